@@ -1,8 +1,12 @@
 #include "AppGui.h"
 
+#include <climits>
+
 #include "RenderEngine.h"
+#include "ClusteredLightCuller.h"
 #include "RenderResources.h"
-#include "GLGPUTimer.h"
+#include "Profiler.h"
+#include "GLBuffer.h"
 
 using namespace nanogui;
 
@@ -91,6 +95,16 @@ AppGui::AppGui(GLFWwindow* window, RenderEngine* render_engine)
    gui->addVariable("z", render_engine->_settings.z)->setSpinnable(true);
    gui->addVariable("z slices", render_engine->_settings.froxel_z_distribution_factor)->setSpinnable(true);  
    addSliderVariable(gui, nanoguiWindow, "bias", &render_engine->_settings.bias, -5.0, 5.0);
+   gui->addGroup("Light culling");
+   gui->addVariable("froxels x", render_engine->_settings.light_froxels_dims.x)->setSpinnable(true);
+   gui->addVariable("froxels y", render_engine->_settings.light_froxels_dims.y)->setSpinnable(true);
+   gui->addVariable("froxels z", render_engine->_settings.light_froxels_dims.z)->setSpinnable(true);
+   gui->addVariable("max lights per froxel", render_engine->_settings.max_lights_per_froxel)->setSpinnable(true);
+   gui->addVariable("mode", render_engine->_settings.light_culling_mode)->setItems({ "Froxel lists", "Z-binned" });
+   gui->addVariable("z bins", render_engine->_settings.light_zbin_count)->setSpinnable(true);
+   gui->addVariable("cull on gpu", render_engine->_settings.light_culling_on_gpu);
+   gui->addVariable("heads in ssbo", render_engine->_settings.light_list_heads_in_ssbo);
+   gui->addVariable("exact spheres", render_engine->_settings.exact_sphere_light_injection);
    gui->addGroup("Volumetric Fog");
    gui->addVariable("enabled", render_engine->_settings.fog_enabled);
    gui->addVariable("scattering", render_engine->_settings.fog_scattering)->setSpinnable(true);   
@@ -99,6 +113,10 @@ AppGui::AppGui(GLFWwindow* window, RenderEngine* render_engine)
    addColorVariable(gui, nanoguiWindow, "color", &render_engine->_settings.fog_scattering_color);
    gui->addGroup("Voxels");
    gui->addVariable("show grid", render_engine->_settings.show_voxel_grid);   
+   gui->addGroup("Surfaces");
+   gui->addVariable("occlusion culling", render_engine->_settings.occlusion_culling);
+   gui->addGroup("Profiler");
+   gui->addButton("save chrome trace", []() { Profiler::writeChromeTrace("yare_trace.json"); });
    
    nanoguiWindow->setPosition(Vector2i(width - nanoguiWindow->preferredSize(screen->nvgContext())[0] - 10, 5));
  
@@ -107,7 +125,7 @@ AppGui::AppGui(GLFWwindow* window, RenderEngine* render_engine)
 
    _hud = new Label(hudWindow, "lol");
    _hud->setFontSize(20);
-   _hud->setFixedSize(Vector2i(200, 0));
+   _hud->setFixedSize(Vector2i(280, 0));
    _hud->setColor(Color(1.0f, 1.0f, 0.0f, 1.0f));
 
    ref<Window> graph_window = new Window(screen, "");
@@ -177,18 +195,32 @@ void AppGui::reportCPUTimings(float render, float update)
 
 void AppGui::_updateHUDText()
 {
-   RenderResources* render_resources = _render_engine->render_resources.get();
-
-   std::string hud_text = string_format("Z PREPASS: %.2fms\n SSAO: %.2fms\n VOLUM FOG:%.2fms\n MATERIALS: %.2fms BACKGROUND: %.2fms\n VOXELIZE: %.2fms\n RAYTRACE: %.2fms\n CPU Render:%.2fms\n CPU Update:%.2fms",
-                                        render_resources->z_pass_timer->elapsedTimeInMs(),
-                                        render_resources->ssao_timer->elapsedTimeInMs(),
-                                        render_resources->volumetric_fog_timer->elapsedTimeInMs(),
-                                        render_resources->material_pass_timer->elapsedTimeInMs(),
-                                        render_resources->background_timer->elapsedTimeInMs(),
-                                        render_resources->voxelize_timer->elapsedTimeInMs(),
-                                        render_resources->raytrace_timer->elapsedTimeInMs(),
+   // the zones of each track, indented by depth
+   std::string hud_text;
+   int track = INT_MIN;
+   for (const auto& zone : Profiler::zoneStats())
+   {
+      if (zone.track != track)
+      {
+         track = zone.track;
+         hud_text += Profiler::trackName(track) + ":\n";
+      }
+      hud_text += string_format("%*s%s: %.2fms\n", 2 * (zone.depth + 1), "", zone.name.c_str(), zone.average_ms);
+   }
+
+   int dropped_light_count = _render_engine->froxeled_light_culler->droppedLightCount();
+   if (dropped_light_count > 0)
+      hud_text += string_format("DROPPED LIGHTS: %d (raise max lights per froxel)\n", dropped_light_count);
+   if (_render_engine->froxeled_light_culler->maxLightsPerFroxel() < _render_engine->_settings.max_lights_per_froxel)
+      hud_text += string_format("MAX LIGHTS PER FROXEL LIMITED TO %d\n", _render_engine->froxeled_light_culler->maxLightsPerFroxel());
+
+   const GLDynamicBufferStalls& stalls = GLDynamicBuffer::stalls();
+   hud_text += string_format("CPU Render:%.2fms\n CPU Update:%.2fms\n SEGMENT STALLS: %d frames %.2fms/%d switches",
                                         _render_time_ms,
-                                       _update_time_ms);
+                                       _update_time_ms,
+                                       stalls.stall_count,
+                                       stalls.stall_time_ms,
+                                       stalls.segment_switch_count);
    _hud->setCaption(hud_text);
 
    for (int i = 0; i < 20; ++i)
@@ -2,14 +2,18 @@
 
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <chrono>
+#include <algorithm>
+#include <cassert>
+#include <climits>
 #include <iostream>
 #include <immintrin.h>
 
 #include "glsl_global_defines.h"
+#include "glsl_light_culling_defines.h"
 #include "GLDevice.h"
 #include "GLTexture.h"
 #include "GLBuffer.h"
+#include "GLFormats.h"
 #include "GLProgram.h"
 #include "GLVertexSource.h"
 #include "Scene.h"
@@ -18,45 +22,313 @@
 #include "matrix_math.h"
 #include "RenderEngine.h"
 #include "simd.h"
-
-#define USE_CHEAP_SPHERE_INJECTION
+#include "Profiler.h"
 
 namespace yare {
 
-static int cMaxLightsPerFroxel = 100;
+// above this light count per froxel and per light type, the counts no longer fit in 10 bits and the
+// list heads use one 32 bits integer per light type
+static const int cMaxPackedLightCount = 0x3FF;
+
+// the light counts of a macro froxel list are stored on 16 bits
+static const int cMaxLightsPerFroxel = 0xFFFF;
+
+// the light list data of all the views and segments stays within this size, max_lights_per_froxel is lowered to fit
+static const std::int64_t cLightListDataBudget = std::int64_t(512) << 20;
+
+// Header of the light list data ssbo, see LightDataSSBO in lighting_uniforms.glsl.
+// In z-binned mode froxels_dims holds the tiles count in x,y and the z bins count in z, and the data is made of:
+// the visible lights sorted by depth, the first and last sorted light of each z bin, and for each tile a bitmask over the sorted lights.
+struct LightListDataHeader
+{
+   ivec3 froxels_dims;
+   int light_counts_packed;
+   int culling_mode;
+   int zbins_offset;
+   int heads_in_ssbo;
+   int padding;
+   ivec4 sorted_lights_offset;
+   ivec4 tile_masks_offset;
+   ivec4 tile_mask_word_count;
+};
+
+// A light prepared for the culling compute shader, see CulledLightsSSBO in light_culling.glsl. The froxel range and the
+// planes are the ones the cpu injection tests, so that both backends build the same lists.
+// The view range of the buffer starts with the index of the first light of each type, and the total light count in w.
+struct GPUCulledLight
+{
+   ivec4 froxel_min; // w is 1 when the light is tested against its view space sphere, held by planes[0]
+   ivec4 froxel_max;
+   vec4 planes[6];
+};
+
+// the widest simd path (AVX-512) processes 4 macro froxels at once, the clip space infos are padded so that
+// the last batch of a row or of the grid can be loaded without reading out of bounds
+static const int cMaxMacroFroxelsPerBatch = 4;
+
+MacroFroxelLightLists::MacroFroxelLightLists(int macro_froxel_count, int max_lights_per_list)
+   : _macro_froxel_count(macro_froxel_count)
+   , _list_capacity(max_lights_per_list)
+   , _generation(1)
+   , _dropped_light_count(0)
+{
+   const int lights_per_cache_line = 64 / sizeof(LightCoverage);
+   _list_stride = (max_lights_per_list + lights_per_cache_line - 1) / lights_per_cache_line * lights_per_cache_line;
+
+   _counts = (MacroFroxelLightCounts*)_aligned_malloc(sizeof(MacroFroxelLightCounts)*macro_froxel_count, 64);
+   memset(_counts, 0, sizeof(MacroFroxelLightCounts)*macro_froxel_count);
+   _lights = (LightCoverage*)_aligned_malloc(sizeof(LightCoverage)*_list_stride * 3 * macro_froxel_count, 64);
+}
+
+MacroFroxelLightLists::~MacroFroxelLightLists()
+{
+   _aligned_free(_counts);
+   _aligned_free(_lights);
+}
+
+void MacroFroxelLightLists::clear()
+{
+   _dropped_light_count = 0;
+   _generation++;
+   if (_generation == 0) // wrapped around, old generations could be mistaken for the current one
+   {
+      memset(_counts, 0, sizeof(MacroFroxelLightCounts)*_macro_froxel_count);
+      _generation = 1;
+   }
+}
+
+void MacroFroxelLightLists::add(int macro_froxel_index, LightType light_type, LightCoverage coverage)
+{
+   MacroFroxelLightCounts& counts = _counts[macro_froxel_index];
+   if (counts.generation != _generation)
+   {
+      counts.generation = _generation;
+      counts.count[0] = counts.count[1] = counts.count[2] = 0;
+   }
+
+   unsigned short& count = counts.count[int(light_type)];
+   if (count < _list_capacity)
+      _list(macro_froxel_index, light_type)[count++] = coverage;
+   else
+      _dropped_light_count++;
+}
+
+void MacroFroxelLightLists::remove(int macro_froxel_index, LightType light_type, int light_index)
+{
+   MacroFroxelLightCounts& counts = _counts[macro_froxel_index];
+   if (counts.generation != _generation)
+      return;
+
+   unsigned short& count = counts.count[int(light_type)];
+   LightCoverage* list = _list(macro_froxel_index, light_type);
+   for (int i = 0; i < count; ++i)
+   {
+      if (list[i].light_index == (unsigned int)light_index)
+      {
+         list[i] = list[--count];
+         return;
+      }
+   }
+}
+
+int MacroFroxelLightLists::count(int macro_froxel_index, LightType light_type) const
+{
+   const MacroFroxelLightCounts& counts = _counts[macro_froxel_index];
+   return (counts.generation == _generation) ? counts.count[int(light_type)] : 0;
+}
+
+const LightCoverage* MacroFroxelLightLists::lights(int macro_froxel_index, LightType light_type) const
+{
+   return _list(macro_froxel_index, light_type);
+}
+
+LightCoverage* MacroFroxelLightLists::_list(int macro_froxel_index, LightType light_type) const
+{
+   return _lights + (macro_froxel_index * 3 + int(light_type)) * _list_stride;
+}
+
+static vec4* _allocateMacroFroxelInfo(int macro_froxel_count)
+{
+   int padded_count = macro_froxel_count + cMaxMacroFroxelsPerBatch - 1;
+   vec4* info = (vec4*)_aligned_malloc(sizeof(vec4)*padded_count, 64);
+   memset(info, 0, sizeof(vec4)*padded_count);
+   return info;
+}
+
+static std::vector<vec4**> _macroFroxelInfoArrays(MacroFroxelInfo& info)
+{
+   return { &info.center_cs.x, &info.center_cs.y, &info.center_cs.z,
+            &info.extent_cs.x, &info.extent_cs.y, &info.extent_cs.z,
+            &info.min_vs.x, &info.min_vs.y, &info.min_vs.z,
+            &info.max_vs.x, &info.max_vs.y, &info.max_vs.z,
+            &info.left_vs.normal_xy, &info.left_vs.normal_z, &info.right_vs.normal_xy, &info.right_vs.normal_z,
+            &info.bottom_vs.normal_xy, &info.bottom_vs.normal_z, &info.top_vs.normal_xy, &info.top_vs.normal_z };
+}
 
 ClusteredLightCuller::ClusteredLightCuller(const RenderResources& render_resources, const RenderSettings& settings)
    : _rr(render_resources)
    , _settings(settings)
 {
-   _froxels_dims = ivec3(24, 24, 32);
-   _froxel_info.resize((_froxels_dims.x + 1) * (_froxels_dims.y + 1) * (_froxels_dims.z + 1));
-   int macro_froxel_count = _froxels_dims.x * _froxels_dims.y * _froxels_dims.z / 2 / 2;
-   _macro_froxel.resize(macro_froxel_count);
-   _macro_froxel_info.center_cs.x = (vec4*)_aligned_malloc(sizeof(vec4)*macro_froxel_count, 16);
-   _macro_froxel_info.center_cs.y = (vec4*)_aligned_malloc(sizeof(vec4)*macro_froxel_count, 16);
-   _macro_froxel_info.center_cs.z = (vec4*)_aligned_malloc(sizeof(vec4)*macro_froxel_count, 16);
-
-   _macro_froxel_info.extent_cs.x = (vec4*)_aligned_malloc(sizeof(vec4)*macro_froxel_count, 16);
-   _macro_froxel_info.extent_cs.y = (vec4*)_aligned_malloc(sizeof(vec4)*macro_froxel_count, 16);
-   _macro_froxel_info.extent_cs.z = (vec4*)_aligned_malloc(sizeof(vec4)*macro_froxel_count, 16);
-
-   _light_list_head_pbo = createDynamicBuffer(_froxels_dims.x* _froxels_dims.y* _froxels_dims.z * sizeof(uvec2));
-   _light_list_head = createTexture3D(_froxels_dims.x, _froxels_dims.y, _froxels_dims.z, GL_RG32UI);
-   _light_list_data = createDynamicBuffer(cMaxLightsPerFroxel * sizeof(int) * _froxels_dims.x * _froxels_dims.y * _froxels_dims.z);
+   _simd_instruction_set = detectSimdInstructionSet();
+   _allocateLightLists(ivec3(0), 1, cMaxLightsPerFroxel);
+
+   _light_culling = createProgramFromFile("light_culling.glsl");
+   _light_list_size = createBuffer(sizeof(unsigned int));
  
    _initDebugData();
 }
 
 ClusteredLightCuller::~ClusteredLightCuller()
 {
-   _aligned_free(_macro_froxel_info.center_cs.x);
-   _aligned_free(_macro_froxel_info.center_cs.y);
-   _aligned_free(_macro_froxel_info.center_cs.z);
+}
+
+LightCullingView::~LightCullingView()
+{
+   for (vec4** info_array : _macroFroxelInfoArrays(macro_froxel_info))
+      _aligned_free(*info_array);
+}
+
+int ClusteredLightCuller::droppedLightCount() const
+{
+   int dropped_light_count = 0;
+   for (const auto& view : _views)
+      dropped_light_count += view->macro_froxel_lights->droppedLightCount();
+   return dropped_light_count;
+}
+
+static ivec3 _validFroxelsDims(const ivec3& froxels_dims)
+{
+   // froxels are injected by blocks of 2x2, the grid must have an even size in x and y
+   return ivec3(max(2, (froxels_dims.x + 1) / 2 * 2), max(2, (froxels_dims.y + 1) / 2 * 2), max(1, froxels_dims.z));
+}
+
+static int _budgetedMaxLightsPerFroxel(int max_lights_per_froxel, const ivec3& froxels_dims, int view_count)
+{
+   std::int64_t froxel_count = std::int64_t(froxels_dims.x) * froxels_dims.y * froxels_dims.z;
+   std::int64_t view_budget = cLightListDataBudget / (GLDynamicBuffer::segmentCount() * view_count);
+   std::int64_t budget_max = (view_budget - (std::int64_t)sizeof(LightListDataHeader)) / (froxel_count * (std::int64_t)sizeof(int));
+   return (int)clamp<std::int64_t>(max_lights_per_froxel, 1, max<std::int64_t>(1, std::min<std::int64_t>(budget_max, cMaxLightsPerFroxel)));
+}
+
+static ivec3 _sceneLightCounts(const Scene& scene)
+{
+   ivec3 light_counts;
+   light_counts[int(LightType::Sphere)] = (int)scene.sphere_lights.size();
+   light_counts[int(LightType::Rectangle)] = (int)scene.rectangle_lights.size();
+   light_counts[int(LightType::Spot)] = (int)scene.spot_lights.size();
+   return light_counts;
+}
+
+void ClusteredLightCuller::updateGridConfiguration(const Scene& scene, int view_count)
+{
+   ivec3 scene_light_counts = _sceneLightCounts(scene);
+
+   bool configuration_changed = max(1, view_count) != (int)_views.size()
+      || _validFroxelsDims(_settings.light_froxels_dims) != _froxels_dims
+      || _settings.max_lights_per_froxel != _requested_max_lights_per_froxel
+      || _settings.light_culling_mode != _culling_mode
+      || _settings.light_culling_on_gpu != _culling_on_gpu
+      || _settings.light_list_heads_in_ssbo != _heads_in_ssbo;
+
+   // the z-binned lists size and the lights prepared for the gpu culling depend on the lights count, the froxel lists do not
+   if (_settings.light_culling_mode == LightCullingMode::ZBinned || _settings.light_culling_on_gpu)
+      configuration_changed |= max(1, _settings.light_zbin_count) != _zbin_count || scene_light_counts != _scene_light_counts;
+
+   if (configuration_changed)
+      _allocateLightLists(scene_light_counts, view_count, cMaxLightsPerFroxel);
+}
+
+void ClusteredLightCuller::_allocateLightLists(const ivec3& scene_light_counts, int view_count, int max_lights_per_froxel_limit)
+{
+   _froxels_dims = _validFroxelsDims(_settings.light_froxels_dims);
+   _requested_max_lights_per_froxel = _settings.max_lights_per_froxel;
+   _max_lights_per_froxel = _budgetedMaxLightsPerFroxel(min(_settings.max_lights_per_froxel, max_lights_per_froxel_limit), _froxels_dims, max(1, view_count));
+   _light_counts_packed = _max_lights_per_froxel <= cMaxPackedLightCount;
+   _culling_mode = _settings.light_culling_mode;
+   _zbin_count = max(1, _settings.light_zbin_count);
+   _culling_on_gpu = _settings.light_culling_on_gpu;
+   _heads_in_ssbo = _settings.light_list_heads_in_ssbo && !_culling_on_gpu && _culling_mode == LightCullingMode::FroxelLists;
+   _scene_light_counts = scene_light_counts;
+   _head_texture_view = -1;
+   _head_texture_lists_version = 0;
+
+   int froxel_count = _froxels_dims.x * _froxels_dims.y * _froxels_dims.z;
+   int macro_froxel_count = froxel_count / 2 / 2;
+
+   _views.clear();
+   for (int i = 0; i < max(1, view_count); ++i)
+   {
+      auto view = std::make_unique<LightCullingView>();
+      view->macro_froxel_lights = std::make_unique<MacroFroxelLightLists>(macro_froxel_count, _max_lights_per_froxel);
+      for (vec4** info_array : _macroFroxelInfoArrays(view->macro_froxel_info))
+         *info_array = _allocateMacroFroxelInfo(macro_froxel_count);
+      view->segment_lists_version.assign(GLDynamicBuffer::segmentCount(), 0);
+      _views.push_back(std::move(view));
+   }
+
+   // the ranges of the views are bound as ssbos, they start on the ssbo offset alignment
+   int storage_buffer_align_size;
+   glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_buffer_align_size);
+   auto view_range_size = [storage_buffer_align_size](std::int64_t size) { return GLFormats::alignSize(size, storage_buffer_align_size); };
+
+   if (_culling_mode == LightCullingMode::ZBinned)
+   {
+      // the list heads are not read in z-binned mode, they are kept to a single texel so that the binding stays valid
+      _view_head_size = view_range_size(sizeof(uvec2));
+      _light_list_head = createTexture3D(1, 1, 1, GL_RG32UI);
+
+      int tile_count = _froxels_dims.x * _froxels_dims.y;
+      int tile_mask_word_count = 0;
+      for (int i = 0; i < 3; ++i)
+         tile_mask_word_count += (scene_light_counts[i] + 31) / 32;
+
+      int sorted_lights_size = scene_light_counts.x + scene_light_counts.y + scene_light_counts.z;
+      int zbins_size = _zbin_count * 3 * 2;
+      _view_data_size = view_range_size(sizeof(LightListDataHeader) + (sorted_lights_size + zbins_size + tile_count * tile_mask_word_count) * sizeof(int));
+   }
+   else if (_culling_on_gpu)
+   {
+      // the compute shader writes the list heads in place, with one 32 bits count per light type
+      _view_head_size = view_range_size(sizeof(uvec2));
+      _light_list_head = createTexture3D(_froxels_dims.x, _froxels_dims.y, _froxels_dims.z, GL_RGBA32UI);
+      _view_data_size = view_range_size(sizeof(LightListDataHeader) + _max_lights_per_froxel * sizeof(int) * froxel_count);
+
+      int light_count = scene_light_counts.x + scene_light_counts.y + scene_light_counts.z;
+      _view_culled_lights_size = view_range_size(sizeof(ivec4) + light_count * sizeof(GPUCulledLight));
+   }
+   else
+   {
+      // when the shaders read the heads from the buffer, the texture is kept to a single texel so that the binding stays valid
+      int head_component_count = _light_counts_packed ? 2 : 4;
+      _view_head_size = view_range_size(froxel_count * head_component_count * sizeof(unsigned int));
+      if (_heads_in_ssbo)
+         _light_list_head = createTexture3D(1, 1, 1, GL_RG32UI);
+      else
+         _light_list_head = createTexture3D(_froxels_dims.x, _froxels_dims.y, _froxels_dims.z, _light_counts_packed ? GL_RG32UI : GL_RGBA32UI);
+      _view_data_size = view_range_size(sizeof(LightListDataHeader) + _max_lights_per_froxel * sizeof(int) * froxel_count);
+   }
+
+   _light_list_head_pbo = createDynamicBuffer(_view_head_size * viewCount());
+   _light_list_data = createDynamicBuffer(_view_data_size * viewCount());
+   _gpu_culled_lights = _culling_on_gpu ? createDynamicBuffer(_view_culled_lights_size * viewCount()) : nullptr;
 
-   _aligned_free(_macro_froxel_info.extent_cs.x);
-   _aligned_free(_macro_froxel_info.extent_cs.y);
-   _aligned_free(_macro_froxel_info.extent_cs.z);
+   // the budget is not the memory left on the gpu, the lists are shrunk until the driver can allocate them
+   bool allocated = _light_list_head_pbo->isMapped() && _light_list_data->isMapped() && (!_gpu_culled_lights || _gpu_culled_lights->isMapped());
+   if (!allocated && _max_lights_per_froxel > 1)
+   {
+      std::cout << "light culling: cannot allocate the lists of " << _max_lights_per_froxel << " lights per froxel, retrying with half" << std::endl;
+      _light_list_head_pbo = nullptr;
+      _light_list_data = nullptr;
+      _gpu_culled_lights = nullptr;
+      _allocateLightLists(scene_light_counts, view_count, _max_lights_per_froxel / 2);
+      return;
+   }
+
+   // the segments not yet written by an update must read as empty lists
+   glClearNamedBufferData(_light_list_head_pbo->id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+   glClearNamedBufferData(_light_list_data->id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+   _initDebugFroxelGrid();
 }
 
 struct intAabb3
@@ -147,72 +419,71 @@ void sphereBoundsForAxis(const vec3& axis, const vec3& sphere_center, float sphe
    return intersection;
 }*/
 
-__forceinline int _overlap(__m128 sse_plane_normal, __m128 sse_dot_plane, __m128* corner_a, __m128* corner_b, __m128* corner_c, __m128* corner_d)
+template<typename simdfloatT>
+__forceinline int _aabbOverlapsFroxel(const simdvec3_t<simdfloatT>& aabb_center, const simdvec3_t<simdfloatT>& aabb_extent,
+                                      const simdvec3_t<simdfloatT>* frustum_planes_xyz, const simdfloatT* frustum_planes_w, int num_planes)
 {
-   __m128 dota = _mm_dp_ps(*corner_a, sse_plane_normal, 0x70 | 0x1);
-   __m128 dotb = _mm_dp_ps(*corner_b, sse_plane_normal, 0x70 | 0x2);
-   __m128 dotc = _mm_dp_ps(*corner_c, sse_plane_normal, 0x70 | 0x4);
-   __m128 dotd = _mm_dp_ps(*corner_d, sse_plane_normal, 0x70 | 0x8);
-
-   __m128 all_dots = _mm_add_ps(dota, dotb);
-   all_dots = _mm_add_ps(all_dots, dotc);
-   all_dots = _mm_add_ps(all_dots, dotd);
+   typename simdfloatT::bool_type test = true;
+   for (int i_plane = 0; i_plane < num_planes; ++i_plane)
+   {
+      simdvec3_t<simdfloatT> plane_normal = frustum_planes_xyz[i_plane];
 
-   __m128 intersection_test = _mm_sub_ps(all_dots, sse_dot_plane);
+      simdfloatT d = dot(aabb_center, plane_normal);
+      simdfloatT r = dot(aabb_extent, abs(plane_normal));
 
-   __m128 zero = _mm_setzero_ps();
-   intersection_test = _mm_cmplt_ps(intersection_test, zero);
+      test &= ((d + r) >= -frustum_planes_w[i_plane]);
+   }
 
-   return _mm_movemask_ps(intersection_test);
+   return movemask(test);
 }
 
-__forceinline __m128 _normalize(__m128 vec)
+template<typename simdfloatT>
+__forceinline simdfloatT _sidePlaneDistance(const MacroFroxelInfo::SidePlane& plane, const simdfloatT& center_xy, const simdfloatT& center_z, int offset)
 {
-   return _mm_mul_ps(vec, _mm_rsqrt_ps(_mm_dp_ps(vec, vec, 0x7F)));
-}
+   simdfloatT normal_xy, normal_z;
+   normal_xy.load((float*)plane.normal_xy + offset);
+   normal_z.load((float*)plane.normal_z + offset);
 
+   return normal_xy * center_xy + normal_z * center_z;
+}
 
-__forceinline int ClusteredLightCuller::_sphereOverlapsFroxel(int x, int y, int z, float sphere_radius, const vec3& sphere_center, const FroxelInfo* froxel_infos)
+// A froxel is the intersection of its view space aabb and of its 4 side planes. The sphere is tested against each of them,
+// so only a sphere close to a froxel edge can be reported overlapping it without touching it.
+template<typename simdfloatT>
+__forceinline int _sphereOverlapsFroxel(const simdvec3_t<simdfloatT>& sphere_center, const simdfloatT& sphere_radius, const MacroFroxelInfo& info, int offset)
 {
-   __m128* center_coord = (__m128*)&froxel_infos[_toFlatFroxelIndex(x, y, z)].center_coord;
-   __m128 sse_sphere_center = _mm_set_ps(1.0, sphere_center.z, sphere_center.y, sphere_center.x);
-   __m128 sse_plane_normal = _normalize(_mm_sub_ps(*center_coord, sse_sphere_center));
-
-   __m128 plane_origin = _mm_add_ps(sse_sphere_center, _mm_mul_ps(_mm_set1_ps(sphere_radius), sse_plane_normal));
-   __m128 sse_dot_plane = _mm_dp_ps(plane_origin, sse_plane_normal, 0x70 | 0xF);
-
-   __m128* corner_a = (__m128*)&froxel_infos[_toFlatFroxelIndex(x + 0, y + 0, z + 0)].corner_coord;
-   __m128* corner_b = (__m128*)&froxel_infos[_toFlatFroxelIndex(x + 1, y + 0, z + 0)].corner_coord;
-   __m128* corner_c = (__m128*)&froxel_infos[_toFlatFroxelIndex(x + 1, y + 1, z + 0)].corner_coord;
-   __m128* corner_d = (__m128*)&froxel_infos[_toFlatFroxelIndex(x + 0, y + 1, z + 0)].corner_coord;
+   simdvec3_t<simdfloatT> aabb_min, aabb_max;
+   aabb_min.load((float*)info.min_vs.x, (float*)info.min_vs.y, (float*)info.min_vs.z, offset);
+   aabb_max.load((float*)info.max_vs.x, (float*)info.max_vs.y, (float*)info.max_vs.z, offset);
 
-   if (_overlap(sse_plane_normal, sse_dot_plane, corner_a, corner_b, corner_c, corner_d))
-      return 1;
+   simdvec3_t<simdfloatT> to_closest_point = max(aabb_min, min(sphere_center, aabb_max)) - sphere_center;
+   typename simdfloatT::bool_type test = dot(to_closest_point, to_closest_point) <= sphere_radius * sphere_radius;
 
-   corner_a = (__m128*)&froxel_infos[_toFlatFroxelIndex(x + 0, y + 0, z + 1)].corner_coord;
-   corner_b = (__m128*)&froxel_infos[_toFlatFroxelIndex(x + 1, y + 0, z + 1)].corner_coord;
-   corner_c = (__m128*)& froxel_infos[_toFlatFroxelIndex(x + 1, y + 1, z + 1)].corner_coord;
-   corner_d = (__m128*)& froxel_infos[_toFlatFroxelIndex(x + 0, y + 1, z + 1)].corner_coord;
+   simdfloatT min_distance = -sphere_radius;
+   test &= _sidePlaneDistance(info.left_vs, sphere_center.x, sphere_center.z, offset) >= min_distance;
+   test &= _sidePlaneDistance(info.right_vs, sphere_center.x, sphere_center.z, offset) >= min_distance;
+   test &= _sidePlaneDistance(info.bottom_vs, sphere_center.y, sphere_center.z, offset) >= min_distance;
+   test &= _sidePlaneDistance(info.top_vs, sphere_center.y, sphere_center.z, offset) >= min_distance;
 
-   return (_overlap(sse_plane_normal, sse_dot_plane, corner_a, corner_b, corner_c, corner_d));
+   return movemask(test);
 }
 
-__forceinline int _aabbOverlapsFroxel(simdvec3 aabb_center, simdvec3 aabb_extent, const simdvec3* frustum_planes_xyz, const simdfloat* frustum_planes_w, int num_planes)
+template<typename simdfloatT>
+struct LightClipPlanes
 {
-   simdbool test = true;
-   for (int i_plane = 0; i_plane < num_planes; ++i_plane)
+   LightClipPlanes(const vec4* planes, int count) : count(count)
    {
-      simdvec3 plane_normal = frustum_planes_xyz[i_plane];
-
-      simdfloat d = dot(aabb_center, plane_normal);
-      simdfloat r = dot(aabb_extent, abs(plane_normal));
-
-      simdbool is_inside = simdbool((d + r) >= -frustum_planes_w[i_plane]);
-      test &= is_inside;
+      for (int i = 0; i < count; ++i)
+      {
+         xyz[i] = simdvec3_t<simdfloatT>(vec3(planes[i].xyz));
+         w[i] = simdfloatT(planes[i].w);
+      }
    }
 
-   return _mm_movemask_ps(test.val);
-}
+   simdvec3_t<simdfloatT> xyz[6];
+   simdfloatT w[6];
+   int count;
+};
 
 
 intAabb3 _convertFroxelNormalizedAABBToIntegerAABB(const Aabb3& clip_space_aabb, const ivec3& light_froxels_dims)
@@ -229,126 +500,441 @@ intAabb3 _convertFroxelNormalizedAABBToIntegerAABB(const Aabb3& clip_space_aabb,
 }
 
 
-static mat4 _matrix_light_proj_local;
-
-
-__forceinline simdfloat _convertFroxelZtoCameraZ(simdfloat froxel_z, simdfloat znear, simdfloat zfar, int froxel_z_distribution_factor)
+template<typename simdfloatT>
+__forceinline simdfloatT _convertFroxelZtoCameraZ(simdfloatT froxel_z, simdfloatT znear, simdfloatT zfar, int froxel_z_distribution_factor)
 {
-   simdfloat z = froxel_z;
+   simdfloatT z = froxel_z;
    for (int i = 0; i < froxel_z_distribution_factor - 1; ++i)
       z = z*froxel_z;//pow(froxel_z, simdfloat(3.0f));
 
    return -mix(znear, zfar, z);
 }
 
-__forceinline simdvec3 _froxelCorner(const simdvec3 ndc_coords, const simdvec3& froxel_dims, const simdfrustum& frustum, int froxel_z_distribution_factor)
+template<typename simdfloatT>
+__forceinline simdvec3_t<simdfloatT> _froxelCorner(const simdvec3_t<simdfloatT> ndc_coords, const simdvec3_t<simdfloatT>& froxel_dims, const simdfrustum_t<simdfloatT>& frustum, int froxel_z_distribution_factor)
 {
-   simdfloat z = _convertFroxelZtoCameraZ(ndc_coords.z * froxel_dims.z, frustum.near, frustum.far, froxel_z_distribution_factor);
+   simdfloatT z = _convertFroxelZtoCameraZ(ndc_coords.z * froxel_dims.z, frustum.near, frustum.far, froxel_z_distribution_factor);
 
-   simdfloat ratio = -z / frustum.near;
-   simdfloat x = mix(frustum.left, frustum.right, ndc_coords.x * froxel_dims.x) * ratio;
-   simdfloat y = mix(frustum.bottom, frustum.top, ndc_coords.y * froxel_dims.y) * ratio;
+   simdfloatT ratio = -z / frustum.near;
+   simdfloatT x = mix(frustum.left, frustum.right, ndc_coords.x * froxel_dims.x) * ratio;
+   simdfloatT y = mix(frustum.bottom, frustum.top, ndc_coords.y * froxel_dims.y) * ratio;
 
-   return simdvec3(x, y, z);
+   return simdvec3_t<simdfloatT>(x, y, z);
 }
 
-__forceinline simdvec3 _project(const simdmat4& matrix, const simdvec3& point)
+template<typename simdfloatT>
+__forceinline simdvec3_t<simdfloatT> _project(const simdmat4_t<simdfloatT>& matrix, const simdvec3_t<simdfloatT>& point)
 {
-   simdvec4 vec_hs = matrix * simdvec4(point.x, point.y, point.z, simdfloat(1.0f));
-   return simdvec3(vec_hs.x, vec_hs.y, vec_hs.z) / simdvec3(vec_hs.w);
+   simdvec4_t<simdfloatT> vec_hs = matrix * simdvec4_t<simdfloatT>(point.x, point.y, point.z, simdfloatT(1.0f));
+   return simdvec3_t<simdfloatT>(vec_hs.x, vec_hs.y, vec_hs.z) / simdvec3_t<simdfloatT>(vec_hs.w);
 }
 
-__forceinline void _computeFroxelCenterAndExtent(const simdfrustum& frustum, const simdmat4& matrix_proj_view, const simdvec3& light_froxels_dims,
-                                            simdfloat x, simdfloat y, simdfloat z, simdvec3* center, simdvec3* extent, int froxel_z_distribution_factor)
+template<typename simdfloatT>
+__forceinline void _computeFroxelCenterAndExtent(const simdfrustum_t<simdfloatT>& frustum, const simdmat4_t<simdfloatT>& matrix_proj_view, const simdvec3_t<simdfloatT>& light_froxels_dims,
+                                                 simdfloatT x, simdfloatT y, simdfloatT z, simdvec3_t<simdfloatT>* center, simdvec3_t<simdfloatT>* extent, int froxel_z_distribution_factor)
 {
-   simdvec3 aabb_min = _project(matrix_proj_view, _froxelCorner(simdvec3(x, y, z), light_froxels_dims, frustum, froxel_z_distribution_factor));
-   simdvec3 aabb_max = _project(matrix_proj_view, _froxelCorner(simdvec3(x + simdfloat(1.0f), y + simdfloat(1.0f), z + simdfloat(1.0f)), light_froxels_dims, frustum, froxel_z_distribution_factor));
+   simdfloatT one(1.0f);
+   simdvec3_t<simdfloatT> aabb_min = _project(matrix_proj_view, _froxelCorner(simdvec3_t<simdfloatT>(x, y, z), light_froxels_dims, frustum, froxel_z_distribution_factor));
+   simdvec3_t<simdfloatT> aabb_max = _project(matrix_proj_view, _froxelCorner(simdvec3_t<simdfloatT>(x + one, y + one, z + one), light_froxels_dims, frustum, froxel_z_distribution_factor));
 
-   *center = simdfloat(0.5f) * (aabb_min + aabb_max);
-   *extent = simdfloat(0.5f) * (aabb_max - aabb_min);
+   *center = simdfloatT(0.5f) * (aabb_min + aabb_max);
+   *extent = simdfloatT(0.5f) * (aabb_max - aabb_min);
 }
 
+template<typename simdfloatT>
+void ClusteredLightCuller::_updateMacroFroxelInfo(LightCullingView& view, const RenderData& render_data)
+{
+   const int macro_froxels_per_batch = simdfloatT::width / 4;
+   int macro_froxel_count = view.macro_froxel_lights->macroFroxelCount();
+   int macro_froxels_per_slice = _froxels_dims.x * _froxels_dims.y / 4;
+   int macro_froxels_per_row = _froxels_dims.x / 2;
+
+   simdfrustum_t<simdfloatT> frustum;
+   frustum.left   = simdfloatT(render_data.frustum.left);
+   frustum.right  = simdfloatT(render_data.frustum.right);
+   frustum.bottom = simdfloatT(render_data.frustum.bottom);
+   frustum.top    = simdfloatT(render_data.frustum.top);
+   frustum.near   = simdfloatT(render_data.frustum.near);
+   frustum.far    = simdfloatT(render_data.frustum.far);
+
+   simdmat4_t<simdfloatT> matrix_proj_view(render_data.matrix_proj_view);
+   simdvec3_t<simdfloatT> light_froxels_dims(1.0f / vec3(_froxels_dims));
+
+   // lane order inside a macro froxel matches the sub froxel bit of LightCoverage::mask
+   _declspec(align(64)) float lanes_x[16];
+   _declspec(align(64)) float lanes_y[16];
+   _declspec(align(64)) float lanes_z[16];
+
+   // the last batch may overlap the padding at the end of the info arrays
+   for (int i = 0; i < macro_froxel_count; i += macro_froxels_per_batch)
+   {
+      for (int k = 0; k < macro_froxels_per_batch; ++k)
+      {
+         int macro_z = (i + k) / macro_froxels_per_slice;
+         int slice_flat = (i + k) % macro_froxels_per_slice;
+         float x = 2.0f * float(slice_flat % macro_froxels_per_row);
+         float y = 2.0f * float(slice_flat / macro_froxels_per_row);
+
+         lanes_x[4 * k + 0] = x;   lanes_x[4 * k + 1] = x + 1.0f; lanes_x[4 * k + 2] = x;        lanes_x[4 * k + 3] = x + 1.0f;
+         lanes_y[4 * k + 0] = y;   lanes_y[4 * k + 1] = y;        lanes_y[4 * k + 2] = y + 1.0f; lanes_y[4 * k + 3] = y + 1.0f;
+         lanes_z[4 * k + 0] = lanes_z[4 * k + 1] = lanes_z[4 * k + 2] = lanes_z[4 * k + 3] = float(macro_z);
+      }
 
-void ClusteredLightCuller::buildLightLists(const Scene& scene, RenderData& render_data)
+      simdfloatT x_, y_, z_;
+      x_.load(lanes_x);
+      y_.load(lanes_y);
+      z_.load(lanes_z);
+
+      simdvec3_t<simdfloatT> center, extent;
+      _computeFroxelCenterAndExtent(frustum, matrix_proj_view, light_froxels_dims, x_, y_, z_, &center, &extent, (int)_settings.froxel_z_distribution_factor);
+
+      center.x.store((float*)&view.macro_froxel_info.center_cs.x[i]);
+      center.y.store((float*)&view.macro_froxel_info.center_cs.y[i]);
+      center.z.store((float*)&view.macro_froxel_info.center_cs.z[i]);
+
+      extent.x.store((float*)&view.macro_froxel_info.extent_cs.x[i]);
+      extent.y.store((float*)&view.macro_froxel_info.extent_cs.y[i]);
+      extent.z.store((float*)&view.macro_froxel_info.extent_cs.z[i]);
+   }
+
+   simdfloatT::leaveSection();
+}
+
+void ClusteredLightCuller::_updateMacroFroxelViewSpaceInfo(LightCullingView& view, const RenderData& render_data)
 {
-   
+   const Frustum& frustum = render_data.frustum;
+   int macro_froxels_per_slice = _froxels_dims.x * _froxels_dims.y / 4;
+   int macro_froxels_per_row = _froxels_dims.x / 2;
+   int macro_froxel_count = view.macro_froxel_lights->macroFroxelCount();
 
-#ifndef USE_CHEAP_SPHERE_INJECTION
-   for (int z = 0; z <= _froxels_dims.z; z++)
+   for (int i = 0; i < macro_froxel_count; ++i)
    {
-      for (int y = 0; y <= _froxels_dims.y; y++)
+      int z = i / macro_froxels_per_slice;
+      int slice_flat = i % macro_froxels_per_slice;
+      float depth_min = -_convertFroxelZtoCameraZ(float(z) / _froxels_dims.z, frustum.near, frustum.far);
+      float depth_max = -_convertFroxelZtoCameraZ(float(z + 1) / _froxels_dims.z, frustum.near, frustum.far);
+
+      // same lane order as _updateMacroFroxelInfo
+      for (int k = 0; k < 4; ++k)
       {
-         for (int x = 0; x <= _froxels_dims.x; x++)
-         {
-            _froxel_info[_toFlatFroxelIndex(x, y, z)].center_coord = _froxelCorner(vec3(x, y, z) + vec3(0.5), _froxels_dims, render_data);
-            _froxel_info[_toFlatFroxelIndex(x, y, z)].corner_coord = _froxelCorner(vec3(x, y, z), _froxels_dims, render_data);
-         }
+         int x = 2 * (slice_flat % macro_froxels_per_row) + (k % 2);
+         int y = 2 * (slice_flat / macro_froxels_per_row) + (k / 2);
+
+         // froxel bounds on the near plane, they scale with depth / near
+         float left = mix(frustum.left, frustum.right, float(x) / _froxels_dims.x);
+         float right = mix(frustum.left, frustum.right, float(x + 1) / _froxels_dims.x);
+         float bottom = mix(frustum.bottom, frustum.top, float(y) / _froxels_dims.y);
+         float top = mix(frustum.bottom, frustum.top, float(y + 1) / _froxels_dims.y);
+
+         float rcp_near = 1.0f / frustum.near;
+         view.macro_froxel_info.min_vs.x[i][k] = min(left * depth_min, left * depth_max) * rcp_near;
+         view.macro_froxel_info.min_vs.y[i][k] = min(bottom * depth_min, bottom * depth_max) * rcp_near;
+         view.macro_froxel_info.min_vs.z[i][k] = -depth_max;
+         view.macro_froxel_info.max_vs.x[i][k] = max(right * depth_min, right * depth_max) * rcp_near;
+         view.macro_froxel_info.max_vs.y[i][k] = max(top * depth_min, top * depth_max) * rcp_near;
+         view.macro_froxel_info.max_vs.z[i][k] = -depth_min;
+
+         // the left plane contains the points where x * near + left * z = 0, the inside has x greater than on the plane
+         vec2 left_normal = normalize(vec2(frustum.near, left));
+         vec2 right_normal = -normalize(vec2(frustum.near, right));
+         vec2 bottom_normal = normalize(vec2(frustum.near, bottom));
+         vec2 top_normal = -normalize(vec2(frustum.near, top));
+         view.macro_froxel_info.left_vs.normal_xy[i][k] = left_normal.x;
+         view.macro_froxel_info.left_vs.normal_z[i][k] = left_normal.y;
+         view.macro_froxel_info.right_vs.normal_xy[i][k] = right_normal.x;
+         view.macro_froxel_info.right_vs.normal_z[i][k] = right_normal.y;
+         view.macro_froxel_info.bottom_vs.normal_xy[i][k] = bottom_normal.x;
+         view.macro_froxel_info.bottom_vs.normal_z[i][k] = bottom_normal.y;
+         view.macro_froxel_info.top_vs.normal_xy[i][k] = top_normal.x;
+         view.macro_froxel_info.top_vs.normal_z[i][k] = top_normal.y;
       }
    }
+}
+
+static bool _sameFrustum(const Frustum& a, const Frustum& b)
+{
+   return a.left == b.left && a.right == b.right && a.bottom == b.bottom
+      && a.top == b.top && a.near == b.near && a.far == b.far;
+}
+
+bool ClusteredLightCuller::_froxelGeometryIsOutdated(const LightCullingView& view, const RenderData& render_data) const
+{
+   return !view.froxel_geometry_valid
+      || view.froxel_geometry_matrix_proj_view != render_data.matrix_proj_view
+      || !_sameFrustum(view.froxel_geometry_frustum, render_data.frustum)
+      || view.froxel_geometry_z_distribution_factor != _settings.froxel_z_distribution_factor
+      || view.froxel_geometry_exact_spheres != _settings.exact_sphere_light_injection;
+}
+
+void ClusteredLightCuller::_updateFroxelGeometry(LightCullingView& view, const RenderData& render_data)
+{
+   // the view space info is only read by the exact sphere lights test
+   if (_settings.exact_sphere_light_injection)
+      _updateMacroFroxelViewSpaceInfo(view, render_data);
+
+   switch (_simd_instruction_set)
+   {
+#ifdef SIMD_AVX512
+   case SimdInstructionSet::AVX512:
+      _updateMacroFroxelInfo<simdfloat16>(view, render_data);
+      break;
 #endif
+   case SimdInstructionSet::AVX:
+      _updateMacroFroxelInfo<simdfloat8>(view, render_data);
+      break;
+   default:
+      _updateMacroFroxelInfo<simdfloat>(view, render_data);
+      break;
+   }
+
+   view.froxel_geometry_matrix_proj_view = render_data.matrix_proj_view;
+   view.froxel_geometry_frustum = render_data.frustum;
+   view.froxel_geometry_z_distribution_factor = _settings.froxel_z_distribution_factor;
+   view.froxel_geometry_exact_spheres = _settings.exact_sphere_light_injection;
+   view.froxel_geometry_valid = true;
+}
+
+void ClusteredLightCuller::buildLightLists(const Scene& scene, RenderData* const* views, int view_count)
+{
+   assert(view_count <= viewCount());
+   _shared_data.update(scene);
+
+   for (int i = 0; i < view_count; ++i)
+      _buildViewLightLists(scene, *views[i], i);
+}
+
+void ClusteredLightCuller::_buildViewLightLists(const Scene& scene, RenderData& render_data, int view_index)
+{
+   if (_culling_mode == LightCullingMode::ZBinned)
+   {
+      _buildZBinnedLightLists(scene, render_data, view_index);
+      return;
+   }
+
+   if (_culling_on_gpu)
+   {
+      _prepareGPULightCulling(scene, render_data, view_index);
+      return;
+   }
+
+   LightCullingView& view = *_views[view_index];
+   bool froxel_geometry_changed = _froxelGeometryIsOutdated(view, render_data);
+   if (froxel_geometry_changed)
+      _updateFroxelGeometry(view, render_data);
 
-   for (int z = 0; z < _froxels_dims.z; z++)
+   Profiler::beginCPUZone("inject lights");
+   if (_prepareLightsInjection(view, scene, render_data, froxel_geometry_changed))
    {
-      for (int y = 0; y < (_froxels_dims.y / 2); y++)
+      _injectLightsIntoFroxels(view, scene, render_data);
+      view.lists_version++;
+   }
+   Profiler::endCPUZone();
+
+   int segment_index = GLDynamicBuffer::updateSegmentIndex();
+   if (view.segment_lists_version[segment_index] != view.lists_version)
+   {
+      _updateFroxelsGLData(view, view_index);
+      view.segment_lists_version[segment_index] = view.lists_version;
+   }
+}
+
+static const std::vector<Light>& _sceneLights(const Scene& scene, LightType light_type)
+{
+   switch (light_type)
+   {
+   case LightType::Sphere:
+      return scene.sphere_lights;
+   case LightType::Spot:
+      return scene.spot_lights;
+   default:
+      return scene.rectangle_lights;
+   }
+}
+
+static int _spotLightBoundingVertices(const Light& light, vec3* vertices)
+{
+   float w = light.radius * tan(light.spot.angle*0.5f);
+   float l = light.radius;
+
+   vertices[0] = vec3(0.0f, 0.0f, 0.0f);
+   vertices[1] = vec3(w, w, -l);
+   vertices[2] = vec3(-w, w, -l);
+   vertices[3] = vec3(-w, -w, -l);
+   vertices[4] = vec3(w, -w, -l);
+   return 5;
+}
+
+static int _rectangleLightBoundingVertices(const Light& light, vec3* vertices)
+{
+   float w = light.rectangle.bounds_width;
+   float h = light.rectangle.bounds_height;
+   float d = light.rectangle.bounds_depth;
+
+   vertices[0] = vec3(w, h, 0.0);
+   vertices[1] = vec3(-w, h, 0.0);
+   vertices[2] = vec3(-w, -h, 0.0);
+   vertices[3] = vec3(w, -h, 0.0);
+   vertices[4] = vec3(w, h, -d);
+   vertices[5] = vec3(-w, h, -d);
+   vertices[6] = vec3(-w, -h, -d);
+   vertices[7] = vec3(w, -h, -d);
+   return 8;
+}
+
+// world space bounds of the light influence volume
+static Aabb3 _lightWorldBounds(const Light& light, LightType light_type)
+{
+   vec3 vertices[8];
+   int vertex_count;
+   if (light_type == LightType::Sphere)
+   {
+      for (int i = 0; i < 8; ++i)
+         vertices[i] = vec3((i & 1) ? light.radius : -light.radius, (i & 2) ? light.radius : -light.radius, (i & 4) ? light.radius : -light.radius);
+      vertex_count = 8;
+   }
+   else if (light_type == LightType::Spot)
+   {
+      vertex_count = _spotLightBoundingVertices(light, vertices);
+   }
+   else
+   {
+      vertex_count = _rectangleLightBoundingVertices(light, vertices);
+   }
+
+   Aabb3 bounds;
+   for (int i = 0; i < vertex_count; ++i)
+      bounds.extend(light.world_to_local_matrix * vec4(vertices[i], 1.0f));
+   return bounds;
+}
+
+// compares every field the froxel coverage of a light depends on, the color and the strength are left out
+static bool _lightCoverageChanged(const Light& old_light, const Light& light, LightType light_type)
+{
+   if (old_light.world_to_local_matrix != light.world_to_local_matrix || old_light.radius != light.radius)
+      return true;
+
+   for (int k = 0; k < 6; ++k)
+   {
+      if (old_light.frustum_planes_in_local[k] != light.frustum_planes_in_local[k])
+         return true;
+   }
+
+   if (light_type == LightType::Spot)
+      return old_light.spot.angle != light.spot.angle;
+   if (light_type == LightType::Rectangle)
+      return old_light.rectangle.bounds_width != light.rectangle.bounds_width
+          || old_light.rectangle.bounds_height != light.rectangle.bounds_height
+          || old_light.rectangle.bounds_depth != light.rectangle.bounds_depth;
+   return false;
+}
+
+void SharedLightCullingData::update(const Scene& scene)
+{
+   bool light_count_changed = false;
+   bool any_light_moved = false;
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      const auto& scene_lights = _sceneLights(scene, LightType(light_type));
+      light_count_changed |= scene_lights.size() != lights[light_type].size();
+      lights[light_type].resize(scene_lights.size());
+      world_bounds[light_type].resize(scene_lights.size());
+
+      for (int i = 0; i < (int)scene_lights.size(); ++i)
       {
-         for (int x = 0; x < (_froxels_dims.x / 2); x++)
-         {
-            _macro_froxel[_toFlatMacroFroxelIndex(x, y, z)].lights[0].resize(0);
-            _macro_froxel[_toFlatMacroFroxelIndex(x, y, z)].lights[1].resize(0);
-            _macro_froxel[_toFlatMacroFroxelIndex(x, y, z)].lights[2].resize(0);
-         }
+         const Light& light = scene_lights[i];
+         SharedLight& shared_light = lights[light_type][i];
+         if (!_lightCoverageChanged(shared_light.light, light, LightType(light_type)))
+            continue;
+
+         // planes transform with the inverse transpose, the views only have to apply their own projection on top
+         mat4 matrix_plane_world_to_local = transpose(inverse(toMat4(light.world_to_local_matrix)));
+         for (int k = 0; k < 6; ++k)
+            shared_light.world_planes[k] = matrix_plane_world_to_local * light.frustum_planes_in_local[k];
+
+         shared_light.light = light;
+         world_bounds[light_type][i] = _lightWorldBounds(light, LightType(light_type));
+         any_light_moved = true;
       }
    }
-   
-   
-   simdfrustum frustum;
-   frustum.left   = simdfloat(render_data.frustum.left);
-   frustum.right  = simdfloat(render_data.frustum.right);
-   frustum.bottom = simdfloat(render_data.frustum.bottom);
-   frustum.top    = simdfloat(render_data.frustum.top);
-   frustum.near   = simdfloat(render_data.frustum.near);
-   frustum.far    = simdfloat(render_data.frustum.far);
 
-   simdmat4 matrix_proj_view(render_data.matrix_proj_view);
-   vec3 temp = 1.0f/vec3(_froxels_dims);
-   simdvec3 light_froxels_dims(temp);   
+   // the bvh structure depends on the lights count, its bounds on the lights position
+   if (light_count_changed)
+      bvh.build(world_bounds);
+   else if (any_light_moved)
+      bvh.refit(world_bounds);
+}
+
+bool ClusteredLightCuller::_prepareLightsInjection(LightCullingView& view, const Scene& scene, const RenderData& render_data, bool froxel_geometry_changed)
+{
+   bool light_count_changed = false;
+   for (int light_type = 0; light_type < 3; ++light_type)
+      light_count_changed |= _sceneLights(scene, LightType(light_type)).size() != view.injected_lights[light_type].size();
+
+   bool reinject_all_lights = froxel_geometry_changed || light_count_changed || render_data.matrix_proj_world != view.injected_matrix_proj_world;
 
-   for (int z = 0; z < _froxels_dims.z; z++)
+   bool any_light_moved = false;
+   for (int light_type = 0; light_type < 3; ++light_type)
    {
-      for (int y = 0; y < (_froxels_dims.y / 2); y++)
+      const auto& lights = _sceneLights(scene, LightType(light_type));
+      auto& injected_lights = view.injected_lights[light_type];
+      injected_lights.resize(lights.size());
+
+      for (int i = 0; i < (int)lights.size(); ++i)
       {
-         for (int x = 0; x < (_froxels_dims.x / 2); x++)
-         {
-            simdfloat x_, y_, z_;
-            x_.load(2.0f*x+1.0f, 2.0f*x, 2.0f*x+1.0f, 2.0f*x);
-            y_.load(2.0f*y+1.0f, 2.0f*y+1.0f, 2.0f*y, 2.0f*y);
-            z_.load(float(z), float(z), float(z), float(z));
+         InjectedLight& injected_light = injected_lights[i];
+         bool light_moved = _lightCoverageChanged(injected_light.light, lights[i], LightType(light_type));
+         injected_light.needs_injection = light_moved;
+         any_light_moved |= light_moved;
+      }
+   }
 
-            simdvec3 center, extent;
-            _computeFroxelCenterAndExtent(frustum, matrix_proj_view, light_froxels_dims, x_, y_, z_, &center, &extent, (int)_settings.froxel_z_distribution_factor);
+   // a light dropped by a full list is not injected again when it stays still, the lights that move away may free
+   // room for it: the lists are rebuilt until none is dropped
+   reinject_all_lights |= any_light_moved && view.macro_froxel_lights->droppedLightCount() > 0;
+   if (!reinject_all_lights && !any_light_moved)
+      return false;
 
-            int index = _toFlatMacroFroxelIndex(x, y, z);
-            _mm_store_ps((float*)&_macro_froxel_info.center_cs.x[index], center.x.val);
-            _mm_store_ps((float*)&_macro_froxel_info.center_cs.y[index], center.y.val);
-            _mm_store_ps((float*)&_macro_froxel_info.center_cs.z[index], center.z.val);
+   if (reinject_all_lights)
+   {
+      view.macro_froxel_lights->clear();
+      view.injected_matrix_proj_world = render_data.matrix_proj_world;
+   }
+
+   _cullLightsOutsideView(render_data);
 
-            _mm_store_ps((float*)&_macro_froxel_info.extent_cs.x[index], extent.x.val);
-            _mm_store_ps((float*)&_macro_froxel_info.extent_cs.y[index], extent.y.val);
-            _mm_store_ps((float*)&_macro_froxel_info.extent_cs.z[index], extent.z.val);
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      const auto& lights = _sceneLights(scene, LightType(light_type));
+      for (int i = 0; i < (int)lights.size(); ++i)
+      {
+         InjectedLight& injected_light = view.injected_lights[light_type][i];
+         if (!reinject_all_lights && !injected_light.needs_injection)
+            continue;
+
+         // the lists still hold the light where it was, remove it from the macro froxels it was injected into
+         if (!reinject_all_lights && injected_light.in_lists)
+         {
+            for (int z = injected_light.macro_froxel_min.z; z <= injected_light.macro_froxel_max.z; z++)
+               for (int y = injected_light.macro_froxel_min.y; y <= injected_light.macro_froxel_max.y; y++)
+                  for (int x = injected_light.macro_froxel_min.x; x <= injected_light.macro_froxel_max.x; x++)
+                     view.macro_froxel_lights->remove(_toFlatMacroFroxelIndex(x, y, z), LightType(light_type), i);
          }
+
+         injected_light.light = lights[i];
+         injected_light.in_lists = _visible_lights[light_type][i] != 0;
+         injected_light.needs_injection = injected_light.in_lists;
       }
    }
 
-   auto start = std::chrono::steady_clock::now();
-      
-   _injectSphereLightsIntoFroxels(scene, render_data);
-   _injectSpotLightsIntoFroxels(scene, render_data);
-   _injectRectangleLightsIntoFroxels(scene, render_data);
+   return true;
+}
 
-   float duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
-   //std::cout << duration*1000.0f << std::endl;
-   _updateFroxelsGLData();
-   
+// lights outside of the view frustum, which also bounds the froxels in depth, are not injected
+void ClusteredLightCuller::_cullLightsOutsideView(const RenderData& render_data)
+{
+   vec4 frustum_planes[6];
+   extractFrustumPlanes(render_data.matrix_proj_world, frustum_planes);
+   _shared_data.bvh.cullLights(frustum_planes, 6, _visible_lights);
 }
 
 vec3* _drawCross(const vec3& center, vec3* buffer)
@@ -385,7 +971,8 @@ void ClusteredLightCuller::drawFroxelGrid(const RenderData& render_data, int ind
 
    _debug_lines_source->setVertexCount(100 * 4);
    GLDevice::bindProgram(*_debug_draw);
-   GLDevice::bindUniformMatrix4(0, _matrix_light_proj_local);
+   // the points are in world space, drawn from the current camera
+   GLDevice::bindUniformMatrix4(0, render_data.matrix_proj_world);
    GLDevice::draw(*_debug_lines_source);
 
    glUseProgram(0);
@@ -396,13 +983,12 @@ void ClusteredLightCuller::debugUpdateFroxeledGrid(RenderData& render_data)
 {
    _debug_render_data = render_data;
 
-
-   _updateFroxelsGLData();
+   const LightCullingView& view = *_views[0];
+   _updateFroxelsGLData(view, 0);
 
    int* enabled_froxels = (int*)_debug_enabled_froxels->map(GL_MAP_WRITE_BIT);
-   for (int i = 0; i <_macro_froxel.size(); ++i)
+   for (int i = 0; i < view.macro_froxel_lights->macroFroxelCount(); ++i)
    {
-      const auto& cpu_froxel = _macro_froxel[i];
       for (int sub_froxel = 0; sub_froxel < 4; sub_froxel++)
       {
          int macro_z = i / (_froxels_dims.y * _froxels_dims.x / 4);
@@ -419,9 +1005,10 @@ void ClusteredLightCuller::debugUpdateFroxeledGrid(RenderData& render_data)
          unsigned int sphere_light_count = 0;
 
          enabled_froxels[_toFlatFroxelIndex(sub_x, sub_y, sub_z)] = false;
-         for (int j = 0; j < cpu_froxel.lights[int(LightType::Sphere)].size(); ++j)
+         const LightCoverage* sphere_lights = view.macro_froxel_lights->lights(i, LightType::Sphere);
+         for (int j = 0; j < view.macro_froxel_lights->count(i, LightType::Sphere); ++j)
          {
-            if ((1 << sub_froxel) & cpu_froxel.lights[int(LightType::Sphere)][j].mask)
+            if ((1 << sub_froxel) & sphere_lights[j].mask)
                enabled_froxels[_toFlatFroxelIndex(sub_x, sub_y, sub_z)] = true;
          }
       }
@@ -431,17 +1018,61 @@ void ClusteredLightCuller::debugUpdateFroxeledGrid(RenderData& render_data)
 
 }
 
-void ClusteredLightCuller::bindLightLists()
+void ClusteredLightCuller::bindLightLists(int view_index)
 {
    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_LIGHT_LIST_DATA_SSBO, _light_list_data->id(),
-                     _light_list_data->getRenderSegmentOffset(), _light_list_data->segmentSize());
+                     _light_list_data->getRenderSegmentOffset() + view_index * _view_data_size, _view_data_size);
 
    GLDevice::bindTexture(BI_LIGHT_LIST_HEAD, *_light_list_head, *_rr.samplers.mipmap_clampToEdge);
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_LIGHT_LIST_HEAD_SSBO, _light_list_head_pbo->id(),
+                     _light_list_head_pbo->getRenderSegmentOffset() + view_index * _view_head_size, _view_head_size);
 }
 
-void ClusteredLightCuller::updateLightListHeadTexture()
+void ClusteredLightCuller::updateLightListHeadTexture(const RenderData& render_data, int view_index)
 {
-   _light_list_head->updateFromBuffer(*_light_list_head_pbo, _light_list_head_pbo->getRenderSegmentOffset());
+   if (_culling_on_gpu && _culling_mode == LightCullingMode::FroxelLists)
+   {
+      _cullLightsOnGPU(render_data, view_index);
+      return;
+   }
+
+   if (_heads_in_ssbo)
+      return;
+
+   // the texture already holds the lists of the render segment when they did not change since the last upload of the same view
+   unsigned int lists_version = _views[view_index]->segment_lists_version[GLDynamicBuffer::renderSegmentIndex()];
+   if (lists_version == 0 || lists_version != _head_texture_lists_version || view_index != _head_texture_view)
+   {
+      _light_list_head->updateFromBuffer(*_light_list_head_pbo, _light_list_head_pbo->getRenderSegmentOffset() + view_index * _view_head_size);
+      _head_texture_lists_version = lists_version;
+      _head_texture_view = view_index;
+   }
+}
+
+void ClusteredLightCuller::_cullLightsOnGPU(const RenderData& render_data, int view_index)
+{
+   glClearNamedBufferData(_light_list_size->id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+   // the lists are written after the header of the view range of the render segment, which was filled by the last update
+   std::int64_t list_capacity = (_view_data_size - sizeof(LightListDataHeader)) / sizeof(int);
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_LIGHT_LIST_DATA_SSBO, _light_list_data->id(),
+                     _light_list_data->getRenderSegmentOffset() + view_index * _view_data_size, _view_data_size);
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BI_LIGHT_LIST_SIZE_SSBO, _light_list_size->id());
+
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_CULLED_LIGHTS_SSBO, _gpu_culled_lights->id(),
+                     _gpu_culled_lights->getRenderSegmentOffset() + view_index * _view_culled_lights_size, _view_culled_lights_size);
+
+   GLDevice::bindProgram(*_light_culling);
+   GLDevice::bindUniformMatrix4(BI_MATRIX_PROJ_VIEW, render_data.matrix_proj_view);
+   glUniform4f(BI_FRUSTUM, render_data.frustum.left, render_data.frustum.right, render_data.frustum.bottom, render_data.frustum.top);
+   glUniform2f(BI_ZNEAR_ZFAR, render_data.frustum.near, render_data.frustum.far);
+   glUniform1f(BI_FROXEL_Z_DISTRIBUTION_FACTOR, _settings.froxel_z_distribution_factor);
+   glUniform1ui(BI_MAX_LIGHTS_PER_FROXEL, _max_lights_per_froxel);
+   glUniform1ui(BI_LIGHT_LIST_CAPACITY, (GLuint)list_capacity);
+   GLDevice::bindImage(BI_LIGHT_LIST_HEAD_IMAGE, *_light_list_head, GL_WRITE_ONLY);
+
+   glDispatchCompute((_froxels_dims.x + 3) / 4, (_froxels_dims.y + 3) / 4, (_froxels_dims.z + 3) / 4);
+   glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 }
 
 
@@ -455,254 +1086,508 @@ int ClusteredLightCuller::_toFlatMacroFroxelIndex(int x, int y, int z)
    return x + y*(_froxels_dims.x / 2) + z*(_froxels_dims.x*_froxels_dims.y / 4);
 }
 
-struct FroxelListHead
-{
-   unsigned int list_start_offset;
-   unsigned int light_counts;
-};
-
-void ClusteredLightCuller::_updateFroxelsGLData()
+void ClusteredLightCuller::_updateFroxelsGLData(const LightCullingView& view, int view_index)
 {
-   auto start = std::chrono::steady_clock::now();
+   CPUProfileZone profile_zone("upload light lists");
 
-   FroxelListHead* gpu_lists_head = (FroxelListHead*)_light_list_head_pbo->getUpdateSegmentPtr();
-   int* gpu_lists_data = (int*)_light_list_data->getUpdateSegmentPtr();
+   unsigned int* gpu_lists_head = (unsigned int*)((char*)_light_list_head_pbo->getUpdateSegmentPtr() + view_index * _view_head_size);
+   int head_component_count = _light_counts_packed ? 2 : 4;
 
-   unsigned int offset_into_data_buffer = 0;
-   int macro_froxel_count = _froxels_dims.x * _froxels_dims.y * _froxels_dims.z / 4;
-   for (int i = 0; i < macro_froxel_count; ++i)
-   {
-      const auto& cpu_froxel = _macro_froxel[i];
+   LightListDataHeader* gpu_lists_data_header = (LightListDataHeader*)((char*)_light_list_data->getUpdateSegmentPtr() + view_index * _view_data_size);
+   *gpu_lists_data_header = {};
+   gpu_lists_data_header->froxels_dims = _froxels_dims;
+   gpu_lists_data_header->light_counts_packed = _light_counts_packed;
+   gpu_lists_data_header->culling_mode = int(LightCullingMode::FroxelLists);
+   gpu_lists_data_header->heads_in_ssbo = _heads_in_ssbo;
+   int* gpu_lists_data = (int*)(gpu_lists_data_header + 1);
 
-      for (int sub_froxel = 0; sub_froxel < 4; sub_froxel++)
-      {
-         int macro_z = i / (_froxels_dims.y * _froxels_dims.x / 4);
-         int slice_flat = i % (_froxels_dims.y * _froxels_dims.x / 4);
-         int macro_y = slice_flat / (_froxels_dims.x / 2);
-         int macro_x = slice_flat % (_froxels_dims.x / 2);
+   std::int64_t list_capacity = (_view_data_size - sizeof(LightListDataHeader)) / sizeof(int);
 
-         int sub_x = 2 * macro_x + (sub_froxel % 2);
-         int sub_y = 2 * macro_y + (sub_froxel / 2);
-         int sub_z = macro_z;
+   // a row is a line of macro froxels along x, the lists of a row are contiguous in the data buffer
+   ivec3 macro_froxels_dims = ivec3(_froxels_dims.x / 2, _froxels_dims.y / 2, _froxels_dims.z);
+   int row_count = macro_froxels_dims.y * macro_froxels_dims.z;
+   _froxel_row_list_offsets.resize(row_count + 1);
 
-         gpu_lists_head[_toFlatFroxelIndex(sub_x, sub_y, sub_z)].list_start_offset = offset_into_data_buffer;
-         unsigned int rectangle_light_count = 0;
-         unsigned int spot_light_count = 0;
-         unsigned int sphere_light_count = 0;
-
-         const auto& sphere_lights = cpu_froxel.lights[int(LightType::Sphere)];
-         for (int j = 0; j < sphere_lights.size(); ++j)
+   // count, each light appears in the lists of the sub froxels set in its mask
+#pragma omp parallel for
+   for (int row = 0; row < row_count; ++row)
+   {
+      unsigned int row_list_size = 0;
+      for (int i = row * macro_froxels_dims.x; i < (row + 1) * macro_froxels_dims.x; ++i)
+      {
+         for (int light_type = 0; light_type < 3; ++light_type)
          {
-            if ((1 << sub_froxel) & sphere_lights[j].mask)
-               gpu_lists_data[offset_into_data_buffer + sphere_light_count++] = sphere_lights[j].light_index;
+            const LightCoverage* lights = view.macro_froxel_lights->lights(i, LightType(light_type));
+            int list_size = view.macro_froxel_lights->count(i, LightType(light_type));
+            for (int j = 0; j < list_size; ++j)
+               row_list_size += _mm_popcnt_u32(lights[j].mask);
          }
-         offset_into_data_buffer += sphere_light_count;
+      }
+      _froxel_row_list_offsets[row + 1] = row_list_size;
+   }
 
-         const auto& spot_lights = cpu_froxel.lights[int(LightType::Spot)];
-         for (int j = 0; j < spot_lights.size(); ++j)
-         {
-            if ((1 << sub_froxel) & spot_lights[j].mask)
-               gpu_lists_data[offset_into_data_buffer + spot_light_count++] = spot_lights[j].light_index;
-         }
-         offset_into_data_buffer += spot_light_count;
+   // exclusive scan of the row sizes
+   _froxel_row_list_offsets[0] = 0;
+   for (int row = 0; row < row_count; ++row)
+      _froxel_row_list_offsets[row + 1] += _froxel_row_list_offsets[row];
 
-         const auto& rectangle_lights = cpu_froxel.lights[int(LightType::Rectangle)];
-         for (int j = 0; j < rectangle_lights.size(); ++j)
-         {
-            if ((1 << sub_froxel) & rectangle_lights[j].mask)
-               gpu_lists_data[offset_into_data_buffer + rectangle_light_count++] = rectangle_lights[j].light_index;
-         }
-         offset_into_data_buffer += rectangle_light_count;
+   // scatter, the segment is write combined memory that is never read back so the stores bypass the cache
+   static const LightType list_order[3] = { LightType::Sphere, LightType::Spot, LightType::Rectangle };
+#pragma omp parallel
+   {
+#pragma omp for nowait
+      for (int row = 0; row < row_count; ++row)
+      {
+         unsigned int offset_into_data_buffer = _froxel_row_list_offsets[row];
+         bool row_fits_in_buffer = _froxel_row_list_offsets[row + 1] <= list_capacity;
+         int macro_y = row % macro_froxels_dims.y;
+         int macro_z = row / macro_froxels_dims.y;
 
-         gpu_lists_head[_toFlatFroxelIndex(sub_x, sub_y, sub_z)].light_counts =
-            (unsigned int(sphere_light_count) & 0x3FF)
-            | ((unsigned int(spot_light_count) & 0x3FF) << 10)
-            | ((unsigned int(rectangle_light_count) & 0x3FF) << 20);
+         for (int macro_x = 0; macro_x < macro_froxels_dims.x; ++macro_x)
+         {
+            int i = macro_x + row * macro_froxels_dims.x;
+            for (int sub_froxel = 0; sub_froxel < 4; sub_froxel++)
+            {
+               unsigned int list_start_offset = offset_into_data_buffer;
+               unsigned int light_counts[3] = { 0, 0, 0 };
+               for (int k = 0; k < 3 && row_fits_in_buffer; ++k)
+               {
+                  const LightCoverage* lights = view.macro_froxel_lights->lights(i, list_order[k]);
+                  int list_size = view.macro_froxel_lights->count(i, list_order[k]);
+                  for (int j = 0; j < list_size; ++j)
+                  {
+                     if ((1 << sub_froxel) & lights[j].mask)
+                     {
+                        _mm_stream_si32(gpu_lists_data + offset_into_data_buffer++, lights[j].light_index);
+                        light_counts[k]++;
+                     }
+                  }
+               }
 
+               int sub_x = 2 * macro_x + (sub_froxel & 1);
+               int sub_y = 2 * macro_y + (sub_froxel >> 1);
+               int* gpu_list_head = (int*)(gpu_lists_head + _toFlatFroxelIndex(sub_x, sub_y, macro_z) * head_component_count);
+               _mm_stream_si32(gpu_list_head, list_start_offset);
+               if (_light_counts_packed)
+               {
+                  _mm_stream_si32(gpu_list_head + 1, (light_counts[0] & 0x3FF) | ((light_counts[1] & 0x3FF) << 10) | ((light_counts[2] & 0x3FF) << 20));
+               }
+               else
+               {
+                  _mm_stream_si32(gpu_list_head + 1, light_counts[0]);
+                  _mm_stream_si32(gpu_list_head + 2, light_counts[1]);
+                  _mm_stream_si32(gpu_list_head + 3, light_counts[2]);
+               }
+            }
+         }
       }
+      // each thread flushes its own write combining buffers before the region joins
+      _mm_sfence();
    }
-
-   float duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
-   //std::cout << "in " << duration*1000.0f << std::endl;
 }
 
-void ClusteredLightCuller::_injectSphereLightsIntoFroxels(const Scene& scene, const RenderData& render_data)
+void ClusteredLightCuller::_buildZBinnedLightLists(const Scene& scene, const RenderData& render_data, int view_index)
 {
-#ifdef USE_CHEAP_SPHERE_INJECTION
-   unsigned short light_index = -1;
+   ivec3 bins_dims = ivec3(_froxels_dims.x, _froxels_dims.y, _zbin_count);
+   for (auto& lights : _zbinned_lights)
+      lights.clear();
+
+   // same visible lights as the froxel lists, the light z bounds are clamped to the froxels and cannot reject the
+   // lights before the near or beyond the far plane
+   _cullLightsOutsideView(render_data);
+
+   int light_index = -1;
    for (const auto& light : scene.sphere_lights)
    {
       light_index++;
-
-      mat4 matrix_light_proj_local = render_data.matrix_proj_world*toMat4(light.world_to_local_matrix);
-      mat4 matrix_plane_clip_to_local = transpose(inverse(matrix_light_proj_local));
-
-      simdvec3 light_clip_planes_xyz[6];
-      simdfloat light_clipplanes_w[6];
-      for (int i = 0; i < 6; ++i)
-      {
-         vec4 oobb_planes_in_clip_space = matrix_plane_clip_to_local * light.frustum_planes_in_local[i];
-         light_clip_planes_xyz[i] = simdvec3(oobb_planes_in_clip_space.xyz);
-         light_clipplanes_w[i] = simdfloat(oobb_planes_in_clip_space.w);
-      }
-
-      Aabb3 clip_space_aabb = _computeSphereFroxelBounds(scene, render_data, light);
-
-      _injectLightIntoFroxels(clip_space_aabb, light_index, LightType::Sphere, light_clip_planes_xyz, light_clipplanes_w, 6);
+      if (!_visible_lights[int(LightType::Sphere)][light_index])
+         continue;
+      _addZBinnedLight(_computeSphereFroxelBounds(scene, render_data, light), light_index, LightType::Sphere, bins_dims);
    }
-#else
-   unsigned short light_index = -1;
-   for (const auto& light : scene.lights)
+
+   light_index = -1;
+   for (const auto& light : scene.spot_lights)
    {
-      if (light.type != LightType::Sphere)
+      light_index++;
+      if (!_visible_lights[int(LightType::Spot)][light_index])
          continue;
+      mat4 matrix_light_proj_local = render_data.matrix_proj_world*toMat4(light.world_to_local_matrix);
+      vec3 vertices[8];
+      int vertex_count = _spotLightBoundingVertices(light, vertices);
+      _addZBinnedLight(_computeConvexMeshFroxelBounds(render_data, matrix_light_proj_local, vertices, vertex_count), light_index, LightType::Spot, bins_dims);
+   }
 
+   light_index = -1;
+   for (const auto& light : scene.rectangle_lights)
+   {
       light_index++;
-      Aabb3 clip_space_aabb = _computeSphereFroxelBounds(scene, render_data, light);
-      intAabb3 voxels_overlapping_light = _convertFroxelNormalizedAABBToIntegerAABB(clip_space_aabb, _froxels_dims);
-      voxels_overlapping_light.pmin.x = voxels_overlapping_light.pmin.x / 2;
-      voxels_overlapping_light.pmax.x = voxels_overlapping_light.pmax.x / 2;
+      if (!_visible_lights[int(LightType::Rectangle)][light_index])
+         continue;
+      mat4 matrix_light_proj_local = render_data.matrix_proj_world*toMat4(light.world_to_local_matrix);
+      vec3 vertices[8];
+      int vertex_count = _rectangleLightBoundingVertices(light, vertices);
+      _addZBinnedLight(_computeConvexMeshFroxelBounds(render_data, matrix_light_proj_local, vertices, vertex_count), light_index, LightType::Rectangle, bins_dims);
+   }
 
-      voxels_overlapping_light.pmin.y = voxels_overlapping_light.pmin.y / 2;
-      voxels_overlapping_light.pmax.y = voxels_overlapping_light.pmax.y / 2;
+   LightListDataHeader* gpu_lists_data_header = (LightListDataHeader*)((char*)_light_list_data->getUpdateSegmentPtr() + view_index * _view_data_size);
+   *gpu_lists_data_header = {};
+   gpu_lists_data_header->froxels_dims = bins_dims;
+   gpu_lists_data_header->culling_mode = int(LightCullingMode::ZBinned);
+   int* gpu_lists_data = (int*)(gpu_lists_data_header + 1);
+   int offset_into_data_buffer = 0;
 
-      vec3 sphere_center_in_vs = project(render_data.matrix_view_world, light.world_to_local_matrix[3]);
+   // the lights of a z bin are a contiguous range of the lights sorted by depth
+   _zbins.assign(_zbin_count * 3, ivec2(INT_MAX, -1));
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      auto& lights = _zbinned_lights[light_type];
+      std::sort(lights.begin(), lights.end(), [](const ZBinnedLight& a, const ZBinnedLight& b) { return a.depth < b.depth; });
 
-      for (int z = voxels_overlapping_light.pmin.z; z <= voxels_overlapping_light.pmax.z; z++)
+      gpu_lists_data_header->sorted_lights_offset[light_type] = offset_into_data_buffer;
+      for (int i = 0; i < (int)lights.size(); ++i)
       {
-         for (int y = voxels_overlapping_light.pmin.y; y <= voxels_overlapping_light.pmax.y; y++)
+         gpu_lists_data[offset_into_data_buffer + i] = lights[i].light_index;
+         for (int zbin = lights[i].bins_min.z; zbin <= lights[i].bins_max.z; ++zbin)
          {
-            for (int x = voxels_overlapping_light.pmin.x; x <= voxels_overlapping_light.pmax.x; x++)
-            {
-               int mask = 0;
-               for (int sub_froxel = 0; sub_froxel < 4; ++sub_froxel)
-               {
-                  int sub_x = 2 * x + (sub_froxel % 2);
-                  int sub_y = 2 * y + (sub_froxel / 2);
-                  int sub_z = z;
+            ivec2& zbin_range = _zbins[zbin * 3 + light_type];
+            zbin_range.x = min(zbin_range.x, i);
+            zbin_range.y = i;
+         }
+      }
+      offset_into_data_buffer += (int)lights.size();
+   }
 
-                  int res = bool(_sphereOverlapsFroxel(sub_x, sub_y, sub_z, light.radius, vec3(sphere_center_in_vs), _froxel_info.data()));
-                  mask |= res << sub_froxel;
-               }
+   gpu_lists_data_header->zbins_offset = offset_into_data_buffer;
+   memcpy(gpu_lists_data + offset_into_data_buffer, _zbins.data(), _zbins.size() * sizeof(ivec2));
+   offset_into_data_buffer += (int)_zbins.size() * 2;
 
-               if (mask != 0)
-                  _macro_froxel[_toFlatMacroFroxelIndex(x, y, z)].lights[int(LightType::Sphere)].emplace_back(LightCoverage(mask, light_index));
-            }
+   // each tile has a bitmask over the sorted lights, the shader intersects it with the range of the z bin
+   int tile_count = bins_dims.x * bins_dims.y;
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      const auto& lights = _zbinned_lights[light_type];
+      int word_count = ((int)lights.size() + 31) / 32;
+
+      _tile_masks.assign(tile_count * word_count, 0);
+      for (int i = 0; i < (int)lights.size(); ++i)
+      {
+         for (int y = lights[i].bins_min.y; y <= lights[i].bins_max.y; y++)
+         {
+            for (int x = lights[i].bins_min.x; x <= lights[i].bins_max.x; x++)
+               _tile_masks[(x + y * bins_dims.x) * word_count + i / 32] |= 1u << (i % 32);
          }
       }
+
+      gpu_lists_data_header->tile_masks_offset[light_type] = offset_into_data_buffer;
+      gpu_lists_data_header->tile_mask_word_count[light_type] = word_count;
+      memcpy(gpu_lists_data + offset_into_data_buffer, _tile_masks.data(), _tile_masks.size() * sizeof(unsigned int));
+      offset_into_data_buffer += (int)_tile_masks.size();
    }
-#endif
 }
 
-void ClusteredLightCuller::_injectSpotLightsIntoFroxels(const Scene& scene, const RenderData& render_data)
+void ClusteredLightCuller::_addZBinnedLight(const Aabb3& clip_space_aabb, int light_index, LightType light_type, const ivec3& bins_dims)
 {
-   unsigned short light_index = -1;
-   for (const auto& light : scene.spot_lights)
-   {
-      light_index++;
+   bool outside_screen = clip_space_aabb.pmax.x < 0.0f || clip_space_aabb.pmin.x > 1.0f
+      || clip_space_aabb.pmax.y < 0.0f || clip_space_aabb.pmin.y > 1.0f;
+   if (outside_screen)
+      return;
+
+   intAabb3 bins_overlapping_light = _convertFroxelNormalizedAABBToIntegerAABB(clip_space_aabb, bins_dims);
+
+   ZBinnedLight light;
+   light.light_index = light_index;
+   light.depth = clip_space_aabb.pmin.z;
+   light.bins_min = bins_overlapping_light.pmin;
+   light.bins_max = bins_overlapping_light.pmax;
+   _zbinned_lights[int(light_type)].push_back(light);
+}
 
+// clip space bounds and bounding planes of a light in the view, shared by the cpu injection and the gpu culling
+int ClusteredLightCuller::_lightFroxelBounds(const Scene& scene, const RenderData& render_data, const mat4& matrix_plane_clip_to_world, LightType light_type, int light_index,
+                                             Aabb3* clip_space_aabb, vec4* light_clip_planes)
+{
+   const Light& light = _sceneLights(scene, light_type)[light_index];
+   if (light_type == LightType::Sphere)
+   {
+      *clip_space_aabb = _computeSphereFroxelBounds(scene, render_data, light);
+   }
+   else
+   {
       mat4 matrix_light_proj_local = render_data.matrix_proj_world*toMat4(light.world_to_local_matrix);
-      mat4 matrix_plane_clip_to_local = transpose(inverse(matrix_light_proj_local));
+      vec3 vertices[8];
+      int vertex_count = (light_type == LightType::Spot) ? _spotLightBoundingVertices(light, vertices) : _rectangleLightBoundingVertices(light, vertices);
+      *clip_space_aabb = _computeConvexMeshFroxelBounds(render_data, matrix_light_proj_local, vertices, vertex_count);
+   }
 
-      simdvec3 frustum_planes_xyz[5];
-      simdfloat frustum_planes_w[5];
-      for (int i = 0; i < 5; ++i)
-      {
-         vec4 spot_planes_in_clip_space = matrix_plane_clip_to_local * light.frustum_planes_in_local[i];
-         frustum_planes_xyz[i] = simdvec3(spot_planes_in_clip_space.xyz);
-         frustum_planes_w[i] = simdfloat(spot_planes_in_clip_space.w);
-      }
+   // a spot light is bounded by a pyramid
+   int plane_count = (light_type == LightType::Spot) ? 5 : 6;
+   const SharedLight& shared_light = _shared_data.lights[int(light_type)][light_index];
+   for (int i = 0; i < plane_count; ++i)
+      light_clip_planes[i] = matrix_plane_clip_to_world * shared_light.world_planes[i];
 
-      float w = light.radius * tan(light.spot.angle*0.5f);
-      float l = light.radius;
+   return plane_count;
+}
+
+void ClusteredLightCuller::_injectLightsIntoFroxels(LightCullingView& view, const Scene& scene, const RenderData& render_data)
+{
+   mat4 matrix_plane_clip_to_world = transpose(inverse(render_data.matrix_proj_world));
 
-      vec3 pyramid_vertices[8];
-      pyramid_vertices[0] = vec3(0.0f, 0.0f, 0.0f);
-      pyramid_vertices[1] = vec3(w, w, -l);
-      pyramid_vertices[2] = vec3(-w, w, -l);
-      pyramid_vertices[3] = vec3(-w, -w, -l);
-      pyramid_vertices[4] = vec3(w, -w, -l);
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      const auto& lights = _sceneLights(scene, LightType(light_type));
+      for (int light_index = 0; light_index < (int)lights.size(); ++light_index)
+      {
+         if (!view.injected_lights[light_type][light_index].needs_injection)
+            continue;
 
-      Aabb3 clip_space_aabb = _computeConvexMeshFroxelBounds(render_data, matrix_light_proj_local, pyramid_vertices, 5);
+         Aabb3 clip_space_aabb;
+         vec4 light_clip_planes[6];
+         int plane_count = _lightFroxelBounds(scene, render_data, matrix_plane_clip_to_world, LightType(light_type), light_index, &clip_space_aabb, light_clip_planes);
 
-      _injectLightIntoFroxels(clip_space_aabb, light_index, LightType::Spot, frustum_planes_xyz, frustum_planes_w, 5);
+         if (LightType(light_type) == LightType::Sphere && view.froxel_geometry_exact_spheres)
+         {
+            const Light& light = lights[light_index];
+            vec3 sphere_center_in_vs = project(render_data.matrix_view_world, light.world_to_local_matrix[3]);
+            _injectSphereLightIntoFroxels(view, clip_space_aabb, light_index, sphere_center_in_vs, light.radius);
+            continue;
+         }
+
+         // cheaper test of the light bounding planes against the froxels clip space aabbs
+         _injectLightIntoFroxels(view, clip_space_aabb, light_index, LightType(light_type), light_clip_planes, plane_count);
+      }
    }
 }
 
-void ClusteredLightCuller::_injectRectangleLightsIntoFroxels(const Scene& scene, const RenderData& render_data)
+static intAabb3 _macroFroxelsOverlappingLight(const Aabb3& clip_space_aabb, const ivec3& light_froxels_dims)
 {
-   unsigned short light_index = -1;
-   for (const auto& light : scene.rectangle_lights)
-   {
-      light_index++;
+   intAabb3 voxels_overlapping_light = _convertFroxelNormalizedAABBToIntegerAABB(clip_space_aabb, light_froxels_dims);
+   voxels_overlapping_light.pmin.x = voxels_overlapping_light.pmin.x / 2;
+   voxels_overlapping_light.pmax.x = voxels_overlapping_light.pmax.x / 2;
 
-      mat4 matrix_light_proj_local = render_data.matrix_proj_world*toMat4(light.world_to_local_matrix);
-      mat4 matrix_plane_clip_to_local = transpose(inverse(matrix_light_proj_local));
+   voxels_overlapping_light.pmin.y = voxels_overlapping_light.pmin.y / 2;
+   voxels_overlapping_light.pmax.y = voxels_overlapping_light.pmax.y / 2;
 
-      simdvec3 light_clip_planes_xyz[6];
-      simdfloat light_clipplanes_w[6];
-      for (int i = 0; i < 6; ++i)
-      {
-         vec4 oobb_planes_in_clip_space = matrix_plane_clip_to_local * light.frustum_planes_in_local[i];
-         light_clip_planes_xyz[i] = simdvec3(oobb_planes_in_clip_space.xyz);
-         light_clipplanes_w[i] = simdfloat(oobb_planes_in_clip_space.w);
-      }
+   return voxels_overlapping_light;
+}
 
-      float w = light.rectangle.bounds_width;
-      float h = light.rectangle.bounds_height;
-      float d = light.rectangle.bounds_depth;
+void ClusteredLightCuller::_injectSphereLightIntoFroxels(LightCullingView& view, const Aabb3& clip_space_aabb, int light_index, const vec3& sphere_center_in_vs, float sphere_radius)
+{
+   intAabb3 voxels_overlapping_light = _macroFroxelsOverlappingLight(clip_space_aabb, _froxels_dims);
 
-      vec3 oobb_vertices[8];
-      oobb_vertices[0] = vec3(w, h, 0.0);
-      oobb_vertices[1] = vec3(-w, h, 0.0);
-      oobb_vertices[2] = vec3(-w, -h, 0.0);
-      oobb_vertices[3] = vec3(w, -h, 0.0);
-      oobb_vertices[4] = vec3(w, h, -d);
-      oobb_vertices[5] = vec3(-w, h, -d);
-      oobb_vertices[6] = vec3(-w, -h, -d);
-      oobb_vertices[7] = vec3(w, -h, -d);
+   const ivec3& pmin = voxels_overlapping_light.pmin;
+   const ivec3& pmax = voxels_overlapping_light.pmax;
+   view.injected_lights[int(LightType::Sphere)][light_index].macro_froxel_min = pmin;
+   view.injected_lights[int(LightType::Sphere)][light_index].macro_froxel_max = pmax;
+   switch (_simd_instruction_set)
+   {
+#ifdef SIMD_AVX512
+   case SimdInstructionSet::AVX512:
+      _injectSphereLightIntoMacroFroxels<simdfloat16>(view, pmin, pmax, light_index, sphere_center_in_vs, sphere_radius);
+      break;
+#endif
+   case SimdInstructionSet::AVX:
+      _injectSphereLightIntoMacroFroxels<simdfloat8>(view, pmin, pmax, light_index, sphere_center_in_vs, sphere_radius);
+      break;
+   default:
+      _injectSphereLightIntoMacroFroxels<simdfloat>(view, pmin, pmax, light_index, sphere_center_in_vs, sphere_radius);
+      break;
+   }
+}
 
-      Aabb3 clip_space_aabb = _computeConvexMeshFroxelBounds(render_data, matrix_light_proj_local, oobb_vertices, 8);
+template<typename simdfloatT>
+void ClusteredLightCuller::_injectSphereLightIntoMacroFroxels(LightCullingView& view, const ivec3& macro_froxel_min, const ivec3& macro_froxel_max, int light_index,
+                                                              const vec3& sphere_center_in_vs, float sphere_radius)
+{
+   // same batching as _injectLightIntoMacroFroxels, one lane per sub froxel
+   const int macro_froxels_per_batch = simdfloatT::width / 4;
+   simdvec3_t<simdfloatT> sphere_center(sphere_center_in_vs);
+   simdfloatT radius(sphere_radius);
 
-      _injectLightIntoFroxels(clip_space_aabb, light_index, LightType::Rectangle, light_clip_planes_xyz, light_clipplanes_w, 6);
+#pragma omp parallel for num_threads(3)
+   for (int z = macro_froxel_min.z; z <= macro_froxel_max.z; z++)
+   {
+      for (int y = macro_froxel_min.y; y <= macro_froxel_max.y; y++)
+      {
+         for (int x = macro_froxel_min.x; x <= macro_froxel_max.x; x += macro_froxels_per_batch)
+         {
+            int index = _toFlatMacroFroxelIndex(x, y, z);
+            int overlap_mask = _sphereOverlapsFroxel(sphere_center, radius, view.macro_froxel_info, 4 * index);
+
+            int batch_size = min(macro_froxels_per_batch, macro_froxel_max.x - x + 1);
+            for (int k = 0; k < batch_size; ++k)
+            {
+               int macro_froxel_mask = (overlap_mask >> (4 * k)) & 0xF;
+               if (macro_froxel_mask != 0)
+                  view.macro_froxel_lights->add(index + k, LightType::Sphere, LightCoverage(macro_froxel_mask, light_index));
+            }
+         }
+      }
+      simdfloatT::leaveSection();
    }
 }
 
-void ClusteredLightCuller::_injectLightIntoFroxels(const Aabb3& clip_space_aabb, unsigned short light_index, LightType light_type,
-                                                      const simdvec3* light_clip_planes_xyz, const simdfloat* light_clip_planes_w, int num_light_clip_planes)
+void ClusteredLightCuller::_injectLightIntoFroxels(LightCullingView& view, const Aabb3& clip_space_aabb, int light_index, LightType light_type,
+                                                   const vec4* light_clip_planes, int num_light_clip_planes)
 {
-   intAabb3 voxels_overlapping_light = _convertFroxelNormalizedAABBToIntegerAABB(clip_space_aabb, _froxels_dims);
-   voxels_overlapping_light.pmin.x = voxels_overlapping_light.pmin.x / 2;
-   voxels_overlapping_light.pmax.x = voxels_overlapping_light.pmax.x / 2;
+   intAabb3 voxels_overlapping_light = _macroFroxelsOverlappingLight(clip_space_aabb, _froxels_dims);
 
-   voxels_overlapping_light.pmin.y = voxels_overlapping_light.pmin.y / 2;
-   voxels_overlapping_light.pmax.y = voxels_overlapping_light.pmax.y / 2;
+   const ivec3& pmin = voxels_overlapping_light.pmin;
+   const ivec3& pmax = voxels_overlapping_light.pmax;
+   view.injected_lights[int(light_type)][light_index].macro_froxel_min = pmin;
+   view.injected_lights[int(light_type)][light_index].macro_froxel_max = pmax;
+   switch (_simd_instruction_set)
+   {
+#ifdef SIMD_AVX512
+   case SimdInstructionSet::AVX512:
+      _injectLightIntoMacroFroxels<simdfloat16>(view, pmin, pmax, light_index, light_type, light_clip_planes, num_light_clip_planes);
+      break;
+#endif
+   case SimdInstructionSet::AVX:
+      _injectLightIntoMacroFroxels<simdfloat8>(view, pmin, pmax, light_index, light_type, light_clip_planes, num_light_clip_planes);
+      break;
+   default:
+      _injectLightIntoMacroFroxels<simdfloat>(view, pmin, pmax, light_index, light_type, light_clip_planes, num_light_clip_planes);
+      break;
+   }
+}
+
+template<typename simdfloatT>
+void ClusteredLightCuller::_injectLightIntoMacroFroxels(LightCullingView& view, const ivec3& macro_froxel_min, const ivec3& macro_froxel_max, int light_index, LightType light_type,
+                                                        const vec4* light_clip_planes, int num_light_clip_planes)
+{
+   // each lane tests one sub froxel, so one instruction covers simdfloatT::width / 4 consecutive macro froxels of a row
+   const int macro_froxels_per_batch = simdfloatT::width / 4;
+   LightClipPlanes<simdfloatT> clip_planes(light_clip_planes, num_light_clip_planes);
 
 #pragma omp parallel for num_threads(3)
-   for (int z = voxels_overlapping_light.pmin.z; z <= voxels_overlapping_light.pmax.z; z++)
+   for (int z = macro_froxel_min.z; z <= macro_froxel_max.z; z++)
    {
-      for (int y = voxels_overlapping_light.pmin.y; y <= voxels_overlapping_light.pmax.y; y++)
+      for (int y = macro_froxel_min.y; y <= macro_froxel_max.y; y++)
       {
-         for (int x = voxels_overlapping_light.pmin.x; x <= voxels_overlapping_light.pmax.x; x++)
+         for (int x = macro_froxel_min.x; x <= macro_froxel_max.x; x += macro_froxels_per_batch)
          {
-            simdvec3 aabb_center;
-            simdvec3 aabb_extent;
-            aabb_center.load((float*)_macro_froxel_info.center_cs.x, (float*)_macro_froxel_info.center_cs.y, (float*)_macro_froxel_info.center_cs.z, 4 * _toFlatMacroFroxelIndex(x, y, z));
-            aabb_extent.load((float*)_macro_froxel_info.extent_cs.x, (float*)_macro_froxel_info.extent_cs.y, (float*)_macro_froxel_info.extent_cs.z, 4 * _toFlatMacroFroxelIndex(x, y, z));
+            int index = _toFlatMacroFroxelIndex(x, y, z);
+            simdvec3_t<simdfloatT> aabb_center;
+            simdvec3_t<simdfloatT> aabb_extent;
+            aabb_center.load((float*)view.macro_froxel_info.center_cs.x, (float*)view.macro_froxel_info.center_cs.y, (float*)view.macro_froxel_info.center_cs.z, 4 * index);
+            aabb_extent.load((float*)view.macro_froxel_info.extent_cs.x, (float*)view.macro_froxel_info.extent_cs.y, (float*)view.macro_froxel_info.extent_cs.z, 4 * index);
 
-            int overlap_mask = _aabbOverlapsFroxel(aabb_center, aabb_extent, light_clip_planes_xyz, light_clip_planes_w, num_light_clip_planes);
+            int overlap_mask = _aabbOverlapsFroxel(aabb_center, aabb_extent, clip_planes.xyz, clip_planes.w, clip_planes.count);
 
-            if (overlap_mask != 0)
-               _macro_froxel[_toFlatMacroFroxelIndex(x, y, z)].lights[int(light_type)].emplace_back(LightCoverage(overlap_mask, light_index));
+            // lanes past the end of the light bounds belong to the next macro froxels of the row, or to the next row
+            int batch_size = min(macro_froxels_per_batch, macro_froxel_max.x - x + 1);
+            for (int k = 0; k < batch_size; ++k)
+            {
+               int macro_froxel_mask = (overlap_mask >> (4 * k)) & 0xF;
+               if (macro_froxel_mask != 0)
+                  view.macro_froxel_lights->add(index + k, light_type, LightCoverage(macro_froxel_mask, light_index));
+            }
          }
       }
+      simdfloatT::leaveSection();
    }
 }
 
+void ClusteredLightCuller::_prepareGPULightCulling(const Scene& scene, const RenderData& render_data, int view_index)
+{
+   // the lists are built when rendering, the update fills the header of the view range of its segment
+   LightListDataHeader* gpu_lists_data_header = (LightListDataHeader*)((char*)_light_list_data->getUpdateSegmentPtr() + view_index * _view_data_size);
+   *gpu_lists_data_header = {};
+   gpu_lists_data_header->froxels_dims = _froxels_dims;
+   gpu_lists_data_header->culling_mode = int(LightCullingMode::FroxelLists);
+
+   // and the lights with the bounds of the cpu injection, the compute shader only runs the per froxel tests
+   _cullLightsOutsideView(render_data);
+   mat4 matrix_plane_clip_to_world = transpose(inverse(render_data.matrix_proj_world));
+
+   ivec4* first_lights = (ivec4*)((char*)_gpu_culled_lights->getUpdateSegmentPtr() + view_index * _view_culled_lights_size);
+   GPUCulledLight* gpu_lights = (GPUCulledLight*)(first_lights + 1);
+   int gpu_light_count = 0;
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      const auto& lights = _sceneLights(scene, LightType(light_type));
+      (*first_lights)[light_type] = gpu_light_count;
+      for (int i = 0; i < (int)lights.size(); ++i)
+      {
+         GPUCulledLight& gpu_light = gpu_lights[gpu_light_count++];
+         if (!_visible_lights[light_type][i])
+         {
+            gpu_light.froxel_min = ivec4(0);
+            gpu_light.froxel_max = ivec4(-1);
+            continue;
+         }
+
+         Aabb3 clip_space_aabb;
+         vec4 light_clip_planes[6];
+         int plane_count = _lightFroxelBounds(scene, render_data, matrix_plane_clip_to_world, LightType(light_type), i, &clip_space_aabb, light_clip_planes);
+
+         // the cpu injects all the froxels of the macro froxels overlapping the bounds
+         intAabb3 macro_froxels = _macroFroxelsOverlappingLight(clip_space_aabb, _froxels_dims);
+         gpu_light.froxel_min = ivec4(2 * macro_froxels.pmin.x, 2 * macro_froxels.pmin.y, macro_froxels.pmin.z, 0);
+         gpu_light.froxel_max = ivec4(2 * macro_froxels.pmax.x + 1, 2 * macro_froxels.pmax.y + 1, macro_froxels.pmax.z, 0);
+
+         if (LightType(light_type) == LightType::Sphere && _settings.exact_sphere_light_injection)
+         {
+            gpu_light.froxel_min.w = 1;
+            gpu_light.planes[0] = vec4(project(render_data.matrix_view_world, lights[i].world_to_local_matrix[3]), lights[i].radius);
+            continue;
+         }
+
+         // the unused planes never cull
+         for (int k = 0; k < 6; ++k)
+            gpu_light.planes[k] = (k < plane_count) ? light_clip_planes[k] : vec4(0.0f, 0.0f, 0.0f, 1.0f);
+      }
+   }
+   first_lights->w = gpu_light_count;
+}
+
+void ClusteredLightCuller::debugReadLightLists(int view_index, std::vector<uvec4>* heads, std::vector<int>* lists)
+{
+   // the gpu culling writes the heads and the lists from a compute shader
+   glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+   int froxel_count = _froxels_dims.x * _froxels_dims.y * _froxels_dims.z;
+   heads->resize(froxel_count);
+   if (_culling_on_gpu || !_light_counts_packed)
+   {
+      if (_heads_in_ssbo)
+         glGetNamedBufferSubData(_light_list_head_pbo->id(), _light_list_head_pbo->getRenderSegmentOffset() + view_index * _view_head_size, froxel_count * sizeof(uvec4), heads->data());
+      else
+         glGetTextureImage(_light_list_head->id(), 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, froxel_count * sizeof(uvec4), heads->data());
+   }
+   else
+   {
+      std::vector<uvec2> packed_heads(froxel_count);
+      if (_heads_in_ssbo)
+         glGetNamedBufferSubData(_light_list_head_pbo->id(), _light_list_head_pbo->getRenderSegmentOffset() + view_index * _view_head_size, froxel_count * sizeof(uvec2), packed_heads.data());
+      else
+         glGetTextureImage(_light_list_head->id(), 0, GL_RG_INTEGER, GL_UNSIGNED_INT, froxel_count * sizeof(uvec2), packed_heads.data());
+
+      for (int i = 0; i < froxel_count; ++i)
+         (*heads)[i] = uvec4(packed_heads[i].x, packed_heads[i].y & 0x3FF, (packed_heads[i].y >> 10) & 0x3FF, (packed_heads[i].y >> 20) & 0x3FF);
+   }
+
+   lists->resize((_view_data_size - sizeof(LightListDataHeader)) / sizeof(int));
+   glGetNamedBufferSubData(_light_list_data->id(), _light_list_data->getRenderSegmentOffset() + view_index * _view_data_size + sizeof(LightListDataHeader),
+                           lists->size() * sizeof(int), lists->data());
+}
+
 void ClusteredLightCuller::_initDebugData()
 {
    _debug_draw_froxel_grid = createProgramFromFile("debug_clustered_shading.glsl");
    _debug_draw = createProgramFromFile("debug_draw.glsl");
+
+   _debug_lines_buffer = createBuffer(sizeof(vec3) * 400, GL_MAP_WRITE_BIT);
+
+   _debug_lines_source = std::make_unique<GLVertexSource>();
+   _debug_lines_source->setVertexBuffer(*_debug_lines_buffer);
+   _debug_lines_source->setPrimitiveType(GL_LINES);
+   _debug_lines_source->setVertexCount(100);
+   _debug_lines_source->setVertexAttribute(0, 3, GL_FLOAT, GLSLVecType::vec);
+}
+
+void ClusteredLightCuller::_initDebugFroxelGrid()
+{
    _debug_froxel_grid = createBuffer(_froxels_dims.x * _froxels_dims.y * _froxels_dims.z * sizeof(vec3) * 24, GL_MAP_WRITE_BIT);
    _debug_enabled_froxels = createBuffer(_froxels_dims.x * _froxels_dims.y * _froxels_dims.z * sizeof(int), GL_MAP_WRITE_BIT);
 
@@ -757,14 +1642,6 @@ void ClusteredLightCuller::_initDebugData()
    _debug_froxel_grid_vertex_source->setPrimitiveType(GL_LINES);
    _debug_froxel_grid_vertex_source->setVertexCount(_froxels_dims.x * _froxels_dims.y * _froxels_dims.z * 24);
    _debug_froxel_grid_vertex_source->setVertexAttribute(0, 3, GL_FLOAT, GLSLVecType::vec);
-
-   _debug_lines_buffer = createBuffer(sizeof(vec3) * 400, GL_MAP_WRITE_BIT);
-
-   _debug_lines_source = std::make_unique<GLVertexSource>();
-   _debug_lines_source->setVertexBuffer(*_debug_lines_buffer);
-   _debug_lines_source->setPrimitiveType(GL_LINES);
-   _debug_lines_source->setVertexCount(100);
-   _debug_lines_source->setVertexAttribute(0, 3, GL_FLOAT, GLSLVecType::vec);
 }
 
 
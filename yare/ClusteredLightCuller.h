@@ -3,10 +3,12 @@
 #include "tools.h"
 
 #include <vector>
+#include <atomic>
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
 #include "Scene.h"
+#include "LightBvh.h"
 
 namespace yare {
 
@@ -20,8 +22,8 @@ class GLDynamicBuffer;
 class Aabb3;
 struct RenderData;
 struct RenderSettings;
-struct simdvec3;
-struct simdfloat;
+enum class SimdInstructionSet;
+enum class LightCullingMode;
 
 
 using namespace glm;
@@ -29,24 +31,69 @@ using namespace glm;
 struct LightCoverage
 {
    LightCoverage() {}
-   LightCoverage(unsigned short mask, unsigned short light_index) : mask(mask), light_index(light_index) {}
+   LightCoverage(unsigned int mask, unsigned int light_index) : mask(mask), light_index(light_index) {}
 
-   unsigned short mask : 4;
-   unsigned short light_index : 12;   
+   unsigned int mask : 4;
+   unsigned int light_index : 28;   
 };
 
-struct MacroFroxel
+// one cache line per macro froxel, the threads injecting into neighbour froxels do not share lines
+struct alignas(64) MacroFroxelLightCounts
 {
-   std::vector<LightCoverage> lights[3];
+   unsigned short generation;
+   unsigned short count[3];
 };
 
-_declspec(align(16))
-struct FroxelInfo
+// Light lists of all the macro froxels, allocated once with a fixed capacity per list.
+// Every list starts on its own cache line so that threads filling different froxels never write to the same line.
+// clear() only bumps a generation counter, the counts of a froxel are reset the first time it is written afterwards.
+// A light added to a full list is dropped and counted, see droppedLightCount().
+class MacroFroxelLightLists
 {
-   vec3 corner_coord;
-   int padding;
-   vec3 center_coord;
-   int padding2;
+public:
+   MacroFroxelLightLists(int macro_froxel_count, int max_lights_per_list);
+   ~MacroFroxelLightLists();
+
+   void clear();
+   void add(int macro_froxel_index, LightType light_type, LightCoverage coverage);
+   void remove(int macro_froxel_index, LightType light_type, int light_index);
+   int count(int macro_froxel_index, LightType light_type) const;
+   const LightCoverage* lights(int macro_froxel_index, LightType light_type) const;
+
+   int macroFroxelCount() const { return _macro_froxel_count; }
+   // lights dropped by full lists since the last clear
+   int droppedLightCount() const { return _dropped_light_count; }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(MacroFroxelLightLists)
+   LightCoverage* _list(int macro_froxel_index, LightType light_type) const;
+
+   int _macro_froxel_count;
+   int _list_capacity;
+   int _list_stride;
+   unsigned short _generation;
+   std::atomic<int> _dropped_light_count;
+   MacroFroxelLightCounts* _counts;
+   LightCoverage* _lights;
+};
+
+// State of a light when it was last injected, and the block of macro froxels it was injected into when in_lists is set
+struct InjectedLight
+{
+   Light light; // as it was injected, to detect the changes of its coverage
+   bool needs_injection;
+   bool in_lists;
+   ivec3 macro_froxel_min;
+   ivec3 macro_froxel_max;
+};
+
+// A visible light in z-binned mode, with the tiles and the z bins covered by its bounds
+struct ZBinnedLight
+{
+   int light_index;
+   float depth;
+   ivec3 bins_min;
+   ivec3 bins_max;
 };
 
 struct MacroFroxelInfo
@@ -64,6 +111,69 @@ struct MacroFroxelInfo
       vec4* y;
       vec4* z;
    } extent_cs;
+
+   // view space bounds of the froxels, for the exact sphere lights test
+   struct
+   {
+      vec4* x;
+      vec4* y;
+      vec4* z;
+   } min_vs, max_vs;
+
+   // planes through the camera bounding the froxels in x (left, right) and y (bottom, top), normals point inside the froxel.
+   // normal_xy is the x component for left and right, the y component for bottom and top
+   struct SidePlane
+   {
+      vec4* normal_xy;
+      vec4* normal_z;
+   } left_vs, right_vs, bottom_vs, top_vs;
+};
+
+// A light as seen by all the views, see SharedLightCullingData
+struct SharedLight
+{
+   Light light; // as it was last prepared, to detect the changes of its coverage
+   vec4 world_planes[6]; // frustum_planes_in_local in world space
+};
+
+// View independent light data, prepared once per frame for all the views:
+// the world space bounding planes of the lights, and a bvh over their world space bounds.
+class SharedLightCullingData
+{
+public:
+   void update(const Scene& scene);
+
+   std::vector<SharedLight> lights[3];
+   std::vector<Aabb3> world_bounds[3];
+   LightBvh bvh;
+};
+
+// The lists of one view and the state they were built from, so that a view only injects again the lights that moved.
+// Every view writes its own range of the shared gpu buffers, see ClusteredLightCuller::bindLightLists.
+struct LightCullingView
+{
+   LightCullingView() = default;
+   ~LightCullingView();
+
+   Uptr<MacroFroxelLightLists> macro_froxel_lights;
+   MacroFroxelInfo macro_froxel_info = {};
+
+   // the froxels geometry does not depend on the camera pose, only on these
+   bool froxel_geometry_valid = false;
+   mat4 froxel_geometry_matrix_proj_view;
+   Frustum froxel_geometry_frustum;
+   float froxel_geometry_z_distribution_factor = 0.0f;
+   bool froxel_geometry_exact_spheres = false;
+
+   // lights are only injected again when they moved or when the camera moved, the gpu segments are only
+   // written when they do not already hold the current version of the lists
+   std::vector<InjectedLight> injected_lights[3];
+   mat4 injected_matrix_proj_world;
+   unsigned int lists_version = 1;
+   std::vector<unsigned int> segment_lists_version;
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(LightCullingView)
 };
 
 class ClusteredLightCuller
@@ -72,29 +182,66 @@ public:
    ClusteredLightCuller(const RenderResources& render_resources, const RenderSettings& settings);
    ~ClusteredLightCuller();
 
-   void buildLightLists(const Scene& scene, RenderData& render_data);
+   // Builds the lists of the views configured by updateGridConfiguration, views[0] being the main view.
+   // The view independent light data is prepared once, then each view writes its range of the shared buffers.
+   void buildLightLists(const Scene& scene, RenderData* const* views, int view_count);
 
    void drawFroxelGrid(const RenderData& render_data, int index);
    void debugUpdateFroxeledGrid(RenderData& render_data);
 
    ivec3 froxelsDimensions() const { return _froxels_dims; }
+   // lower than max_lights_per_froxel when the lists would not fit the memory budget
+   int maxLightsPerFroxel() const { return _max_lights_per_froxel; }
+   // lights missing from the lists because they were full, raise max_lights_per_froxel when it is not 0
+   int droppedLightCount() const;
+   // Reads back the lists of the view in the render segment as the shaders see them, after updateLightListHeadTexture.
+   // A head holds the offset of the froxel list and its sphere, spot and rectangle light counts. Froxel lists mode only.
+   void debugReadLightLists(int view_index, std::vector<uvec4>* heads, std::vector<int>* lists);
+   int viewCount() const { return (int)_views.size(); }
+
+   // Reallocates the froxel grid and the light lists when the settings, the scene lights count or the views count ask for a different configuration.
+   // It makes gl calls, call it from the render thread when no update is running.
+   void updateGridConfiguration(const Scene& scene, int view_count = 1);
 
-   void bindLightLists();
-   void updateLightListHeadTexture();
+   // binds the range of the shared buffers holding the lists of the view, the shaders read it from offset 0
+   void bindLightLists(int view_index = 0);
+   // uploads the lists of the view built by the last update, or builds them with a compute shader when culling on the gpu
+   void updateLightListHeadTexture(const RenderData& render_data, int view_index = 0);
 
 private:
+   void _allocateLightLists(const ivec3& scene_light_counts, int view_count, int max_lights_per_froxel_limit);
    int _toFlatFroxelIndex(int x, int y, int z);
    int _toFlatMacroFroxelIndex(int x, int y, int z);
-   void _updateFroxelsGLData();   
-   int _sphereOverlapsFroxel(int x, int y, int z, float sphere_radius, const vec3& sphere_center, const FroxelInfo* froxel_infos);
+   void _buildViewLightLists(const Scene& scene, RenderData& render_data, int view_index);
+   void _updateFroxelsGLData(const LightCullingView& view, int view_index);
+   bool _froxelGeometryIsOutdated(const LightCullingView& view, const RenderData& render_data) const;
+   bool _prepareLightsInjection(LightCullingView& view, const Scene& scene, const RenderData& render_data, bool froxel_geometry_changed);
+   void _updateFroxelGeometry(LightCullingView& view, const RenderData& render_data);
+
+   void _cullLightsOutsideView(const RenderData& render_data);
+   int _lightFroxelBounds(const Scene& scene, const RenderData& render_data, const mat4& matrix_plane_clip_to_world, LightType light_type, int light_index,
+                          Aabb3* clip_space_aabb, vec4* light_clip_planes);
+   void _prepareGPULightCulling(const Scene& scene, const RenderData& render_data, int view_index);
+   void _cullLightsOnGPU(const RenderData& render_data, int view_index);
+   void _buildZBinnedLightLists(const Scene& scene, const RenderData& render_data, int view_index);
+   void _addZBinnedLight(const Aabb3& clip_space_aabb, int light_index, LightType light_type, const ivec3& bins_dims);
 
-   void _injectSphereLightsIntoFroxels(const Scene& scene, const RenderData& render_data);
-   void _injectSpotLightsIntoFroxels(const Scene& scene, const RenderData& render_data);
-   void _injectRectangleLightsIntoFroxels(const Scene& scene, const RenderData& render_data);   
-   void _injectLightIntoFroxels(const Aabb3& clip_space_aabb, unsigned short light_index, LightType light_type,
-                                 const simdvec3* light_clip_planes_xyz, const simdfloat* light_clip_planes_w, int num_light_clip_planes);
+   void _injectLightsIntoFroxels(LightCullingView& view, const Scene& scene, const RenderData& render_data);
+   void _injectLightIntoFroxels(LightCullingView& view, const Aabb3& clip_space_aabb, int light_index, LightType light_type,
+                                 const vec4* light_clip_planes, int num_light_clip_planes);
+   template<typename simdfloatT>
+   void _injectLightIntoMacroFroxels(LightCullingView& view, const ivec3& macro_froxel_min, const ivec3& macro_froxel_max, int light_index, LightType light_type,
+                                     const vec4* light_clip_planes, int num_light_clip_planes);
+   void _injectSphereLightIntoFroxels(LightCullingView& view, const Aabb3& clip_space_aabb, int light_index, const vec3& sphere_center_in_vs, float sphere_radius);
+   template<typename simdfloatT>
+   void _injectSphereLightIntoMacroFroxels(LightCullingView& view, const ivec3& macro_froxel_min, const ivec3& macro_froxel_max, int light_index,
+                                           const vec3& sphere_center_in_vs, float sphere_radius);
+   template<typename simdfloatT>
+   void _updateMacroFroxelInfo(LightCullingView& view, const RenderData& render_data);
+   void _updateMacroFroxelViewSpaceInfo(LightCullingView& view, const RenderData& render_data);
 
    void _initDebugData();
+   void _initDebugFroxelGrid();
    float _convertFroxelZtoCameraZ(float froxel_z, float znear, float zfar);
    float _convertCameraZtoFroxelZ(float z_in_camera_space, float znear, float zfar);
    Aabb3 _computeConvexMeshFroxelBounds(const RenderData& render_data, const mat4& matrix_light_proj_local, vec3* vertices_in_local, int num_vertices);
@@ -108,14 +255,40 @@ public:
 private:
    DISALLOW_COPY_AND_ASSIGN(ClusteredLightCuller)
    ivec3 _froxels_dims;
+   int _requested_max_lights_per_froxel;
+   int _max_lights_per_froxel; // the requested one lowered to the memory budget
+   bool _light_counts_packed;
+   LightCullingMode _culling_mode;
+   int _zbin_count;
+   bool _culling_on_gpu;
+   bool _heads_in_ssbo;
+   ivec3 _scene_light_counts;
+   SimdInstructionSet _simd_instruction_set;
    
-   std::vector<MacroFroxel> _macro_froxel;
-   std::vector<FroxelInfo> _froxel_info;
-   MacroFroxelInfo _macro_froxel_info;
+   SharedLightCullingData _shared_data;
+   std::vector<Uptr<LightCullingView>> _views;
+
+   // scratch of the view being built, the views are built one after the other
+   std::vector<unsigned int> _froxel_row_list_offsets;
+   std::vector<ZBinnedLight> _zbinned_lights[3];
+   std::vector<ivec2> _zbins;
+   std::vector<unsigned int> _tile_masks;
+   std::vector<unsigned char> _visible_lights[3]; // only the lights the shared bvh finds in the view frustum are injected
+
+   // the head texture is shared by the views, it is only written when it does not already hold the lists of the rendered view
+   int _head_texture_view;
+   unsigned int _head_texture_lists_version;
 
+   // each segment of the buffers holds the ranges of all the views one after the other
+   std::int64_t _view_head_size;
+   std::int64_t _view_data_size;
+   std::int64_t _view_culled_lights_size;
    Uptr<GLTexture3D> _light_list_head;
-   Uptr<GLDynamicBuffer> _light_list_head_pbo;
+   Uptr<GLDynamicBuffer> _light_list_head_pbo; // also bound as a ssbo when the shaders read the heads from it
    Uptr<GLDynamicBuffer> _light_list_data;
+   Uptr<GLDynamicBuffer> _gpu_culled_lights; // the lights prepared for the compute shader when culling on the gpu
+   Uptr<GLProgram> _light_culling;
+   Uptr<GLBuffer> _light_list_size;
 
    
    Uptr<GLProgram> _debug_draw_froxel_grid;
@@ -12,7 +12,7 @@
 #include "glsl_cubemap_filtering_defines.h"
 #include "GLSampler.h"
 #include "GLProgram.h"
-#include "GLGPUTimer.h"
+#include "Profiler.h"
 #include "GLBuffer.h"
 
 #define PARALLEL_REDUCE_RESULT_WIDTH 64
@@ -80,14 +80,13 @@ Uptr<GLTextureCubemap> CubemapFiltering::createDiffuseCubemap(const GLTextureCub
    int last_level = input_cubemap.levelCount() - 1;
    int size_64_level = last_level - int(std::log2(128));
    
+   GPUProfileZone profile_zone("diffuse cubemap filtering");
    if (method == DiffuseFilteringMethod::BruteForce)
       _computeDiffuseEnvWithBruteForce(input_cubemap, size_64_level, render_to_cubemap, *diffuse_cubemap);
    else
       _computeDiffuseEnvWithSphericalHarmonics(input_cubemap, size_64_level, render_to_cubemap, *diffuse_cubemap);
 
    diffuse_cubemap->buildMipmaps();
-   _render_resources.timer->stop();
-   _render_resources.timer->printElapsedTimeInMs(TimerResult::CurrentFrame);
 
    return diffuse_cubemap;
 }
@@ -156,7 +155,6 @@ void CubemapFiltering::_computeDiffuseEnvWithSphericalHarmonics(const GLTextureC
                                                                 const GLFramebuffer& diffuse_cubemap_framebuffer,
                                                                 GLTextureCubemap& diffuse_cubemap) const
 {
-   _render_resources.timer->start();
    GLDevice::bindProgram(*_compute_env_spherical_harmonics);
    glUniform1i(BI_INPUT_CUBEMAP_LEVEL, used_input_cubemap_level);   
    GLDevice::bindTexture(BI_INPUT_CUBEMAP, input_cubemap, *_render_resources.samplers.nearest_clampToEdge);
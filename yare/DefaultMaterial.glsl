@@ -1,4 +1,5 @@
 ~~~~~~~~~~~~~~~~~~~VertexShader ~~~~~~~~~~~~~~~~~~~~~
+#extension GL_ARB_shader_draw_parameters : require
 #include "glsl_global_defines.h"
 #include "surface_uniforms.glsl"
 
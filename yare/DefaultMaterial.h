@@ -28,6 +28,7 @@ virtual const GLProgram& compile(MaterialVariant material_variant) override { re
 virtual void bindTextures() override { }
 virtual bool isTransparent() override { return false; }
 virtual bool hasTessellation() override { return false; }
+virtual bool supportsOctahedralDirections() override { return false; }
 
 private:
 DISALLOW_COPY_AND_ASSIGN(DefaultMaterial)
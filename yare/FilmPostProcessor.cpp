@@ -11,6 +11,7 @@
 #include "glsl_film_postprocessing_defines.h"
 #include "GLProgram.h"
 #include "GLBuffer.h"
+#include "Profiler.h"
 
 namespace yare {
 
@@ -37,6 +38,7 @@ void FilmPostProcessor::developFilm()
 {     
    GLDevice::bindDepthStencilState({ false, GL_LEQUAL });
 
+   GPUProfileZone profile_zone("develop film");
    _downscaleSceneTexture();
    
    _computeLuminanceHistogram();
@@ -86,8 +88,7 @@ void FilmPostProcessor::_computeLuminanceHistogram()
    GLDevice::bindImage(BI_INPUT_IMAGE, halfsize_texture0, GL_READ_ONLY);
    GLDevice::bindImage(BI_HISTOGRAMS_IMAGE, *_histograms_texture, GL_READ_WRITE);
 
-   //_timer.start();
-
+   GPUProfileZone profile_zone("luminance histogram");
    GLDevice::bindProgram(*_luminance_histogram);
    glDispatchCompute(num_group_x, num_group_y, 1);
    glMemoryBarrier(GL_ALL_BARRIER_BITS);
@@ -95,9 +96,6 @@ void FilmPostProcessor::_computeLuminanceHistogram()
    GLDevice::bindProgram(*_luminance_histogram_reduce);
    glDispatchCompute(HISTOGRAM_SIZE, 1, 1);
    glMemoryBarrier(GL_ALL_BARRIER_BITS);
-   //_timer.stop();
-
-   //std::cout << _timer.elapsedTimeInMs() << std::endl;
 }
 
 void FilmPostProcessor::_computeBloom()
@@ -105,7 +103,7 @@ void FilmPostProcessor::_computeBloom()
 #if 1
    auto& halfsize_texture0 = (GLTexture2D&)_rr.halfsize_postprocess_fbo->attachedTexture(GL_COLOR_ATTACHMENT0);
    auto& halfsize_texture1 = (GLTexture2D&)_rr.halfsize_postprocess_fbo->attachedTexture(GL_COLOR_ATTACHMENT1);
-   _timer.start();
+   GPUProfileZone profile_zone("bloom");
 
    glViewport(0, 0, halfsize_texture0.width(), halfsize_texture0.height());
    GLDevice::bindFramebuffer(_rr.halfsize_postprocess_fbo.get(), 1);
@@ -144,7 +142,6 @@ void FilmPostProcessor::_computeBloom()
    _rr.halfsize_postprocess_fbo->setDrawColorBuffer(0);
    GLDevice::bindTexture(BI_INPUT_TEXTURE, halfsize_texture1, *_rr.samplers.linear_clampToEdge);
    GLDevice::draw(*_rr.fullscreen_triangle_source);
-   _timer.stop();
 
 #else
    auto& halfsize_texture0 = (GLTexture2D&)_rr.halfsize_postprocess_fbo->attachedTexture(GL_COLOR_ATTACHMENT0);
@@ -155,7 +152,7 @@ void FilmPostProcessor::_computeBloom()
    
    int num_group_x = _rr.framebuffer_size.width / 2;
    int num_group_y = _rr.framebuffer_size.height / 2;
-   _timer.start();
+   GPUProfileZone profile_zone("bloom");
    GLDevice::bindProgram(*_kawase_blur_program);
 
    glUniform1i(BI_KERNEL_SIZE, 0);
@@ -187,17 +184,12 @@ void FilmPostProcessor::_computeBloom()
    GLDevice::bindImage(BI_OUTPUT_IMAGE, halfsize_texture1, GL_WRITE_ONLY);
    glDispatchCompute(num_group_x, num_group_y, 1);
    glMemoryBa_rrier(GL_ALL_BA_rrIER_BITS);
-
-    _timer.stop();
-
-   
 #endif
-    //std::cout << _timer.elapsedTimeInMs() << std::endl;
 }
 
 void FilmPostProcessor::_presentFinalImage()
 {
-   GLDevice::bindFramebuffer(default_framebuffer, 0);   
+   GLDevice::bindFramebuffer(_rr.present_framebuffer ? _rr.present_framebuffer.get() : default_framebuffer, 0);   
    glViewport(0, 0, _rr.framebuffer_size.width, _rr.framebuffer_size.height);
    
    const GLTexture2D& scene_texture = (GLTexture2D&)_rr.main_framebuffer->attachedTexture(GL_COLOR_ATTACHMENT0);
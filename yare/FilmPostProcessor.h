@@ -1,7 +1,6 @@
 #pragma once
 
 #include "tools.h"
-#include "GLGPUTimer.h"
 
 namespace yare {
 
@@ -38,7 +37,6 @@ private:
    Uptr<GLTexture2D> _histograms_texture;
    Uptr<GLBuffer> _exposure_values_ssbo;
    const RenderResources& _rr; // Bad naming but lisibility win for vars referencing
-   GLGPUTimer _timer;
 };
 
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "GLBuffer.h"
 
+#include <algorithm>
+#include <assert.h>
+
 #include "GLFormats.h"
 
 namespace yare {
@@ -31,15 +34,21 @@ void GLBuffer::unmap()
     glUnmapNamedBuffer(_buffer_id);
 }
 
-static const int _segment_count = 3;
+static int _segment_count = 3;
+static bool _segments_in_use = false;
 int GLDynamicBuffer::_update_segment_index = 1;
 int GLDynamicBuffer::_render_segment_index = 0;
+std::vector<GLsync> GLDynamicBuffer::_segment_fences(3, nullptr);
+GLDynamicBufferStalls GLDynamicBuffer::_stalls = { 0, 0, 0.0 };
+bool GLDynamicBuffer::_stalling = false;
+std::chrono::steady_clock::time_point GLDynamicBuffer::_stall_start;
 
 static const int _persistent_map_flags = GL_MAP_WRITE_BIT | GL_MAP_COHERENT_BIT | GL_MAP_PERSISTENT_BIT;
 
 GLDynamicBuffer::GLDynamicBuffer(const GLDynamicBufferDesc& desc)
  : GLBuffer(GLBufferDesc(desc.segment_size_bytes*_segment_count, nullptr, _persistent_map_flags | GL_DYNAMIC_STORAGE_BIT))
 {
+   _segments_in_use = true;
    _head_ptr = (char*)glMapNamedBufferRange(_buffer_id, 0, desc.segment_size_bytes*_segment_count, _persistent_map_flags);
    _segment_size = desc.segment_size_bytes;
 }
@@ -69,11 +78,66 @@ std::int64_t GLDynamicBuffer::getRenderSegmentOffset() const
    return _render_segment_index*segmentSize();
 }
 
-void GLDynamicBuffer::moveActiveSegments()
+int GLDynamicBuffer::segmentCount()
+{
+   return _segment_count;
+}
+
+void GLDynamicBuffer::setSegmentCount(int segment_count)
+{
+   assert(!_segments_in_use && segment_count >= 2);
+   _segment_count = segment_count;
+   _segment_fences.assign(segment_count, nullptr);
+}
+
+void GLDynamicBuffer::resetStalls()
+{
+   _stalls = { 0, 0, 0.0 };
+   _stalling = false;
+}
+
+void GLDynamicBuffer::setUpdateSegment(int segment_index)
+{
+   assert(segment_index >= 0 && segment_index < _segment_count);
+   _update_segment_index = segment_index;
+}
+
+void GLDynamicBuffer::setRenderSegment(int segment_index)
+{
+   assert(segment_index >= 0 && segment_index < _segment_count);
+   _render_segment_index = segment_index;
+}
+
+void GLDynamicBuffer::fenceSegment(int segment_index)
 { 
-   _render_segment_index = (_render_segment_index + 1) % _segment_count;
-   _update_segment_index = (_render_segment_index + 1) % _segment_count;
-   
+   if (_segment_fences[segment_index] != nullptr)
+      glDeleteSync(_segment_fences[segment_index]);
+   _segment_fences[segment_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool GLDynamicBuffer::isSegmentReleased(int segment_index)
+{
+   GLsync fence = _segment_fences[segment_index];
+   if (fence != nullptr)
+   {
+      // flushed so that the fence signals even if the render submits nothing else until the next check
+      if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+      {
+         if (!_stalling)
+            _stall_start = std::chrono::steady_clock::now();
+         _stalling = true;
+         _stalls.stall_count++;
+         return false;
+      }
+      glDeleteSync(fence);
+      _segment_fences[segment_index] = nullptr;
+   }
+
+   if (_stalling)
+      _stalls.stall_time_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _stall_start).count();
+   _stalling = false;
+   _stalls.segment_switch_count++;
+   return true;
 }
 
 
@@ -88,11 +152,13 @@ Uptr<GLBuffer> createBuffer(std::int64_t size_bytes, GLenum flags, void* data)
 
 Uptr<GLDynamicBuffer> createDynamicBuffer(std::int64_t requested_size_bytes)
 {
-   int uniform_buffer_align_size;
+   // segments are bound as uniform buffers or as ssbos
+   int uniform_buffer_align_size, storage_buffer_align_size;
    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_align_size);
+   glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_buffer_align_size);
 
    GLDynamicBufferDesc desc;
-   desc.segment_size_bytes = GLFormats::alignSize(requested_size_bytes, uniform_buffer_align_size);
+   desc.segment_size_bytes = GLFormats::alignSize(requested_size_bytes, std::max(uniform_buffer_align_size, storage_buffer_align_size));
    return std::make_unique<GLDynamicBuffer>(desc);
 }
 
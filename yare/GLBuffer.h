@@ -1,7 +1,9 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <chrono>
 #include <cstdint>
+#include <vector>
 
 #include "tools.h"
 
@@ -37,12 +39,24 @@ protected:
 	std::int64_t _size_bytes;
 };
 
+// Segments handed back to the update by the render since the start or the last reset.
+// The cpu never waits for the gpu: while the segment to hand back is still in use, the render draws the previous snapshot again.
+// A stall is one of these frames, the stall time runs from the first check that found the segment in use to its release.
+struct GLDynamicBufferStalls
+{
+   int segment_switch_count;
+   int stall_count;
+   double stall_time_ms;
+};
+
 struct GLDynamicBufferDesc
 {
    std::int64_t segment_size_bytes;
 };
 
 // Deriving directly from GLBuffer is awkward, there should be a GLBufferBase
+// All the dynamic buffers share the same segments, the update thread writes one while the render thread reads another.
+// A fence is inserted after the last frame that rendered from a segment, the segment is written again once isSegmentReleased() sees it signaled.
 class GLDynamicBuffer : public GLBuffer
 {
 public:
@@ -55,13 +69,34 @@ public:
    std::int64_t getRenderSegmentOffset() const;
 
    std::int64_t segmentSize() const { return _segment_size; }
-   static void moveActiveSegments();
+   // false when the driver could not allocate the buffer
+   bool isMapped() const { return _head_ptr != nullptr; }
+   // each index is only set and read by its own thread
+   static void setUpdateSegment(int segment_index);
+   static void setRenderSegment(int segment_index);
+   // render thread only, after the commands of the last frame that read the segment
+   static void fenceSegment(int segment_index);
+   // render thread only, does not wait, true when the gpu is done with the frames that read the segment.
+   // The segment is then handed back to the update, call it again only after the next fenceSegment()
+   static bool isSegmentReleased(int segment_index);
+   // at least 2, call it before the first dynamic buffer is created
+   static void setSegmentCount(int segment_count);
+   static int segmentCount();
+   static const GLDynamicBufferStalls& stalls() { return _stalls; }
+   static void resetStalls();
+   static int updateSegmentIndex() { return _update_segment_index; }
+   static int renderSegmentIndex() { return _render_segment_index; }
 
 private:
    char* _head_ptr;
    std::int64_t _segment_size;
+
    static int _update_segment_index;
    static int _render_segment_index;
+   static std::vector<GLsync> _segment_fences;
+   static GLDynamicBufferStalls _stalls;
+   static bool _stalling;
+   static std::chrono::steady_clock::time_point _stall_start;
    DISALLOW_COPY_AND_ASSIGN(GLDynamicBuffer)
 };
 
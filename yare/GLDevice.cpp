@@ -53,11 +53,11 @@ void bindTexture(int texture_unit, const GLTexture& texture, const GLSampler& sa
    glBindSamplers(texture_unit, 1, &sampler_id);
 }
 
-void bindImage(int image_unit, const GLTexture& texture, GLenum access)
+void bindImage(int image_unit, const GLTexture& texture, GLenum access, int level)
 {
    const GLTexture3D* texture3d = dynamic_cast<const GLTexture3D*>(&texture);
    bool bind_as_layered = (texture3d != nullptr);
-   glBindImageTexture(image_unit, texture.id(), 0, bind_as_layered, 0, access, texture.internalFormat());   
+   glBindImageTexture(image_unit, texture.id(), level, bind_as_layered, 0, access, texture.internalFormat());   
 }
 
 void bindDepthStencilState(const GLDepthStencilState& state)
@@ -122,7 +122,19 @@ void draw(int vertex_start, int vertex_count)
 void draw(const GLVertexSource& vertex_source)
 {
    glBindVertexArray(vertex_source.id());
-   glDrawArrays(vertex_source.primitiveType(), 0, vertex_source.vertexCount());
+   if (vertex_source.isIndexed())
+      glDrawElements(vertex_source.primitiveType(), vertex_source.indexCount(), vertex_source.indexType(), nullptr);
+   else
+      glDrawArrays(vertex_source.primitiveType(), 0, vertex_source.vertexCount());
+}
+
+void multiDrawIndirect(const GLVertexSource& vertex_source, std::int64_t indirect_offset, int draw_count)
+{
+   glBindVertexArray(vertex_source.id());
+   if (vertex_source.isIndexed())
+      glMultiDrawElementsIndirect(vertex_source.primitiveType(), vertex_source.indexType(), (const void*)indirect_offset, draw_count, 0);
+   else
+      glMultiDrawArraysIndirect(vertex_source.primitiveType(), (const void*)indirect_offset, draw_count, 0);
 }
 
 }}
@@ -2,6 +2,8 @@
 
 #include <GL/glew.h>
 #include <glm/fwd.hpp>
+#include <cstdint>
+
 namespace yare { 
 
 using namespace glm;
@@ -43,7 +45,7 @@ namespace GLDevice
    void bindProgram(const GLProgram& program);
    void bindVertexSource(const GLVertexSource& vertex_source);
    void bindTexture(int texture_unit, const GLTexture& texture, const GLSampler& sampler);
-   void bindImage(int image_unit, const GLTexture& texture, GLenum access);
+   void bindImage(int image_unit, const GLTexture& texture, GLenum access, int level = 0);
 
    void bindDepthStencilState(const GLDepthStencilState& state);
    void bindDefaultDepthStencilState();
@@ -57,6 +59,9 @@ namespace GLDevice
    // draw calls
    void draw(int vertex_start, int vertex_count);
    void draw(const GLVertexSource& vertex_source);
+   // draws with the command array at indirect_offset in the bound GL_DRAW_INDIRECT_BUFFER,
+   // DrawElementsIndirectCommand when the source is indexed, DrawArraysIndirectCommand otherwise
+   void multiDrawIndirect(const GLVertexSource& vertex_source, std::int64_t indirect_offset, int draw_count);
 }
 
 }
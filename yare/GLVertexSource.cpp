@@ -7,6 +7,8 @@ namespace yare {
 GLVertexSource::GLVertexSource()
     : _primitive_type(GL_TRIANGLES)
     , _vertex_count(0)
+    , _index_type(GL_NONE)
+    , _index_count(0)
 {
     glGenVertexArrays(1, &_vao_id);
 }
@@ -16,22 +18,25 @@ GLVertexSource::~GLVertexSource()
     glDeleteVertexArrays(1, &_vao_id);
 }
 
-void GLVertexSource::setVertexAttribute(int attribute_slot, int components, GLenum component_type, GLSLVecType glsl_type, int attribute_stride, std::int64_t attribute_offset)
+void GLVertexSource::setVertexAttribute(int attribute_slot, int components, GLenum component_type, GLSLVecType glsl_type, int attribute_stride, std::int64_t attribute_offset,
+                                        bool normalized)
 {
    glBindVertexArray(_vao_id);
    glEnableVertexAttribArray(attribute_slot);
    if (glsl_type == GLSLVecType::ivec || glsl_type == GLSLVecType::uvec)
       glVertexAttribIPointer(attribute_slot, components, component_type, attribute_stride, (const void*)attribute_offset);
    else
-      glVertexAttribPointer(attribute_slot, components, component_type, GL_FALSE, attribute_stride, (const void*)attribute_offset);
+      glVertexAttribPointer(attribute_slot, components, component_type, normalized ? GL_TRUE : GL_FALSE, attribute_stride, (const void*)attribute_offset);
    glBindVertexArray(0);
 }
 
-void GLVertexSource::setIndexBuffer(const GLBuffer& index_buffer)
+void GLVertexSource::setIndexBuffer(const GLBuffer& index_buffer, GLenum index_type, int index_count)
 {
     glBindVertexArray(_vao_id);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer.id());
     glBindVertexArray(0);
+    _index_type = index_type;
+    _index_count = index_count;
 }
 
 void GLVertexSource::setVertexBuffer(const GLBuffer& vertex_buffer)
@@ -21,8 +21,10 @@ public:
     GLuint id() const { return _vao_id; }
 
     void setVertexAttribute(int attribute_slot, int components, GLenum component_type,
-                            GLSLVecType glsl_type = GLSLVecType::vec, int attribute_stride = 0, std::int64_t attribute_offset = 0);
-    void setIndexBuffer(const GLBuffer& index_buffer);
+                            GLSLVecType glsl_type = GLSLVecType::vec, int attribute_stride = 0, std::int64_t attribute_offset = 0,
+                            bool normalized = false);
+    // the draws of an indexed source read index_count indices of index_type
+    void setIndexBuffer(const GLBuffer& index_buffer, GLenum index_type, int index_count);
     void setVertexBuffer(const GLBuffer& vertex_buffer);
 
     void setPrimitiveType(GLenum primitive_type) {_primitive_type = primitive_type; }
@@ -31,11 +33,17 @@ public:
     void setVertexCount(int vertex_count) {_vertex_count = vertex_count; }
     int vertexCount() const { return _vertex_count; }
 
+    bool isIndexed() const { return _index_type != GL_NONE; }
+    GLenum indexType() const { return _index_type; }
+    int indexCount() const { return _index_count; }
+
 private:
     DISALLOW_COPY_AND_ASSIGN(GLVertexSource)
     GLuint _vao_id;
     GLenum _primitive_type;
     int _vertex_count;
+    GLenum _index_type;
+    int _index_count;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,719 @@
+#include "HeadlessBenchmark.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <random>
+#include <json/json.h>
+#include <glm/gtx/transform.hpp>
+
+#include "ClusteredLightCuller.h"
+#include "GLBuffer.h"
+#include "GLDevice.h"
+#include "GLFramebuffer.h"
+#include "Importer3DY.h"
+#include "ImageSize.h"
+#include "Profiler.h"
+#include "RenderDataMailbox.h"
+#include "RenderEngine.h"
+#include "RenderResources.h"
+#include "Scene.h"
+#include "TransformHierarchy.h"
+
+namespace yare {
+
+struct FrameTimings
+{
+   float update_ms;
+   float render_ms;
+   std::vector<double> gpu_ms; // per gpu zone name
+};
+
+static void __stdcall _printGLError(GLenum source, GLenum type, GLuint id, GLenum severity,
+   GLsizei length, const GLchar* message, const void* userparam)
+{
+   if (severity == GL_DEBUG_SEVERITY_HIGH)
+      std::cerr << message << std::endl;
+}
+
+// EGL is loaded at runtime so that the build does not depend on it, only the few entry points used here are declared
+typedef void* EGLDisplay;
+typedef void* EGLConfig;
+typedef void* EGLContext;
+typedef void* EGLSurface;
+typedef int EGLint;
+typedef unsigned int EGLBoolean;
+typedef unsigned int EGLenum;
+
+static const EGLint EGL_NONE = 0x3038;
+static const EGLint EGL_EXTENSIONS = 0x3055;
+static const EGLint EGL_SURFACE_TYPE = 0x3033;
+static const EGLint EGL_PBUFFER_BIT = 0x0004;
+static const EGLint EGL_RENDERABLE_TYPE = 0x3040;
+static const EGLint EGL_OPENGL_BIT = 0x0008;
+static const EGLint EGL_WIDTH = 0x3057;
+static const EGLint EGL_HEIGHT = 0x3056;
+static const EGLint EGL_CONTEXT_MAJOR_VERSION = 0x3098;
+static const EGLint EGL_CONTEXT_MINOR_VERSION = 0x30FB;
+static const EGLint EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD;
+static const EGLint EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001;
+static const EGLint EGL_CONTEXT_OPENGL_DEBUG = 0x31B0;
+static const EGLenum EGL_OPENGL_API = 0x30A2;
+static const EGLenum EGL_PLATFORM_SURFACELESS_MESA = 0x31DD;
+
+struct EGLFunctions
+{
+   void* (__stdcall *getProcAddress)(const char* name);
+   EGLDisplay (__stdcall *getDisplay)(void* native_display);
+   EGLDisplay (__stdcall *getPlatformDisplayEXT)(EGLenum platform, void* native_display, const EGLint* attribs);
+   EGLBoolean (__stdcall *initialize)(EGLDisplay display, EGLint* major, EGLint* minor);
+   EGLBoolean (__stdcall *terminate)(EGLDisplay display);
+   const char* (__stdcall *queryString)(EGLDisplay display, EGLint name);
+   EGLBoolean (__stdcall *bindAPI)(EGLenum api);
+   EGLBoolean (__stdcall *chooseConfig)(EGLDisplay display, const EGLint* attribs, EGLConfig* configs, EGLint config_size, EGLint* config_count);
+   EGLContext (__stdcall *createContext)(EGLDisplay display, EGLConfig config, EGLContext share_context, const EGLint* attribs);
+   EGLBoolean (__stdcall *destroyContext)(EGLDisplay display, EGLContext context);
+   EGLSurface (__stdcall *createPbufferSurface)(EGLDisplay display, EGLConfig config, const EGLint* attribs);
+   EGLBoolean (__stdcall *destroySurface)(EGLDisplay display, EGLSurface surface);
+   EGLBoolean (__stdcall *makeCurrent)(EGLDisplay display, EGLSurface draw, EGLSurface read, EGLContext context);
+};
+
+// Either an egl context without any window, or the context of a hidden glfw window when egl is not available
+struct HeadlessContext
+{
+   void* egl_library = nullptr;
+   EGLFunctions egl = {};
+   EGLDisplay egl_display = nullptr;
+   EGLContext egl_context = nullptr;
+   EGLSurface egl_surface = nullptr; // a pbuffer, only when the display cannot make a context current without surface
+   GLFWwindow* window = nullptr;
+};
+
+static void* _loadLibrary(const char* name)
+{
+#ifdef _WIN32
+   return LoadLibraryA(name);
+#else
+   return dlopen(name, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void _freeLibrary(void* library)
+{
+#ifdef _WIN32
+   FreeLibrary((HMODULE)library);
+#else
+   dlclose(library);
+#endif
+}
+
+static void* _libraryFunction(void* library, const char* name)
+{
+#ifdef _WIN32
+   return (void*)GetProcAddress((HMODULE)library, name);
+#else
+   return dlsym(library, name);
+#endif
+}
+
+static bool _hasExtension(const char* extensions, const char* name)
+{
+   if (!extensions)
+      return false;
+   std::istringstream stream(extensions);
+   std::string extension;
+   while (stream >> extension)
+   {
+      if (extension == name)
+         return true;
+   }
+   return false;
+}
+
+static void _destroyHeadlessContext(HeadlessContext* context)
+{
+   if (context->egl_display)
+   {
+      context->egl.makeCurrent(context->egl_display, nullptr, nullptr, nullptr);
+      if (context->egl_surface)
+         context->egl.destroySurface(context->egl_display, context->egl_surface);
+      if (context->egl_context)
+         context->egl.destroyContext(context->egl_display, context->egl_context);
+      context->egl.terminate(context->egl_display);
+   }
+   if (context->egl_library)
+      _freeLibrary(context->egl_library);
+   if (context->window)
+   {
+      glfwDestroyWindow(context->window);
+      glfwTerminate();
+   }
+   *context = HeadlessContext();
+}
+
+// A context that needs no window system at all, on the mesa surfaceless platform when the library has it.
+// With mesa, llvmpipe runs it without any gpu.
+static bool _createEGLContext(HeadlessContext* context)
+{
+#ifdef _WIN32
+   context->egl_library = _loadLibrary("libEGL.dll");
+#else
+   context->egl_library = _loadLibrary("libEGL.so.1");
+#endif
+   if (!context->egl_library)
+      return false;
+
+   EGLFunctions& egl = context->egl;
+   egl.getProcAddress = (decltype(egl.getProcAddress))_libraryFunction(context->egl_library, "eglGetProcAddress");
+   if (!egl.getProcAddress)
+      return false;
+   egl.getDisplay = (decltype(egl.getDisplay))egl.getProcAddress("eglGetDisplay");
+   egl.getPlatformDisplayEXT = (decltype(egl.getPlatformDisplayEXT))egl.getProcAddress("eglGetPlatformDisplayEXT");
+   egl.initialize = (decltype(egl.initialize))egl.getProcAddress("eglInitialize");
+   egl.terminate = (decltype(egl.terminate))egl.getProcAddress("eglTerminate");
+   egl.queryString = (decltype(egl.queryString))egl.getProcAddress("eglQueryString");
+   egl.bindAPI = (decltype(egl.bindAPI))egl.getProcAddress("eglBindAPI");
+   egl.chooseConfig = (decltype(egl.chooseConfig))egl.getProcAddress("eglChooseConfig");
+   egl.createContext = (decltype(egl.createContext))egl.getProcAddress("eglCreateContext");
+   egl.destroyContext = (decltype(egl.destroyContext))egl.getProcAddress("eglDestroyContext");
+   egl.createPbufferSurface = (decltype(egl.createPbufferSurface))egl.getProcAddress("eglCreatePbufferSurface");
+   egl.destroySurface = (decltype(egl.destroySurface))egl.getProcAddress("eglDestroySurface");
+   egl.makeCurrent = (decltype(egl.makeCurrent))egl.getProcAddress("eglMakeCurrent");
+   if (!egl.getDisplay || !egl.initialize || !egl.terminate || !egl.queryString || !egl.bindAPI || !egl.chooseConfig
+       || !egl.createContext || !egl.destroyContext || !egl.createPbufferSurface || !egl.destroySurface || !egl.makeCurrent)
+      return false;
+
+   // the client extensions are queried without display
+   const char* client_extensions = egl.queryString(nullptr, EGL_EXTENSIONS);
+   EGLDisplay display = nullptr;
+   if (egl.getPlatformDisplayEXT && _hasExtension(client_extensions, "EGL_MESA_platform_surfaceless"))
+      display = egl.getPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+   if (!display)
+      display = egl.getDisplay(nullptr);
+   if (!display || !egl.initialize(display, nullptr, nullptr))
+      return false;
+   context->egl_display = display;
+
+   if (!egl.bindAPI(EGL_OPENGL_API))
+      return false;
+
+   // everything renders to offscreen framebuffers, the default one is never used: a context without surface needs no config
+   const char* display_extensions = egl.queryString(display, EGL_EXTENSIONS);
+   bool surfaceless = _hasExtension(display_extensions, "EGL_KHR_surfaceless_context") && _hasExtension(display_extensions, "EGL_KHR_no_config_context");
+   EGLConfig config = nullptr;
+   if (!surfaceless)
+   {
+      const EGLint config_attribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+      EGLint config_count = 0;
+      if (!egl.chooseConfig(display, config_attribs, &config, 1, &config_count) || config_count == 0)
+         return false;
+   }
+
+   const EGLint context_attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                      EGL_CONTEXT_OPENGL_DEBUG, 1, EGL_NONE };
+   context->egl_context = egl.createContext(display, config, nullptr, context_attribs);
+   if (!context->egl_context)
+      return false;
+
+   if (!surfaceless)
+   {
+      const EGLint pbuffer_attribs[] = { EGL_WIDTH, 64, EGL_HEIGHT, 64, EGL_NONE };
+      context->egl_surface = egl.createPbufferSurface(display, config, pbuffer_attribs);
+      if (!context->egl_surface)
+         return false;
+   }
+   return egl.makeCurrent(display, context->egl_surface, context->egl_surface, context->egl_context) != 0;
+}
+
+// The context of a hidden glfw window, created through wgl like the windowed app.
+// Mesa's opengl32.dll next to the executable makes it a llvmpipe context, no gpu is needed, but it still needs a desktop.
+static bool _createHiddenContext(HeadlessContext* context)
+{
+   if (!glfwInit())
+      return false;
+
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+   glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+   glfwWindowHint(GLFW_DEPTH_BITS, 0);
+   glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+   context->window = glfwCreateWindow(64, 64, "yare headless", nullptr, nullptr);
+   if (!context->window)
+   {
+      glfwTerminate();
+      return false;
+   }
+
+   glfwMakeContextCurrent(context->window);
+   return true;
+}
+
+static bool _initHeadlessGL(HeadlessContext* context)
+{
+   // glew loads the functions through the window system of the platform: with the system opengl32.dll an egl context
+   // is not current for it and glew fails or misses the functions, the hidden window is then used instead
+   bool context_ready = _createEGLContext(context) && glewInit() == GLEW_OK && glCreateBuffers != nullptr;
+   if (!context_ready)
+   {
+      _destroyHeadlessContext(context);
+      if (!_createHiddenContext(context))
+      {
+         fprintf(stderr, "egl and glfw: failed to create an opengl 4.5 context\n");
+         return false;
+      }
+      if (glewInit() != GLEW_OK)
+      {
+         fprintf(stderr, "glew: failed to initialize\n");
+         _destroyHeadlessContext(context);
+         return false;
+      }
+   }
+
+   glEnable(GL_DEBUG_OUTPUT);
+   glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+   glDebugMessageCallback(&_printGLError, nullptr);
+   glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+   GLDevice::bindDefaultDepthStencilState();
+   GLDevice::bindDefaultColorBlendState();
+   GLDevice::bindDefaultRasterizationState();
+   return true;
+}
+
+static void _importScene(const std::string& scene_file, RenderEngine* render_engine)
+{
+   import3DY(scene_file, *render_engine, render_engine->scene());
+   // baking needs the opencl raytracer, the volumes that were not baked in the file are not used
+   Scene* scene = render_engine->scene();
+   if (scene->ao_volume && !scene->ao_volume->ao_texture)
+      scene->ao_volume.reset();
+   if (scene->sdf_volume && !scene->sdf_volume->sdf_texture)
+      scene->sdf_volume.reset();
+   render_engine->offlinePrepareScene();
+}
+
+static bool _readCameraPath(const std::string& filename, std::vector<PointOfView>* keys)
+{
+   std::ifstream file(filename);
+   std::string line;
+   while (std::getline(file, line))
+   {
+      if (line.empty() || line[0] == '#')
+         continue;
+
+      std::istringstream stream(line);
+      PointOfView key;
+      stream >> key.from.x >> key.from.y >> key.from.z >> key.to.x >> key.to.y >> key.to.z >> key.up.x >> key.up.y >> key.up.z;
+      if (!stream)
+         return false;
+      keys->push_back(key);
+   }
+   return !keys->empty();
+}
+
+static PointOfView _cameraPathPointOfView(const std::vector<PointOfView>& keys, int frame, int frame_count)
+{
+   float t = frame_count > 1 ? float(frame) / float(frame_count - 1) * float(keys.size() - 1) : 0.0f;
+   int key = glm::min(int(t), int(keys.size()) - 1);
+   int next_key = glm::min(key + 1, int(keys.size()) - 1);
+   float blend = t - float(key);
+
+   PointOfView point_of_view = keys[key];
+   point_of_view.from = glm::mix(keys[key].from, keys[next_key].from, blend);
+   point_of_view.to = glm::mix(keys[key].to, keys[next_key].to, blend);
+   point_of_view.up = glm::normalize(glm::mix(keys[key].up, keys[next_key].up, blend));
+   return point_of_view;
+}
+
+// the gpu zones of each frame, by name in the order they first ran, the zones that ran several times in a frame are summed
+static void _gatherGPUTimings(std::uint64_t first_frame, std::vector<FrameTimings>* frames, std::vector<std::string>* gpu_zone_names)
+{
+   std::map<std::string, int> columns;
+   for (const auto& event : Profiler::events())
+   {
+      if (event.track != cGPUProfilerTrack || event.frame < first_frame || event.frame >= first_frame + frames->size())
+         continue;
+
+      auto column = columns.find(event.name);
+      if (column == columns.end())
+      {
+         column = columns.insert({ event.name, int(gpu_zone_names->size()) }).first;
+         gpu_zone_names->push_back(event.name);
+      }
+
+      FrameTimings& frame = (*frames)[event.frame - first_frame];
+      frame.gpu_ms.resize(gpu_zone_names->size(), 0.0);
+      frame.gpu_ms[column->second] += event.duration_us / 1000.0;
+   }
+
+   for (auto& frame : *frames)
+      frame.gpu_ms.resize(gpu_zone_names->size(), 0.0);
+}
+
+static std::string _csvColumnName(std::string name)
+{
+   std::replace(name.begin(), name.end(), ' ', '_');
+   return name;
+}
+
+static void _writeCSV(std::ostream& out, const std::vector<FrameTimings>& frames, const std::vector<std::string>& gpu_zone_names)
+{
+   out << "frame,update_ms,render_ms";
+   for (const auto& name : gpu_zone_names)
+      out << ",gpu_" << _csvColumnName(name) << "_ms";
+   out << "\n";
+
+   for (int i = 0; i < int(frames.size()); ++i)
+   {
+      out << i << "," << frames[i].update_ms << "," << frames[i].render_ms;
+      for (double gpu_ms : frames[i].gpu_ms)
+         out << "," << gpu_ms;
+      out << "\n";
+   }
+}
+
+static void _writeJSON(std::ostream& out, const std::string& scene_file, const ImageSize& size,
+                       const std::vector<FrameTimings>& frames, const std::vector<std::string>& gpu_zone_names)
+{
+   Json::Value root;
+   root["scene"] = scene_file;
+   root["width"] = size.width;
+   root["height"] = size.height;
+   root["renderer"] = (const char*)glGetString(GL_RENDERER);
+
+   Json::Value& json_frames = root["frames"];
+   for (const auto& frame : frames)
+   {
+      Json::Value json_frame;
+      json_frame["update_ms"] = frame.update_ms;
+      json_frame["render_ms"] = frame.render_ms;
+      for (int i = 0; i < int(gpu_zone_names.size()); ++i)
+         json_frame["gpu_ms"][gpu_zone_names[i]] = frame.gpu_ms[i];
+      json_frames.append(json_frame);
+   }
+
+   Json::StreamWriterBuilder builder;
+   builder["indentation"] = "  ";
+   std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+   writer->write(root, &out);
+   out << "\n";
+}
+
+static float _elapsedMs(std::chrono::steady_clock::time_point start)
+{
+   return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int runHeadlessBenchmark(int argc, char** argv, int dynamic_buffer_segment_count)
+{
+   if (argc != 4 && argc != 6)
+   {
+      fprintf(stderr, "usage: yare --headless scene.3dy camera_path.txt frame_count timings.csv|timings.json [width height]\n");
+      return -1;
+   }
+
+   std::string scene_file = argv[0];
+   std::string output_file = argv[3];
+   int frame_count = atoi(argv[2]);
+   ImageSize size = argc == 6 ? ImageSize(atoi(argv[4]), atoi(argv[5])) : ImageSize(1500, 1000);
+   bool output_json = output_file.size() >= 5 && output_file.compare(output_file.size() - 5, 5, ".json") == 0;
+
+   std::vector<PointOfView> camera_path;
+   if (frame_count <= 0 || !_readCameraPath(argv[1], &camera_path))
+   {
+      fprintf(stderr, "headless: invalid frame count or camera path\n");
+      return -1;
+   }
+
+   HeadlessContext context;
+   if (!_initHeadlessGL(&context))
+      return -1;
+
+   // all the zones of the run are kept for the per frame gpu timings
+   Profiler::setThreadName("render");
+   Profiler::setMaxEventCount(frame_count * 256);
+
+   GLDynamicBuffer::setSegmentCount(dynamic_buffer_segment_count);
+   GLDynamicBuffer::resetStalls();
+   RenderDataMailbox render_data_mailbox;
+   {
+      RenderEngine render_engine(size);
+      render_engine.render_resources->present_framebuffer = createFramebuffer(size, GL_RGBA8, 1);
+
+      _importScene(scene_file, &render_engine);
+      Scene* scene = render_engine.scene();
+
+      std::uint64_t first_frame = Profiler::frameIndex();
+      std::vector<FrameTimings> frames(frame_count);
+      for (int i = 0; i < frame_count; ++i)
+      {
+         scene->camera.point_of_view = _cameraPathPointOfView(camera_path, i, frame_count);
+
+         // the update and the render run one after the other, the timings are not mixed up
+         auto update_start = std::chrono::steady_clock::now();
+         render_engine.updateScene(scene->render_data[render_data_mailbox.writeSlot()]);
+         render_data_mailbox.publish();
+         float update_ms = _elapsedMs(update_start);
+
+         auto render_start = std::chrono::steady_clock::now();
+         render_data_mailbox.consume();
+         render_engine.renderScene(scene->render_data[render_data_mailbox.readSlot()]);
+         glFlush();
+         float render_ms = _elapsedMs(render_start);
+
+         // the gpu results are read frames later, the cpu does not wait for them
+         Profiler::endFrame();
+         frames[i] = { update_ms, render_ms, {} };
+      }
+      glFinish();
+      Profiler::endFrame(true);
+
+      std::vector<std::string> gpu_zone_names;
+      _gatherGPUTimings(first_frame, &frames, &gpu_zone_names);
+
+      std::ofstream output(output_file);
+      if (output_json)
+         _writeJSON(output, scene_file, size, frames, gpu_zone_names);
+      else
+         _writeCSV(output, frames, gpu_zone_names);
+      if (!output)
+      {
+         fprintf(stderr, "headless: failed to write %s\n", output_file.c_str());
+         return -1;
+      }
+
+      const GLDynamicBufferStalls& stalls = GLDynamicBuffer::stalls();
+      printf("segment stalls: %d frames rendered the previous snapshot again for %.2fms, %d switches\n",
+             stalls.stall_count, stalls.stall_time_ms, stalls.segment_switch_count);
+   }
+
+   _destroyHeadlessContext(&context);
+   return 0;
+}
+
+// the lights of one type in the list of a froxel, sorted: the cpu lists keep the order the lights were injected in
+static std::vector<int> _froxelLightList(const uvec4& head, const std::vector<int>& lists, int list_index)
+{
+   int start = int(head.x);
+   for (int i = 0; i < list_index; ++i)
+      start += int(head[1 + i]);
+   int count = int(head[1 + list_index]);
+   if (start < 0 || start + count > int(lists.size()))
+      return { -1 };
+
+   std::vector<int> lights(lists.begin() + start, lists.begin() + start + count);
+   std::sort(lights.begin(), lights.end());
+   return lights;
+}
+
+// the number of froxels whose lists differ, the first ones are printed
+static int _compareLightLists(int frame, int view_index, const std::vector<uvec4> heads[2], const std::vector<int> lists[2])
+{
+   static const char* list_names[3] = { "sphere", "spot", "rectangle" };
+   int mismatch_count = 0;
+   for (int froxel = 0; froxel < int(heads[0].size()); ++froxel)
+   {
+      for (int list_index = 0; list_index < 3; ++list_index)
+      {
+         std::vector<int> cpu_lights = _froxelLightList(heads[0][froxel], lists[0], list_index);
+         std::vector<int> gpu_lights = _froxelLightList(heads[1][froxel], lists[1], list_index);
+         if (cpu_lights == gpu_lights)
+            continue;
+
+         if (mismatch_count < 16)
+            fprintf(stderr, "frame %d view %d froxel %d: %zu %s lights on the cpu, %zu on the gpu\n", frame, view_index, froxel, cpu_lights.size(), list_names[list_index], gpu_lights.size());
+         mismatch_count++;
+         break;
+      }
+   }
+   return mismatch_count;
+}
+
+// the second view of the comparison, from the camera position but looking backward
+static void _setBackwardView(const RenderData& main_view, RenderData* view)
+{
+   const mat4 half_turn = mat4(vec4(-1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, -1, 0), vec4(0, 0, 0, 1));
+   view->frustum = main_view.frustum;
+   view->matrix_proj_view = main_view.matrix_proj_view;
+   view->matrix_view_proj = main_view.matrix_view_proj;
+   view->matrix_view_world = half_turn * main_view.matrix_view_world;
+   view->matrix_proj_world = view->matrix_proj_view * view->matrix_view_world;
+}
+
+static const int cLightCullingTestLightCount = 96;
+
+// The lights of the light culling test: a field of sphere, rectangle and spot lights with random positions, orientations and
+// sizes, from a fixed seed so that every run culls the same scene. The scene has no surface, only the lights are culled.
+static void _createLightCullingTestScene(Scene* scene)
+{
+   std::vector<TransformHierarchyNode> nodes(1);
+   nodes[0].local_transform = { vec3(0.0f), RotationType::Quaternion, vec4(1.0f, 0.0f, 0.0f, 0.0f), vec3(1.0f) };
+   nodes[0].parent_to_node_matrix = mat4x3(1.0f);
+   nodes[0].children_count = 0;
+   nodes[0].first_child = -1;
+   scene->transform_hierarchy = std::make_unique<TransformHierarchy>(std::move(nodes));
+
+   std::mt19937 generator(1234);
+   auto real_rand = [&generator]() { return std::uniform_real_distribution<float>(0.0f, 1.0f)(generator); };
+   for (int i = 0; i < cLightCullingTestLightCount; ++i)
+   {
+      Light light;
+      light.type = LightType(i % 3);
+      light.color = vec3(1.0f);
+      light.strength = 1.0f + real_rand() * 3.0f;
+      vec3 axis = vec3(real_rand(), real_rand(), real_rand()) + vec3(0.1f);
+      light.world_to_local_matrix = mat4x3(rotate(real_rand() * 6.28f, normalize(axis)));
+      light.world_to_local_matrix[3] = vec3(real_rand() * 16.0f - 8.0f, real_rand() * 16.0f - 8.0f, real_rand() * 4.0f - 1.0f);
+
+      switch (light.type)
+      {
+      case LightType::Sphere:
+         light.sphere.size = 0.05f;
+         scene->sphere_lights.push_back(light);
+         break;
+      case LightType::Rectangle:
+         light.rectangle.size_x = 0.2f + real_rand() * 0.5f;
+         light.rectangle.size_y = 0.2f + real_rand() * 0.5f;
+         scene->rectangle_lights.push_back(light);
+         break;
+      default:
+         light.spot.angle = 0.4f + real_rand();
+         light.spot.angle_blend = 0.1f;
+         scene->spot_lights.push_back(light);
+         break;
+      }
+   }
+}
+
+static int _compareLightCulling(const std::function<void(RenderEngine*)>& prepare_scene, const std::vector<PointOfView>& camera_path,
+                                int frame_count, int dynamic_buffer_segment_count)
+{
+   HeadlessContext context;
+   if (!_initHeadlessGL(&context))
+      return -1;
+
+   Profiler::setThreadName("render");
+   GLDynamicBuffer::setSegmentCount(dynamic_buffer_segment_count);
+   RenderDataMailbox render_data_mailbox;
+   int mismatch_count = 0;
+   {
+      RenderEngine render_engine(ImageSize(1500, 1000));
+      render_engine._settings.light_culling_mode = LightCullingMode::FroxelLists;
+      render_engine._settings.light_list_heads_in_ssbo = false;
+      prepare_scene(&render_engine);
+      Scene* scene = render_engine.scene();
+      ClusteredLightCuller& light_culler = *render_engine.froxeled_light_culler;
+
+      // the engine only culls the main view, a second one is culled here so that both ranges of the shared buffers are compared
+      const int view_count = 2;
+      RenderData backward_view;
+      for (int i = 0; i < frame_count; ++i)
+      {
+         scene->camera.point_of_view = _cameraPathPointOfView(camera_path, i, frame_count);
+
+         // the same frame is culled by the cpu then by the gpu, the lists are read back as the shaders see them
+         std::vector<uvec4> heads[view_count][2];
+         std::vector<int> lists[view_count][2];
+         int dropped_light_count = 0;
+         for (int on_gpu = 0; on_gpu < 2; ++on_gpu)
+         {
+            render_engine._settings.light_culling_on_gpu = on_gpu != 0;
+            light_culler.updateGridConfiguration(*scene, view_count);
+            RenderData& main_view = scene->render_data[render_data_mailbox.writeSlot()];
+            render_engine.updateScene(main_view);
+
+            // the main view lists built by the update do not change, only the backward view ones are added
+            _setBackwardView(main_view, &backward_view);
+            RenderData* views[view_count] = { &main_view, &backward_view };
+            light_culler.buildLightLists(*scene, views, view_count);
+            render_data_mailbox.publish();
+
+            // the retired slots are released once the gpu is done, the published one is always consumed
+            glFinish();
+            render_data_mailbox.consume();
+            const RenderData* read_views[view_count] = { &scene->render_data[render_data_mailbox.readSlot()], &backward_view };
+            for (int view_index = 0; view_index < view_count; ++view_index)
+            {
+               light_culler.updateLightListHeadTexture(*read_views[view_index], view_index);
+               light_culler.debugReadLightLists(view_index, &heads[view_index][on_gpu], &lists[view_index][on_gpu]);
+            }
+            if (!on_gpu)
+               dropped_light_count = light_culler.droppedLightCount();
+            Profiler::endFrame();
+         }
+
+         // the cpu lists drop lights by macro froxel and the gpu ones by froxel, full lists may differ
+         if (dropped_light_count > 0)
+            fprintf(stderr, "frame %d: %d lights dropped by full cpu lists\n", i, dropped_light_count);
+         for (int view_index = 0; view_index < view_count; ++view_index)
+            mismatch_count += _compareLightLists(i, view_index, heads[view_index], lists[view_index]);
+      }
+      glFinish();
+   }
+
+   printf("light culling: %d froxels with different cpu and gpu lists over %d frames of 2 views (%s)\n", mismatch_count, frame_count, (const char*)glGetString(GL_RENDERER));
+
+   _destroyHeadlessContext(&context);
+   return mismatch_count == 0 ? 0 : 1;
+}
+
+int runLightCullingComparison(int argc, char** argv, int dynamic_buffer_segment_count)
+{
+   if (argc != 3)
+   {
+      fprintf(stderr, "usage: yare --compare-light-culling scene.3dy camera_path.txt frame_count\n");
+      return -1;
+   }
+
+   std::string scene_file = argv[0];
+   int frame_count = atoi(argv[2]);
+   std::vector<PointOfView> camera_path;
+   if (frame_count <= 0 || !_readCameraPath(argv[1], &camera_path))
+   {
+      fprintf(stderr, "headless: invalid frame count or camera path\n");
+      return -1;
+   }
+
+   return _compareLightCulling([&scene_file](RenderEngine* render_engine) { _importScene(scene_file, render_engine); },
+                               camera_path, frame_count, dynamic_buffer_segment_count);
+}
+
+int runLightCullingTest(int dynamic_buffer_segment_count)
+{
+   // a loop through the light field, with keys inside and outside of it
+   std::vector<PointOfView> camera_path(4);
+   camera_path[0].from = vec3(-10.0f, 0.0f, 1.0f);  camera_path[0].to = vec3(0.0f, 0.0f, 0.0f);
+   camera_path[1].from = vec3(0.0f, -4.0f, 2.0f);   camera_path[1].to = vec3(5.0f, 5.0f, 0.0f);
+   camera_path[2].from = vec3(6.0f, 6.0f, 0.5f);    camera_path[2].to = vec3(-6.0f, 2.0f, 0.0f);
+   camera_path[3].from = vec3(0.0f, 9.0f, 4.0f);    camera_path[3].to = vec3(0.0f, 0.0f, 0.0f);
+
+   auto prepare_scene = [](RenderEngine* render_engine)
+   {
+      _createLightCullingTestScene(render_engine->scene());
+      // the lists never drop a light, the cpu and gpu lists must be the same in every froxel
+      render_engine->_settings.max_lights_per_froxel = cLightCullingTestLightCount;
+      render_engine->offlinePrepareScene();
+   };
+   return _compareLightCulling(prepare_scene, camera_path, 24, dynamic_buffer_segment_count);
+}
+
+}
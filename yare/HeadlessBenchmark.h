@@ -0,0 +1,26 @@
+#pragma once
+
+namespace yare {
+
+// yare --headless scene.3dy camera_path.txt frame_count timings.csv|timings.json [width height]
+// Renders to an offscreen framebuffer in an egl context without window, from libEGL loaded at runtime. Without egl, or
+// when glew cannot load the functions of the egl context, a hidden glfw window is created instead, which needs a desktop.
+// Mesa's llvmpipe runs both without gpu. HEADLESS_BENCHMARK in main.cpp builds the mode. The camera path has one key per line,
+// "from.x from.y from.z to.x to.y to.z up.x up.y up.z", the frames are spread evenly along the keys.
+// The timings are the cpu update and render of each frame and its gpu profiler zones.
+// The dynamic buffers have the segment count of the windowed app. Returns the process exit code.
+int runHeadlessBenchmark(int argc, char** argv, int dynamic_buffer_segment_count);
+
+// yare --compare-light-culling scene.3dy camera_path.txt frame_count
+// Builds the froxel light lists of each frame of the camera path on the cpu and with the culling compute shader,
+// in the same headless context, and compares the lists each froxel reads from the heads and the data.
+// The lights are culled for the camera and for a second view looking backward, in their ranges of the shared buffers.
+// Returns 0 when every froxel has the same lights with both backends.
+int runLightCullingComparison(int argc, char** argv, int dynamic_buffer_segment_count);
+
+// yare --test-light-culling
+// The comparison on a fixed scene of generated lights and a fixed camera path, with lists large enough to never drop
+// a light. Returns 0 when the lists match, 1 otherwise, so that it can run as a test.
+int runLightCullingTest(int dynamic_buffer_segment_count);
+
+}
@@ -5,7 +5,7 @@ namespace yare {
 class GLProgram;
 struct RenderResources;
 
-enum class MaterialVariant : int {Normal = 1 << 0, WithSkinning = 1 << 1, EnableAOVolume = 1 << 2, EnableSDFVolume = 1 << 3};
+enum class MaterialVariant : int {Normal = 1 << 0, WithSkinning = 1 << 1, EnableAOVolume = 1 << 2, EnableSDFVolume = 1 << 3, OctahedralDirections = 1 << 4};
 
 class IMaterial
 {
@@ -18,6 +18,8 @@ public:
    virtual void bindTextures() = 0;
    virtual bool isTransparent() = 0;
    virtual bool hasTessellation() = 0;
+   // the shaders can decode octahedral normals and tangents, with the OctahedralDirections variant
+   virtual bool supportsOctahedralDirections() = 0;
    
 };
 
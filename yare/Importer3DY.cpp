@@ -11,6 +11,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "GLTexture.h"
+#include "MappedFile.h"
 #include "RenderMesh.h"
 #include "Scene.h"
 #include "ShadeTreeNode.h"
@@ -38,14 +39,13 @@ static void readDataBlock(const Json::Value& json_object, uint64_t* address, uin
 	*size = datablock["Size"].asUInt64();
 }
 
-static std::unique_ptr<char[]> readDataBlock(const Json::Value& json_object, std::ifstream& data_file)
+// the block in the mapped data file, not copied
+static const char* readDataBlock(const Json::Value& json_object, const MappedFile& data_file)
 {
    uint64_t address, size;
    readDataBlock(json_object, &address, &size);
-   auto buffer = std::make_unique<char[]>(size);
-   data_file.seekg(address, std::ios::beg);
-   data_file.read(buffer.get(), size);
-   return buffer;
+   assert(address + size <= uint64_t(data_file.size()));
+   return data_file.data() + address;
 }
 
 static MeshFieldName _fieldName(const std::string& field_name)
@@ -82,7 +82,27 @@ GLenum _componentType(const std::string& component_type)
    return 0;
 }
 
-static Uptr<RenderMesh> readMesh(const Json::Value& mesh_object, std::ifstream& data_file)
+// packed format of each float field, the normals and tangents stay floats for the materials that cannot decode them
+static VertexEncoding _vertexEncoding(MeshFieldName field_name, bool octahedral_directions)
+{
+   switch (field_name)
+   {
+   case MeshFieldName::Position:
+      return VertexEncoding::Unorm16;
+   case MeshFieldName::Normal:
+      return octahedral_directions ? VertexEncoding::Octahedral16 : VertexEncoding::Float;
+   case MeshFieldName::Tangent0:
+      return octahedral_directions ? VertexEncoding::Octahedral8 : VertexEncoding::Float;
+   case MeshFieldName::Uv0:
+      return VertexEncoding::HalfFloat;
+   case MeshFieldName::BoneWeights:
+      return VertexEncoding::Unorm8;
+   default:
+      return VertexEncoding::Float;
+   }
+}
+
+static Uptr<RenderMesh> readMesh(const Json::Value& mesh_object, const Sptr<const MappedFile>& data_file, bool octahedral_directions)
 {
 	int vertex_count = mesh_object["VertexCount"].asInt();
 	int triangle_count = mesh_object["TriangleCount"].asInt();
@@ -105,15 +125,13 @@ static Uptr<RenderMesh> readMesh(const Json::Value& mesh_object, std::ifstream&
 	{
 		uint64_t address, size;
 		readDataBlock(field, &address, &size);
-		data_file.seekg(address, std::ios::beg);
 		auto name = _fieldName(field["Name"].asString());
-		char* vertex_field = (char*)render_mesh->mapVertices(name);
-		//auto var = size / 3 / 4 ;
-		//assert(var == vertex_count);
-		data_file.read(vertex_field, size);
-		render_mesh->unmapVertices();
+		render_mesh->mapFieldToFile(name, data_file, address);
 	}
 
+   render_mesh->optimizeForIndexedDraw();
+   for (const auto& field : mesh_fields)
+      render_mesh->encodeField(field.name, _vertexEncoding(field.name, octahedral_directions));
    render_mesh->commitToGPU();
 
 	return render_mesh;
@@ -220,27 +238,27 @@ static void readVectMathNodeProperties(const Json::Value& json_node, VectorMathN
    node.operation = json_node["Operation"].asString();
 }
 
-static void readColorRampNodeProperties(const Json::Value& json_node, ColorRampNode& node, std::ifstream& data_file)
+static void readColorRampNodeProperties(const Json::Value& json_node, ColorRampNode& node, const MappedFile& data_file)
 {
    const auto& json_colors = json_node["Colors"];
-   auto temp_buf_ptr = readDataBlock(json_colors, data_file);
-   node.ramp_texture = createMipmappedTexture1D(256, GL_RGB16, temp_buf_ptr.get());
+   const char* colors = readDataBlock(json_colors, data_file);
+   node.ramp_texture = createMipmappedTexture1D(256, GL_RGB16, (void*)colors);
 }
 
-static auto readCurve(const Json::Value& json_curve_node, std::ifstream& data_file)
+static auto readCurve(const Json::Value& json_curve_node, const MappedFile& data_file)
 {
-   auto temp_buf_ptr = readDataBlock(json_curve_node, data_file);
-   return createTexture1D(256, GL_R16, temp_buf_ptr.get());
+   const char* curve = readDataBlock(json_curve_node, data_file);
+   return createTexture1D(256, GL_R16, (void*)curve);
 }
 
-static void readCurveRgbNodeProperties(const Json::Value& json_node, CurveRgbNode& node, std::ifstream& data_file)
+static void readCurveRgbNodeProperties(const Json::Value& json_node, CurveRgbNode& node, const MappedFile& data_file)
 {
    node.red_curve = readCurve(json_node["RedCurve"], data_file);
    node.green_curve = readCurve(json_node["GreenCurve"], data_file);
    node.blue_curve = readCurve(json_node["BlueCurve"], data_file);
 }
 
-static Uptr<ShadeTreeMaterial> readMaterial(const RenderEngine& render_engine, const Json::Value& json_material, const TextureMap& textures, std::ifstream& data_file)
+static Uptr<ShadeTreeMaterial> readMaterial(const RenderEngine& render_engine, const Json::Value& json_material, const TextureMap& textures, const MappedFile& data_file)
 {   
    Uptr<ShadeTreeMaterial> material = std::make_unique<ShadeTreeMaterial>(*render_engine.render_resources);
     material->name = json_material["Name"].asString();
@@ -273,7 +291,7 @@ static Uptr<ShadeTreeMaterial> readMaterial(const RenderEngine& render_engine, c
 }
 
 
-static MaterialMap readMaterials(const RenderEngine& render_engine, const Json::Value& json_materials, const TextureMap& textures, std::ifstream& data_file)
+static MaterialMap readMaterials(const RenderEngine& render_engine, const Json::Value& json_materials, const TextureMap& textures, const MappedFile& data_file)
 {
    MaterialMap materials;
    for (const auto& json_material : json_materials)
@@ -612,7 +630,13 @@ void addSDFVolume(Scene* scene)
 
 void import3DY(const std::string& filename, const RenderEngine& render_engine, Scene* scene)
 {
-	std::ifstream data_file(filename+"\\data.bin", std::ifstream::binary);
+	// mapped once, the meshes and the materials read their data blocks in place
+	auto data_file = std::make_shared<const MappedFile>(filename+"\\data.bin");
+   if (!data_file->isOpen())
+   {
+      std::cout << "import3DY: cannot map " << filename << "\\data.bin, the scene is not imported" << std::endl;
+      return;
+   }
 
 	Json::Value root;
 	std::ifstream json_file(filename+"\\structure.json");
@@ -635,7 +659,7 @@ void import3DY(const std::string& filename, const RenderEngine& render_engine, S
    readActions(root["Actions"], scene);
    auto skeletons = readSkeletons(root["Skeletons"], scene);
    auto textures = readTextures(root["Textures"]);
-   auto materials = readMaterials(render_engine, root["Materials"], textures, data_file);        
+   auto materials = readMaterials(render_engine, root["Materials"], textures, *data_file);        
    
 
 	const auto& json_surfaces = root["Surfaces"];
@@ -643,22 +667,23 @@ void import3DY(const std::string& filename, const RenderEngine& render_engine, S
    auto default_material = std::make_shared<DefaultMaterial>();
    for (const auto& json_surface : json_surfaces)
 	{			
-		auto render_mesh = readMesh(json_surface["Mesh"], data_file);
+		SurfaceInstance surface_instance;
+      auto mat_it = materials.find(json_surface["Material"].asString());
+      if (mat_it != materials.end())
+         surface_instance.material = mat_it->second;
+      else
+         surface_instance.material = default_material;
+
+      bool octahedral_directions = surface_instance.material->supportsOctahedralDirections();
+		auto render_mesh = readMesh(json_surface["Mesh"], data_file, octahedral_directions);
 		if (!render_mesh)
 			continue;
 		//const auto& json_matrix = json_surface["WorldToLocalMatrix"];
 		
-		SurfaceInstance surface_instance;
       surface_instance.center_in_local_space = readVec3(json_surface["CenterInLocal"]);
 		surface_instance.mesh = std::move(render_mesh);
       surface_instance.transform_node_index = scene->object_name_to_transform_node_index.at(json_surface["Name"].asString());
 
-      auto mat_it = materials.find(json_surface["Material"].asString());
-      if (mat_it != materials.end())
-         surface_instance.material = mat_it->second;
-      else
-         surface_instance.material = default_material;
-
       auto sk_it = skeletons.find(json_surface["Skeleton"].asString());
       if (sk_it != skeletons.end())
       {
@@ -681,6 +706,15 @@ void import3DY(const std::string& filename, const RenderEngine& render_engine, S
          ((int&)surface_instance.material_variant) |= int(MaterialVariant::EnableSDFVolume);
       }
 
+      if (octahedral_directions)
+         ((int&)surface_instance.material_variant) |= int(MaterialVariant::OctahedralDirections);
+
+      // skinning and tessellation displacement move the vertices out of their bounds, these surfaces are never culled
+      if (surface_instance.skeleton || surface_instance.material->hasTessellation())
+         surface_instance.bounds_in_local_space.setNull();
+      else
+         surface_instance.bounds_in_local_space = surface_instance.mesh->positionBounds();
+
       surface_instance.material_program = &surface_instance.material->compile(surface_instance.material_variant);
 		scene->surfaces.push_back(surface_instance);      
 	}
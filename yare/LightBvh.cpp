@@ -0,0 +1,161 @@
+#include "LightBvh.h"
+
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+namespace yare {
+
+static const int cMaxLightsPerLeaf = 4;
+
+// median splits keep the depth under log2 of the lights count
+static const int cMaxDepth = 64;
+
+LightBvh::LightBvh()
+{
+   _light_counts[0] = _light_counts[1] = _light_counts[2] = 0;
+}
+
+static Aabb3 _lightBounds(const LightBvhItem& light, const std::vector<Aabb3>* light_bounds)
+{
+   return light_bounds[light.light_type][light.light_index];
+}
+
+static void _extend(Aabb3* bounds, const Aabb3& other)
+{
+   bounds->extend(other.pmin);
+   bounds->extend(other.pmax);
+}
+
+void LightBvh::build(const std::vector<Aabb3>* light_bounds)
+{
+   _nodes.clear();
+   _lights.clear();
+   for (int light_type = 0; light_type < 3; ++light_type)
+   {
+      _light_counts[light_type] = (int)light_bounds[light_type].size();
+      for (int i = 0; i < _light_counts[light_type]; ++i)
+         _lights.push_back({ light_type, i });
+   }
+
+   if (!_lights.empty())
+      _buildNode(0, (int)_lights.size(), light_bounds);
+}
+
+int LightBvh::_buildNode(int first_light, int light_count, const std::vector<Aabb3>* light_bounds)
+{
+   int node_index = (int)_nodes.size();
+   _nodes.emplace_back();
+
+   Aabb3 bounds;
+   Aabb3 centers;
+   for (int i = first_light; i < first_light + light_count; ++i)
+   {
+      Aabb3 light = _lightBounds(_lights[i], light_bounds);
+      _extend(&bounds, light);
+      centers.extend(0.5f * (light.pmin + light.pmax));
+   }
+
+   _nodes[node_index].bounds = bounds;
+   _nodes[node_index].first_light = first_light;
+   _nodes[node_index].light_count = light_count;
+   _nodes[node_index].second_child = -1;
+
+   vec3 centers_extent = centers.pmax - centers.pmin;
+   int axis = (centers_extent.x > centers_extent.y) ? 0 : 1;
+   axis = (centers_extent.z > centers_extent[axis]) ? 2 : axis;
+   if (light_count <= cMaxLightsPerLeaf || centers_extent[axis] <= 0.0f)
+      return node_index;
+
+   // split at the median light center along the largest axis
+   int half_count = light_count / 2;
+   auto first = _lights.begin() + first_light;
+   std::nth_element(first, first + half_count, first + light_count, [&](const LightBvhItem& a, const LightBvhItem& b)
+   {
+      Aabb3 bounds_a = _lightBounds(a, light_bounds);
+      Aabb3 bounds_b = _lightBounds(b, light_bounds);
+      return bounds_a.pmin[axis] + bounds_a.pmax[axis] < bounds_b.pmin[axis] + bounds_b.pmax[axis];
+   });
+
+   _buildNode(first_light, half_count, light_bounds);
+   int second_child = _buildNode(first_light + half_count, light_count - half_count, light_bounds);
+   _nodes[node_index].second_child = second_child;
+
+   return node_index;
+}
+
+void LightBvh::refit(const std::vector<Aabb3>* light_bounds)
+{
+   // children are stored after their parent
+   for (int node_index = (int)_nodes.size() - 1; node_index >= 0; --node_index)
+   {
+      LightBvhNode& node = _nodes[node_index];
+      node.bounds.setNull();
+      if (node.second_child == -1)
+      {
+         for (int i = node.first_light; i < node.first_light + node.light_count; ++i)
+            _extend(&node.bounds, _lightBounds(_lights[i], light_bounds));
+      }
+      else
+      {
+         _extend(&node.bounds, _nodes[node_index + 1].bounds);
+         _extend(&node.bounds, _nodes[node.second_child].bounds);
+      }
+   }
+}
+
+void LightBvh::cullLights(const vec4* planes, int plane_count, std::vector<unsigned char>* visible_lights) const
+{
+   for (int light_type = 0; light_type < 3; ++light_type)
+      visible_lights[light_type].assign(_light_counts[light_type], 0);
+
+   if (_nodes.empty())
+      return;
+
+   // the planes a node is tested against are the ones its parent is not fully inside of
+   struct NodeToVisit
+   {
+      int node_index;
+      int plane_mask;
+   };
+   NodeToVisit stack[cMaxDepth + 1];
+   int stack_size = 0;
+   stack[stack_size++] = { 0, (1 << plane_count) - 1 };
+
+   while (stack_size > 0)
+   {
+      NodeToVisit visit = stack[--stack_size];
+      const LightBvhNode& node = _nodes[visit.node_index];
+      vec3 center = 0.5f * (node.bounds.pmax + node.bounds.pmin);
+      vec3 extent = 0.5f * (node.bounds.pmax - node.bounds.pmin);
+
+      bool outside = false;
+      int plane_mask = visit.plane_mask;
+      for (int i = 0; i < plane_count && !outside; ++i)
+      {
+         if ((plane_mask & (1 << i)) == 0)
+            continue;
+
+         float d = dot(center, vec3(planes[i].xyz)) + planes[i].w;
+         float r = dot(extent, abs(vec3(planes[i].xyz)));
+         outside = d + r < 0.0f;
+         if (d - r >= 0.0f)
+            plane_mask &= ~(1 << i);
+      }
+
+      if (outside)
+         continue;
+
+      if (plane_mask == 0 || node.second_child == -1)
+      {
+         for (int i = node.first_light; i < node.first_light + node.light_count; ++i)
+            visible_lights[_lights[i].light_type][_lights[i].light_index] = 1;
+         continue;
+      }
+
+      stack[stack_size++] = { node.second_child, plane_mask };
+      stack[stack_size++] = { visit.node_index + 1, plane_mask };
+   }
+}
+
+}
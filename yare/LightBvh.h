@@ -0,0 +1,51 @@
+#pragma once
+
+#include "tools.h"
+
+#include <vector>
+#include <glm/vec4.hpp>
+
+#include "Aabb3.h"
+
+namespace yare {
+
+using namespace glm;
+
+// The lights of a subtree are a contiguous range of the bvh lights, inner nodes keep that range too
+struct LightBvhNode
+{
+   Aabb3 bounds;
+   int first_light;
+   int light_count;
+   int second_child; // -1 for a leaf, the first child follows its parent
+};
+
+struct LightBvhItem
+{
+   int light_type;
+   int light_index;
+};
+
+// Bvh over the world space bounds of the sphere, rectangle and spot lights, indexed by LightType.
+// Build it again when the lights count changes, refit it when lights moved.
+class LightBvh
+{
+public:
+   LightBvh();
+
+   void build(const std::vector<Aabb3>* light_bounds);
+   void refit(const std::vector<Aabb3>* light_bounds);
+
+   // flags the lights whose bounds are not fully outside one of the planes, subtrees are accepted or rejected as a whole.
+   // A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+   void cullLights(const vec4* planes, int plane_count, std::vector<unsigned char>* visible_lights) const;
+
+private:
+   int _buildNode(int first_light, int light_count, const std::vector<Aabb3>* light_bounds);
+
+   std::vector<LightBvhNode> _nodes;
+   std::vector<LightBvhItem> _lights;
+   int _light_counts[3];
+};
+
+}
@@ -0,0 +1,78 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace yare {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+   : _data(nullptr)
+   , _size(0)
+   , _file_handle(INVALID_HANDLE_VALUE)
+   , _mapping_handle(nullptr)
+{
+   _file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   LARGE_INTEGER size;
+   if (_file_handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(_file_handle, &size) || size.QuadPart == 0)
+      return;
+
+   _mapping_handle = CreateFileMappingA(_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (_mapping_handle == nullptr)
+      return;
+
+   _data = (const char*)MapViewOfFile(_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+   if (_data != nullptr)
+      _size = size.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+   if (_data != nullptr)
+      UnmapViewOfFile(_data);
+   if (_mapping_handle != nullptr)
+      CloseHandle(_mapping_handle);
+   if (_file_handle != INVALID_HANDLE_VALUE)
+      CloseHandle(_file_handle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+   : _data(nullptr)
+   , _size(0)
+   , _file_descriptor(-1)
+{
+   _file_descriptor = open(filename.c_str(), O_RDONLY);
+   struct stat file_stat;
+   if (_file_descriptor == -1 || fstat(_file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+      return;
+
+   void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, _file_descriptor, 0);
+   if (data == MAP_FAILED)
+      return;
+
+   _data = (const char*)data;
+   _size = file_stat.st_size;
+}
+
+MappedFile::~MappedFile()
+{
+   if (_data != nullptr)
+      munmap((void*)_data, _size);
+   if (_file_descriptor != -1)
+      close(_file_descriptor);
+}
+
+#endif
+
+}
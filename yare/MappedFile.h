@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "tools.h"
+
+namespace yare {
+
+// Read only mapping of a whole file, the os pages it in when it is read.
+// Not open when the file is missing or empty.
+class MappedFile
+{
+public:
+   explicit MappedFile(const std::string& filename);
+   ~MappedFile();
+
+   bool isOpen() const { return _data != nullptr; }
+   const char* data() const { return _data; }
+   std::int64_t size() const { return _size; }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(MappedFile)
+
+   const char* _data;
+   std::int64_t _size;
+#ifdef _WIN32
+   void* _file_handle;
+   void* _mapping_handle;
+#else
+   int _file_descriptor;
+#endif
+};
+
+}
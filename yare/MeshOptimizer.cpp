@@ -0,0 +1,224 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace yare {
+
+static std::uint64_t _hashVertex(const std::vector<VertexBlock>& blocks, int vertex)
+{
+   // fnv-1a
+   std::uint64_t hash = 14695981039346656037ull;
+   for (const auto& block : blocks)
+   {
+      const unsigned char* bytes = (const unsigned char*)block.data + std::int64_t(vertex)*block.vertex_size;
+      for (int i = 0; i < block.vertex_size; ++i)
+         hash = (hash ^ bytes[i]) * 1099511628211ull;
+   }
+   return hash;
+}
+
+static bool _sameVertex(const std::vector<VertexBlock>& blocks, int a, int b)
+{
+   for (const auto& block : blocks)
+   {
+      if (memcmp(block.data + std::int64_t(a)*block.vertex_size, block.data + std::int64_t(b)*block.vertex_size, block.vertex_size) != 0)
+         return false;
+   }
+   return true;
+}
+
+std::vector<unsigned int> weldVertices(const std::vector<VertexBlock>& blocks, int vertex_count, std::vector<int>* unique_vertices)
+{
+   std::vector<unsigned int> indices(vertex_count);
+   unique_vertices->clear();
+
+   // unique vertices by hash, the collisions are told apart by comparing the bytes
+   std::unordered_multimap<std::uint64_t, int> unique_vertices_by_hash;
+   unique_vertices_by_hash.reserve(vertex_count);
+   for (int vertex = 0; vertex < vertex_count; ++vertex)
+   {
+      std::uint64_t hash = _hashVertex(blocks, vertex);
+      auto candidates = unique_vertices_by_hash.equal_range(hash);
+      auto match = std::find_if(candidates.first, candidates.second, [&](const std::pair<const std::uint64_t, int>& candidate)
+                                { return _sameVertex(blocks, (*unique_vertices)[candidate.second], vertex); });
+
+      if (match != candidates.second)
+      {
+         indices[vertex] = match->second;
+         continue;
+      }
+
+      int unique_vertex = int(unique_vertices->size());
+      unique_vertices->push_back(vertex);
+      unique_vertices_by_hash.insert({ hash, unique_vertex });
+      indices[vertex] = unique_vertex;
+   }
+   return indices;
+}
+
+static const int cVertexCacheSize = 32;
+
+static float _vertexScore(int cache_position, int remaining_triangle_count)
+{
+   if (remaining_triangle_count == 0)
+      return -1.0f;
+
+   float score = 0.0f;
+   if (cache_position >= 0)
+   {
+      // the last triangle vertices get a fixed score, so that the next triangle does not favour one of its edges
+      if (cache_position < 3)
+         score = 0.75f;
+      else
+         score = std::pow(1.0f - float(cache_position - 3) / float(cVertexCacheSize - 3), 1.5f);
+   }
+
+   // vertices with few triangles left are finished first, they are not left behind to be fetched again later
+   score += 2.0f / std::sqrt(float(remaining_triangle_count));
+   return score;
+}
+
+void optimizeVertexCacheOrder(std::vector<unsigned int>* indices, int vertex_count)
+{
+   int triangle_count = int(indices->size()) / 3;
+   if (triangle_count == 0)
+      return;
+
+   // the triangles of each vertex, the ones not added yet are kept at the front of its range
+   std::vector<int> remaining_triangle_counts(vertex_count, 0);
+   for (unsigned int index : *indices)
+      remaining_triangle_counts[index]++;
+
+   std::vector<int> adjacency_offsets(vertex_count + 1, 0);
+   for (int vertex = 0; vertex < vertex_count; ++vertex)
+      adjacency_offsets[vertex + 1] = adjacency_offsets[vertex] + remaining_triangle_counts[vertex];
+
+   std::vector<int> adjacency(indices->size());
+   std::vector<int> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+   for (int triangle = 0; triangle < triangle_count; ++triangle)
+   {
+      for (int corner = 0; corner < 3; ++corner)
+         adjacency[adjacency_fill[(*indices)[3 * triangle + corner]]++] = triangle;
+   }
+
+   std::vector<float> vertex_scores(vertex_count);
+   for (int vertex = 0; vertex < vertex_count; ++vertex)
+      vertex_scores[vertex] = _vertexScore(-1, remaining_triangle_counts[vertex]);
+
+   auto triangle_score = [&](int triangle)
+   {
+      const unsigned int* triangle_indices = &(*indices)[3 * triangle];
+      return vertex_scores[triangle_indices[0]] + vertex_scores[triangle_indices[1]] + vertex_scores[triangle_indices[2]];
+   };
+
+   std::vector<bool> triangle_added(triangle_count, false);
+   int best_triangle = 0;
+   float best_score = triangle_score(0);
+   for (int triangle = 1; triangle < triangle_count; ++triangle)
+   {
+      float score = triangle_score(triangle);
+      if (score > best_score)
+      {
+         best_score = score;
+         best_triangle = triangle;
+      }
+   }
+
+   std::vector<unsigned int> ordered_indices;
+   ordered_indices.reserve(indices->size());
+   std::vector<int> cache, new_cache;
+   cache.reserve(cVertexCacheSize + 3);
+   new_cache.reserve(cVertexCacheSize + 3);
+   int next_unadded_triangle = 0;
+
+   for (int added_count = 0; added_count < triangle_count; ++added_count)
+   {
+      // no triangle left around the cache, the next one in the input order starts again
+      if (best_triangle < 0)
+      {
+         while (triangle_added[next_unadded_triangle])
+            next_unadded_triangle++;
+         best_triangle = next_unadded_triangle;
+      }
+
+      triangle_added[best_triangle] = true;
+      const unsigned int* triangle_indices = &(*indices)[3 * best_triangle];
+      new_cache.clear();
+      for (int corner = 0; corner < 3; ++corner)
+      {
+         int vertex = triangle_indices[corner];
+         ordered_indices.push_back(vertex);
+
+         // removes the triangle from the ones left around the vertex
+         int* triangles = &adjacency[adjacency_offsets[vertex]];
+         int last = --remaining_triangle_counts[vertex];
+         std::swap(*std::find(triangles, triangles + last + 1, best_triangle), triangles[last]);
+
+         if (std::find(new_cache.begin(), new_cache.end(), vertex) == new_cache.end())
+            new_cache.push_back(vertex);
+      }
+
+      // the triangle vertices go to the front of the lru cache, the ones pushed out of it lose their cache score
+      for (int vertex : cache)
+      {
+         if (std::find(new_cache.begin(), new_cache.end(), vertex) == new_cache.end())
+            new_cache.push_back(vertex);
+      }
+      for (int i = cVertexCacheSize; i < int(new_cache.size()); ++i)
+         vertex_scores[new_cache[i]] = _vertexScore(-1, remaining_triangle_counts[new_cache[i]]);
+      new_cache.resize(std::min(int(new_cache.size()), cVertexCacheSize));
+      std::swap(cache, new_cache);
+
+      for (int i = 0; i < int(cache.size()); ++i)
+         vertex_scores[cache[i]] = _vertexScore(i, remaining_triangle_counts[cache[i]]);
+
+      // the next triangle is the best one around the cache
+      best_triangle = -1;
+      best_score = -1.0f;
+      for (int vertex : cache)
+      {
+         for (int i = 0; i < remaining_triangle_counts[vertex]; ++i)
+         {
+            int triangle = adjacency[adjacency_offsets[vertex] + i];
+            float score = triangle_score(triangle);
+            if (score > best_score)
+            {
+               best_score = score;
+               best_triangle = triangle;
+            }
+         }
+      }
+   }
+
+   indices->swap(ordered_indices);
+}
+
+std::vector<int> optimizeVertexFetchOrder(std::vector<unsigned int>* indices, int vertex_count)
+{
+   std::vector<int> new_indices(vertex_count, -1);
+   std::vector<int> previous_indices;
+   previous_indices.reserve(vertex_count);
+   for (unsigned int& index : *indices)
+   {
+      if (new_indices[index] == -1)
+      {
+         new_indices[index] = int(previous_indices.size());
+         previous_indices.push_back(index);
+      }
+      index = new_indices[index];
+   }
+
+   // the vertices no triangle uses go last
+   for (int vertex = 0; vertex < vertex_count; ++vertex)
+   {
+      if (new_indices[vertex] == -1)
+         previous_indices.push_back(vertex);
+   }
+   return previous_indices;
+}
+
+}
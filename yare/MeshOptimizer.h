@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+namespace yare {
+
+// a vertex field stored in its own block, vertex i is at data + i*vertex_size
+struct VertexBlock
+{
+   const char* data;
+   int vertex_size;
+};
+
+// Import time stages that turn a triangle soup into a compact indexed mesh.
+
+// vertices whose bytes are identical in all the blocks are merged, returns the index of each soup vertex
+// and the first soup vertex of each unique vertex in unique_vertices
+std::vector<unsigned int> weldVertices(const std::vector<VertexBlock>& blocks, int vertex_count, std::vector<int>* unique_vertices);
+
+// reorders the triangles for the post transform vertex cache, Forsyth's linear speed vertex cache optimisation
+void optimizeVertexCacheOrder(std::vector<unsigned int>* indices, int vertex_count);
+
+// renumbers the vertices in the order the triangles first use them, so that the fetches go forward in memory.
+// Returns the previous index of each vertex.
+std::vector<int> optimizeVertexFetchOrder(std::vector<unsigned int>* indices, int vertex_count);
+
+}
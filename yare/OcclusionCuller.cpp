@@ -0,0 +1,106 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+
+#include "RenderResources.h"
+#include "glsl_occlusion_culling_defines.h"
+#include "GLDevice.h"
+#include "GLBuffer.h"
+#include "GLFramebuffer.h"
+#include "GLSampler.h"
+#include "GLProgram.h"
+#include "GLTexture.h"
+#include "Scene.h"
+
+namespace yare {
+
+OcclusionCuller::OcclusionCuller(const RenderResources& render_resources)
+: _rr(render_resources)
+{
+   _copy_depth = createProgramFromFile("build_hiz.glsl", "COPY_DEPTH");
+   _reduce_hiz = createProgramFromFile("build_hiz.glsl");
+   _keep_visible_last_frame = createProgramFromFile("occlusion_culling.glsl", "LAST_FRAME_VISIBILITY");
+   _test_hiz = createProgramFromFile("occlusion_culling.glsl", "HIZ_TEST");
+   _keep_visible = createProgramFromFile("occlusion_culling.glsl");
+
+   GLTexture2DDesc desc;
+   desc.width = _rr.framebuffer_size.width;
+   desc.height = _rr.framebuffer_size.height;
+   desc.mipmapped = true;
+   desc.texture_pixels = nullptr;
+   desc.texture_pixels_in_bgr = false;
+   desc.internal_format = GL_R32F;
+   _hiz = std::make_unique<GLTexture2D>(desc);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::setSurfaceCount(int surface_count, int max_draw_count)
+{
+   std::vector<unsigned int> all_visible(std::max(surface_count, 1), 1);
+   _surface_visibility = createBuffer(sizeof(unsigned int)*all_visible.size(), 0, all_visible.data());
+   _second_phase_draw_commands = createBuffer(5 * sizeof(unsigned int)*std::max(max_draw_count, 1));
+}
+
+void OcclusionCuller::_dispatchOverMultiDraws(const GLProgram& program, const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands)
+{
+   GLDevice::bindProgram(program);
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_DRAW_COMMANDS_SSBO, draw_commands.id(), draw_commands.getRenderSegmentOffset(), draw_commands.segmentSize());
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BI_SURFACE_VISIBILITY_SSBO, _surface_visibility->id());
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BI_SECOND_PHASE_DRAW_COMMANDS_SSBO, _second_phase_draw_commands->id());
+
+   for (const auto& draw_batch : draw_batches)
+   {
+      if (draw_batch.multi_draw_count == 0)
+         continue;
+
+      glUniform1i(BI_FIRST_DRAW, draw_batch.first_draw);
+      glUniform1i(BI_DRAW_COUNT, draw_batch.multi_draw_count);
+      glDispatchCompute((draw_batch.multi_draw_count + OCCLUSION_CULLING_GROUP_SIZE - 1) / OCCLUSION_CULLING_GROUP_SIZE, 1, 1);
+   }
+   glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void OcclusionCuller::keepSurfacesVisibleLastFrame(const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands)
+{
+   _dispatchOverMultiDraws(*_keep_visible_last_frame, draw_batches, draw_commands);
+}
+
+void OcclusionCuller::buildHiZ()
+{
+   GLDevice::bindProgram(*_copy_depth);
+   GLDevice::bindTexture(BI_DEPTH_TEXTURE, _rr.main_framebuffer->attachedTexture(GL_DEPTH_ATTACHMENT), *_rr.samplers.nearest_clampToEdge);
+   GLDevice::bindImage(BI_HIZ_OUTPUT_IMAGE, *_hiz, GL_WRITE_ONLY, 0);
+   glDispatchCompute((_hiz->width() + HIZ_TILE_WIDTH - 1) / HIZ_TILE_WIDTH, (_hiz->height() + HIZ_TILE_WIDTH - 1) / HIZ_TILE_WIDTH, 1);
+   glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+   GLDevice::bindProgram(*_reduce_hiz);
+   for (int level = 1; level < _hiz->levelCount(); ++level)
+   {
+      int level_width = std::max(_hiz->width() >> level, 1);
+      int level_height = std::max(_hiz->height() >> level, 1);
+      GLDevice::bindImage(BI_HIZ_INPUT_IMAGE, *_hiz, GL_READ_ONLY, level - 1);
+      GLDevice::bindImage(BI_HIZ_OUTPUT_IMAGE, *_hiz, GL_WRITE_ONLY, level);
+      glDispatchCompute((level_width + HIZ_TILE_WIDTH - 1) / HIZ_TILE_WIDTH, (level_height + HIZ_TILE_WIDTH - 1) / HIZ_TILE_WIDTH, 1);
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+   }
+   glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void OcclusionCuller::testSurfacesAgainstHiZ(const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands)
+{
+   // the levels are read with texelFetch, the sampler only has to be a mipmapped one
+   GLDevice::bindTexture(BI_HIZ_TEXTURE, *_hiz, *_rr.samplers.mipmap_clampToEdge);
+   GLDevice::bindProgram(*_test_hiz);
+   glUniform1i(BI_HIZ_LEVEL_COUNT, _hiz->levelCount());
+   _dispatchOverMultiDraws(*_test_hiz, draw_batches, draw_commands);
+}
+
+void OcclusionCuller::keepVisibleSurfaces(const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands)
+{
+   _dispatchOverMultiDraws(*_keep_visible, draw_batches, draw_commands);
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "tools.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace yare {
+
+struct RenderResources;
+struct SurfaceDrawBatch;
+class GLBuffer;
+class GLDynamicBuffer;
+class GLProgram;
+class GLTexture2D;
+
+// Two phases occlusion culling of the multi draws, on the gpu.
+// The first phase draws the surfaces visible last frame, a hi-z pyramid is built from their depth, then every surface
+// is tested against it. The second phase draws the visible surfaces the first one missed, and the later passes only
+// draw the visible ones. The visibility stays on the gpu, the single draws are never culled.
+class OcclusionCuller
+{
+public:
+   OcclusionCuller(const RenderResources& render_resources);
+   ~OcclusionCuller();
+
+   // all the surfaces start visible
+   void setSurfaceCount(int surface_count, int max_draw_count);
+
+   // the draw commands render segment and the draw surface indices must be bound
+   void keepSurfacesVisibleLastFrame(const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands);
+   void buildHiZ();
+   void testSurfacesAgainstHiZ(const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands);
+   void keepVisibleSurfaces(const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands);
+
+   // indirect commands of the second phase, laid out like the main ones
+   const GLBuffer& secondPhaseDrawCommands() const { return *_second_phase_draw_commands; }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(OcclusionCuller)
+   void _dispatchOverMultiDraws(const GLProgram& program, const std::vector<SurfaceDrawBatch>& draw_batches, const GLDynamicBuffer& draw_commands);
+
+   Uptr<GLTexture2D> _hiz;
+   Uptr<GLBuffer> _surface_visibility;
+   Uptr<GLBuffer> _second_phase_draw_commands;
+   Uptr<GLProgram> _copy_depth;
+   Uptr<GLProgram> _reduce_hiz;
+   Uptr<GLProgram> _keep_visible_last_frame;
+   Uptr<GLProgram> _test_hiz;
+   Uptr<GLProgram> _keep_visible;
+   const RenderResources& _rr;
+};
+
+}
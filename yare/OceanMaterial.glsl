@@ -1,4 +1,5 @@
 ~~~~~~~~~~~~~~~~~~~ VertexShader ~~~~~~~~~~~~~~~~~~~~~
+#extension GL_ARB_shader_draw_parameters : require
 #include "glsl_global_defines.h"
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
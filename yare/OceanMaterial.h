@@ -28,6 +28,7 @@ public:
    virtual void bindTextures() override { }
    virtual bool isTransparent() override { return false;  }
    virtual bool hasTessellation() override { return true; }
+   virtual bool supportsOctahedralDirections() override { return false; }
 
 private:
    DISALLOW_COPY_AND_ASSIGN(OceanMaterial)
@@ -0,0 +1,312 @@
+#include "Profiler.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <json/json.h>
+
+#include "stl_helpers.h"
+
+namespace yare {
+
+struct OpenZone
+{
+   const char* name;
+   double start_us;
+   GLuint start_query;
+};
+
+struct PendingGPUZone
+{
+   const char* name;
+   int depth;
+   GLuint start_query;
+   GLuint end_query;
+   std::uint64_t frame;
+};
+
+// the completed zones of one thread, or of the gpu. Only its thread writes to it, its lock is contended only by the readers.
+struct ThreadTrack
+{
+   int index;
+   std::vector<OpenZone> open_zones;
+
+   std::mutex mutex;
+   std::deque<ProfilerEvent> events;
+   std::vector<ProfilerZoneStats> zone_stats;
+   // zone name pointer to its index in zone_stats, several pointers can have the same name
+   std::unordered_map<const char*, int> zone_indices;
+};
+
+static const float cAverageWeight = 0.05f;
+
+static const auto _start = std::chrono::steady_clock::now();
+static std::atomic<std::uint64_t> _frame(0);
+static std::atomic<int> _max_event_count(1 << 16);
+
+// the tracks are never freed, the readers can still see the events of the threads that exited
+static std::mutex _tracks_mutex;
+static std::vector<Uptr<ThreadTrack>> _tracks;
+static std::vector<std::string> _track_names;
+static ThreadTrack _gpu_track = { cGPUProfilerTrack };
+
+// render thread only
+static std::vector<OpenZone> _open_gpu_zones;
+static std::deque<PendingGPUZone> _pending_gpu_zones;
+static std::vector<GLuint> _free_queries;
+static bool _gpu_clock_calibrated = false;
+static double _gpu_to_cpu_us = 0.0;
+
+static double _nowUs()
+{
+   return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _start).count();
+}
+
+static ThreadTrack& _threadTrack()
+{
+   thread_local ThreadTrack* track = nullptr;
+   if (!track)
+   {
+      std::lock_guard<std::mutex> lock(_tracks_mutex);
+      _tracks.push_back(std::make_unique<ThreadTrack>());
+      track = _tracks.back().get();
+      track->index = int(_track_names.size());
+      _track_names.push_back(string_format("thread %d", track->index));
+   }
+   return *track;
+}
+
+static int _zoneIndex(ThreadTrack& track, const ProfilerEvent& event)
+{
+   auto index_it = track.zone_indices.find(event.name);
+   if (index_it != track.zone_indices.end())
+      return index_it->second;
+
+   // first time this pointer is seen, the name can already have stats under another pointer
+   int zone_index = 0;
+   while (zone_index < int(track.zone_stats.size()) && track.zone_stats[zone_index].name != event.name)
+      zone_index++;
+   if (zone_index == int(track.zone_stats.size()))
+      track.zone_stats.push_back({ event.name, event.track, event.depth, 0.0f, float(event.duration_us / 1000.0), event.start_us });
+   track.zone_indices[event.name] = zone_index;
+   return zone_index;
+}
+
+static void _recordEvent(ThreadTrack& track, const ProfilerEvent& event)
+{
+   std::lock_guard<std::mutex> lock(track.mutex);
+   int zone_index = _zoneIndex(track, event);
+   track.events.push_back(event);
+   while (int(track.events.size()) > _max_event_count)
+      track.events.pop_front();
+
+   float duration_ms = float(event.duration_us / 1000.0);
+   ProfilerZoneStats& stats = track.zone_stats[zone_index];
+   stats.depth = event.depth;
+   stats.last_ms = duration_ms;
+   stats.average_ms += (duration_ms - stats.average_ms) * cAverageWeight;
+}
+
+void Profiler::setThreadName(const std::string& name)
+{
+   int index = _threadTrack().index;
+   std::lock_guard<std::mutex> lock(_tracks_mutex);
+   _track_names[index] = name;
+}
+
+void Profiler::beginCPUZone(const char* name)
+{
+   _threadTrack().open_zones.push_back({ name, _nowUs(), 0 });
+}
+
+void Profiler::endCPUZone()
+{
+   ThreadTrack& track = _threadTrack();
+   OpenZone zone = track.open_zones.back();
+   track.open_zones.pop_back();
+
+   ProfilerEvent event = { zone.name, zone.start_us, _nowUs() - zone.start_us, int(track.open_zones.size()), track.index, _frame };
+   _recordEvent(track, event);
+}
+
+static GLuint _takeQuery()
+{
+   if (_free_queries.empty())
+   {
+      GLuint queries[32];
+      glGenQueries(32, queries);
+      _free_queries.insert(_free_queries.end(), queries, queries + 32);
+   }
+   GLuint query = _free_queries.back();
+   _free_queries.pop_back();
+   return query;
+}
+
+void Profiler::beginGPUZone(const char* name)
+{
+   beginCPUZone(name);
+
+   GLuint query = _takeQuery();
+   glQueryCounter(query, GL_TIMESTAMP);
+   _open_gpu_zones.push_back({ name, 0.0, query });
+}
+
+void Profiler::endGPUZone()
+{
+   OpenZone zone = _open_gpu_zones.back();
+   _open_gpu_zones.pop_back();
+
+   GLuint query = _takeQuery();
+   glQueryCounter(query, GL_TIMESTAMP);
+   _pending_gpu_zones.push_back({ zone.name, int(_open_gpu_zones.size()), zone.start_query, query, _frame });
+
+   endCPUZone();
+}
+
+void Profiler::endFrame(bool flush)
+{
+   // the gpu timestamps are placed on the cpu timeline once, the clocks drift too little for a trace
+   if (!_gpu_clock_calibrated)
+   {
+      GLint64 gpu_now_ns;
+      glGetInteger64v(GL_TIMESTAMP, &gpu_now_ns);
+      _gpu_to_cpu_us = _nowUs() - double(gpu_now_ns) / 1000.0;
+      _gpu_clock_calibrated = true;
+   }
+
+   // the zones end in submission order, the first unavailable one stops the reads
+   while (!_pending_gpu_zones.empty())
+   {
+      const PendingGPUZone& zone = _pending_gpu_zones.front();
+      GLint available = GL_TRUE;
+      if (!flush)
+         glGetQueryObjectiv(zone.end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+         break;
+
+      GLuint64 start_ns, end_ns;
+      glGetQueryObjectui64v(zone.start_query, GL_QUERY_RESULT, &start_ns);
+      glGetQueryObjectui64v(zone.end_query, GL_QUERY_RESULT, &end_ns);
+
+      ProfilerEvent event = { zone.name, double(start_ns) / 1000.0 + _gpu_to_cpu_us, double(end_ns - start_ns) / 1000.0,
+                              zone.depth, cGPUProfilerTrack, zone.frame };
+      _recordEvent(_gpu_track, event);
+
+      _free_queries.push_back(zone.start_query);
+      _free_queries.push_back(zone.end_query);
+      _pending_gpu_zones.pop_front();
+   }
+
+   _frame++;
+}
+
+std::uint64_t Profiler::frameIndex()
+{
+   return _frame;
+}
+
+void Profiler::setMaxEventCount(int max_event_count)
+{
+   _max_event_count = std::max(max_event_count, 1);
+}
+
+static std::vector<ThreadTrack*> _allTracks()
+{
+   std::vector<ThreadTrack*> tracks = { &_gpu_track };
+   std::lock_guard<std::mutex> lock(_tracks_mutex);
+   for (const auto& track : _tracks)
+      tracks.push_back(track.get());
+   return tracks;
+}
+
+std::vector<ProfilerEvent> Profiler::events()
+{
+   std::vector<ProfilerEvent> all_events;
+   for (ThreadTrack* track : _allTracks())
+   {
+      std::lock_guard<std::mutex> lock(track->mutex);
+      all_events.insert(all_events.end(), track->events.begin(), track->events.end());
+   }
+   return all_events;
+}
+
+std::vector<ProfilerZoneStats> Profiler::zoneStats()
+{
+   std::vector<ProfilerZoneStats> zone_stats;
+   for (ThreadTrack* track : _allTracks())
+   {
+      std::lock_guard<std::mutex> lock(track->mutex);
+      zone_stats.insert(zone_stats.end(), track->zone_stats.begin(), track->zone_stats.end());
+   }
+
+   std::sort(zone_stats.begin(), zone_stats.end(), [](const ProfilerZoneStats& a, const ProfilerZoneStats& b)
+   {
+      return a.track != b.track ? a.track < b.track : a.first_start_us < b.first_start_us;
+   });
+   return zone_stats;
+}
+
+std::string Profiler::trackName(int track)
+{
+   if (track == cGPUProfilerTrack)
+      return "gpu";
+
+   std::lock_guard<std::mutex> lock(_tracks_mutex);
+   return _track_names[track];
+}
+
+bool Profiler::writeChromeTrace(const std::string& filename)
+{
+   std::vector<ProfilerEvent> all_events = events();
+   int track_count;
+   {
+      std::lock_guard<std::mutex> lock(_tracks_mutex);
+      track_count = int(_track_names.size());
+   }
+
+   // chrome thread ids, the gpu comes first
+   auto tid = [](int track) { return track - cGPUProfilerTrack; };
+
+   Json::Value root;
+   root["displayTimeUnit"] = "ms";
+   Json::Value& trace_events = root["traceEvents"];
+   for (int track = cGPUProfilerTrack; track < track_count; ++track)
+   {
+      Json::Value metadata;
+      metadata["name"] = "thread_name";
+      metadata["ph"] = "M";
+      metadata["pid"] = 0;
+      metadata["tid"] = tid(track);
+      metadata["args"]["name"] = trackName(track);
+      trace_events.append(metadata);
+   }
+
+   for (const auto& event : all_events)
+   {
+      Json::Value trace_event;
+      trace_event["name"] = event.name;
+      trace_event["cat"] = event.track == cGPUProfilerTrack ? "gpu" : "cpu";
+      trace_event["ph"] = "X";
+      trace_event["ts"] = event.start_us;
+      trace_event["dur"] = event.duration_us;
+      trace_event["pid"] = 0;
+      trace_event["tid"] = tid(event.track);
+      trace_event["args"]["frame"] = Json::UInt64(event.frame);
+      trace_events.append(trace_event);
+   }
+
+   std::ofstream file(filename);
+   Json::StreamWriterBuilder builder;
+   builder["indentation"] = "";
+   std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+   writer->write(root, &file);
+   return bool(file);
+}
+
+}
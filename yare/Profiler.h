@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tools.h"
+
+namespace yare {
+
+const int cGPUProfilerTrack = -1;
+
+// a completed zone, the times are from the start of the profiler
+struct ProfilerEvent
+{
+   const char* name;
+   double start_us;
+   double duration_us;
+   int depth;
+   int track; // track of the thread that ran the zone, or cGPUProfilerTrack
+   std::uint64_t frame; // render frame the zone started in
+};
+
+struct ProfilerZoneStats
+{
+   std::string name;
+   int track;
+   int depth;
+   float last_ms;
+   float average_ms;
+   double first_start_us;
+};
+
+// Nested named zones, timed on the cpu of any thread or with timestamp queries on the gpu of the render thread.
+// The gpu results are read frames later, once available, so that the render never waits for them.
+// Each thread keeps its last completed zones for the chrome about:tracing export and its per zone stats for the hud,
+// recording a zone only takes the uncontended lock of its thread.
+// The names are not copied, they must stay valid as long as the results are used.
+class Profiler
+{
+public:
+   static void setThreadName(const std::string& name);
+   static void beginCPUZone(const char* name);
+   static void endCPUZone();
+   // render thread, also times the cpu side of the zone
+   static void beginGPUZone(const char* name);
+   static void endGPUZone();
+   // render thread, after the frame was submitted, flushing waits for all the gpu results
+   static void endFrame(bool flush = false);
+   static std::uint64_t frameIndex();
+
+   // per thread, and for the gpu
+   static void setMaxEventCount(int max_event_count);
+   static std::vector<ProfilerEvent> events();
+   // sorted by track, then by start
+   static std::vector<ProfilerZoneStats> zoneStats();
+   static std::string trackName(int track);
+   static bool writeChromeTrace(const std::string& filename);
+};
+
+class CPUProfileZone
+{
+public:
+   explicit CPUProfileZone(const char* name) { Profiler::beginCPUZone(name); }
+   ~CPUProfileZone() { Profiler::endCPUZone(); }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(CPUProfileZone)
+};
+
+class GPUProfileZone
+{
+public:
+   explicit GPUProfileZone(const char* name) { Profiler::beginGPUZone(name); }
+   ~GPUProfileZone() { Profiler::endGPUZone(); }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(GPUProfileZone)
+};
+
+}
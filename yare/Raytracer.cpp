@@ -57,13 +57,13 @@ static matrix _convertMatrix(const mat4x3 mat)
                        0.0,       0.0,       0.0,       1.0);
 }
 
-static void _fillFaceNormals(const mat3& matrix_normal_world_local, vec3* vertices, vec4* mapped_face_normals, int normals_offset, int face_count)
+static void _fillFaceNormals(const mat3& matrix_normal_world_local, vec3* vertices, const int* indices, vec4* mapped_face_normals, int normals_offset, int face_count)
 {
    #pragma omp parallel for
    for (int i = 0; i < face_count; ++i)
    {
-      vec3 side1 = vertices[3*i + 1] - vertices[3*i];
-      vec3 side2 = vertices[3*i + 2] - vertices[3*i];
+      vec3 side1 = vertices[indices[3*i + 1]] - vertices[indices[3*i]];
+      vec3 side2 = vertices[indices[3*i + 2]] - vertices[indices[3*i]];
       mapped_face_normals[normals_offset + i].xyz = matrix_normal_world_local * normalize(cross(side1, side2));
    }
 }
@@ -79,10 +79,6 @@ void Raytracer::init(const Scene& scene)
    }
       
    std::vector<int> indices(max_triangles_for_one_mesh*3);
-   for (int i = 0; i < max_triangles_for_one_mesh * 3; ++i)
-   {
-      indices[i] = i;
-   }
 
    float3* mapped_face_normals;
    _ocl_face_normal_buffer = _ocl_context.CreateBuffer<float3>(total_triangle_count, CL_MEM_READ_WRITE);
@@ -94,20 +90,32 @@ void Raytracer::init(const Scene& scene)
    {
       auto mat = scene.transform_hierarchy->nodeWorldToLocalMatrix(surface.transform_node_index);
 
-      float* vertices = (float*)surface.mesh->mapVertices(MeshFieldName::Position);
-      _fillFaceNormals(normalMatrix(mat), (vec3*)vertices, (vec4*)mapped_face_normals, normals_offset, surface.mesh->triangleCount());
+      int triangle_count = surface.mesh->triangleCount();
+      const void* mesh_indices = surface.mesh->mapTrianglesIndices();
+      for (int i = 0; i < 3 * triangle_count; ++i)
+      {
+         if (!surface.mesh->isIndexed())
+            indices[i] = i;
+         else if (surface.mesh->indexType() == GL_UNSIGNED_SHORT)
+            indices[i] = ((const unsigned short*)mesh_indices)[i];
+         else
+            indices[i] = ((const unsigned int*)mesh_indices)[i];
+      }
+      surface.mesh->unmapTriangleIndices();
 
+      // the positions may be quantised in the vertex buffer
       int vertex_count = surface.mesh->vertexCount();
+      std::vector<vec3> vertices(vertex_count);
+      surface.mesh->copyPackedPositions(vertices.data());
+      _fillFaceNormals(normalMatrix(mat), vertices.data(), indices.data(), (vec4*)mapped_face_normals, normals_offset, triangle_count);
 
-      Shape* shape = _api->CreateMesh(vertices, vertex_count, 3 * sizeof(float), indices.data(), 0, nullptr, vertex_count / 3);
+      Shape* shape = _api->CreateMesh((float*)vertices.data(), vertex_count, 3 * sizeof(float), indices.data(), 0, nullptr, triangle_count);
       shape->SetId(normals_offset);
       matrix radeon_mat = _convertMatrix(mat);
       shape->SetTransform((radeon_mat), inverse(radeon_mat));
       _api->AttachShape(shape);
 
-      surface.mesh->unmapVertices();
-
-      normals_offset += vertex_count / 3;
+      normals_offset += triangle_count;
    }
 
    _ocl_context.UnmapBuffer(0, _ocl_face_normal_buffer, mapped_face_normals).Wait();
@@ -0,0 +1,61 @@
+#include "RenderDataMailbox.h"
+
+#include <assert.h>
+
+#include "GLBuffer.h"
+#include "Scene.h"
+
+namespace yare {
+
+static const int cFreshBit = 0x100;
+static const int cSlotMask = 0xff;
+
+RenderDataMailbox::RenderDataMailbox()
+   : _published_slot(1)
+   , _write_slot(0)
+   , _published_count(0)
+   , _dropped_count(0)
+   , _read_slot(2)
+{
+   assert(GLDynamicBuffer::segmentCount() >= 4);
+   for (int slot = 3; slot < GLDynamicBuffer::segmentCount(); ++slot)
+      _retired_slots.push_back(slot);
+   GLDynamicBuffer::setUpdateSegment(_write_slot);
+   GLDynamicBuffer::setRenderSegment(_read_slot);
+}
+
+void RenderDataMailbox::publish()
+{
+   // the previous published slot was either never read, or handed back by consume() once the gpu was done with it
+   int previous = _published_slot.exchange(_write_slot | cFreshBit, std::memory_order_acq_rel);
+   if (previous & cFreshBit)
+      _dropped_count++;
+   _published_count++;
+
+   _write_slot = previous & cSlotMask;
+   GLDynamicBuffer::setUpdateSegment(_write_slot);
+}
+
+bool RenderDataMailbox::consume()
+{
+   // only consume() clears the bit, the slot can change until the exchange but it stays fresh
+   if (!(_published_slot.load(std::memory_order_acquire) & cFreshBit))
+      return false;
+
+   // the oldest retired slot goes back to the update, which may write it as soon as its next publish.
+   // While the gpu still reads it the fresh snapshot waits for the next frame, the same one is rendered again.
+   int released_slot = _retired_slots.front();
+   if (!GLDynamicBuffer::isSegmentReleased(released_slot))
+      return false;
+   _retired_slots.pop_front();
+   int published = _published_slot.exchange(released_slot, std::memory_order_acq_rel);
+
+   // the commands already submitted are the last ones to read the current slot
+   GLDynamicBuffer::fenceSegment(_read_slot);
+   _retired_slots.push_back(_read_slot);
+   _read_slot = published & cSlotMask;
+   GLDynamicBuffer::setRenderSegment(_read_slot);
+   return true;
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+#include "tools.h"
+
+namespace yare {
+
+// Lock-free handoff of the RenderData snapshots from the update thread to the render thread.
+// Each slot is a Scene::render_data entry and the dynamic buffers segment of the same index. At any time a slot is either
+// written by the update, published, read by the render, or retired: its last frames may still be executing on the gpu.
+// The slots beyond the first three are retired in a fifo, so that many frames can be in flight.
+// The update never waits for the render, a snapshot published before the previous one was consumed replaces it.
+// The render never waits for the gpu, a snapshot is consumed once the oldest retired slot was released.
+class RenderDataMailbox
+{
+public:
+   // one slot per dynamic buffers segment, at least 4
+   RenderDataMailbox();
+
+   // update thread
+   int writeSlot() const { return _write_slot; }
+   // the write slot becomes the latest snapshot, the update continues in another slot
+   void publish();
+
+   // render thread
+   int readSlot() const { return _read_slot; }
+   // moves to the latest snapshot if a new one was published and the gpu released the oldest retired slot,
+   // returns false when the read slot did not change
+   bool consume();
+
+   std::uint64_t publishedCount() const { return _published_count; }
+   // snapshots replaced before the render consumed them
+   std::uint64_t droppedCount() const { return _dropped_count; }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(RenderDataMailbox)
+
+   // slot index with a bit telling whether the render has not consumed it yet
+   std::atomic<int> _published_slot;
+
+   int _write_slot;
+   std::atomic<std::uint64_t> _published_count;
+   std::atomic<std::uint64_t> _dropped_count;
+
+   int _read_slot;
+   std::deque<int> _retired_slots; // oldest first
+};
+
+}
@@ -22,7 +22,7 @@
 #include "BackgroundSky.h"
 #include "GLFramebuffer.h"
 #include "FilmPostProcessor.h"
-#include "GLGPUTimer.h"
+#include "Profiler.h"
 #include "Skeleton.h"
 #include "matrix_math.h"
 #include "GLFormats.h"
@@ -33,16 +33,32 @@
 #include "ClusteredLightCuller.h"
 #include "VolumetricFog.h"
 #include "Voxelizer.h"
+#include "simd.h"
+#include "RenderQueue.h"
+#include "OcclusionCuller.h"
+#include "TaskGraph.h"
 
 namespace yare {
 
 using namespace glm;
 
+// one per surface in the surface uniforms ssbo, std430 array stride
 struct SurfaceUniforms
 {
    mat4 matrix_proj_local;
    mat4 normal_matrix_world_local;
    mat4 matrix_world_local;
+   vec4 world_bounds_center; // w is 0 when the surface is never culled
+   vec4 world_bounds_extent;
+};
+
+struct DrawElementsIndirectCommand
+{
+   GLuint count;
+   GLuint instance_count;
+   GLuint first_index;
+   GLint base_vertex;
+   GLuint base_instance;
 };
 
 struct SceneUniforms
@@ -115,79 +131,142 @@ RenderEngine::RenderEngine(const ImageSize& framebuffer_size)
    , froxeled_light_culler(new ClusteredLightCuller(*render_resources, _settings))
    , volumetric_fog(new VolumetricFog(*render_resources, _settings))
    , voxelizer(new Voxelizer(*render_resources, _settings))
+   , occlusion_culler(new OcclusionCuller(*render_resources))
+   , update_graph(new TaskGraph())
+   , _render_queue(new RenderQueue())
 {    
    _z_pass_render_program = createProgramFromFile("z_pass_render.glsl");
+   _surface_world_bounds = nullptr;
+   _surface_world_bounds_stride = 0;
+   _simd_instruction_set = detectSimdInstructionSet();
+   _scene.render_data.resize(GLDynamicBuffer::segmentCount());
+   _update_render_data = nullptr;
+   _update_time = 0.0f;
+   _update_delta_time = 0.0f;
 }
 
 RenderEngine::~RenderEngine()
 {   
+   _aligned_free(_surface_world_bounds);
 }
 
 void RenderEngine::offlinePrepareScene()
 {
    bindAnimationCurvesToTargets(_scene, *_scene.animation_player);
    
-   _sortSurfacesByMaterial();   
-   
-   int uniform_buffer_align_size;
-   glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_align_size);
-   _surface_uniforms_size = GLFormats::alignSize(sizeof(SurfaceUniforms), uniform_buffer_align_size);
+   _partitionSurfacesByOpacity();   
+   _render_queue->setSurfaces(_scene.surfaces);
       
    int surface_count = int(_scene.surfaces.size());
-   _surface_uniforms = createDynamicBuffer(_surface_uniforms_size * surface_count);
+   _all_surface_indices.resize(surface_count);
+   for (int i = 0; i < surface_count; ++i)
+      _all_surface_indices[i] = i;
+   _surface_uniforms = createDynamicBuffer(sizeof(SurfaceUniforms) * surface_count);
+   // every surface is drawn at most once by the voxelizer, the z pass and the material passes
+   int max_draw_count = std::max(3 * surface_count, 1);
+   _draw_surface_indices = createDynamicBuffer(sizeof(int) * max_draw_count);
+   _draw_commands = createDynamicBuffer(sizeof(DrawElementsIndirectCommand) * max_draw_count);
+   occlusion_culler->setSurfaceCount(surface_count, max_draw_count);
    _scene_uniforms = createDynamicBuffer(sizeof(SceneUniforms));
    _computeLightsRadius();
    _createSceneLightsBuffer();
+   froxeled_light_culler->updateGridConfiguration(_scene);
    
-   _scene.render_data[0].main_view_surface_data.resize(_scene.surfaces.size());
-   _scene.render_data[1].main_view_surface_data.resize(_scene.surfaces.size());
+   for (auto& render_data : _scene.render_data)
+   {
+      render_data.main_view_surface_data.resize(_scene.surfaces.size());
+      render_data.surface_visibility.resize(_scene.surfaces.size());
+   }
+
+   // padded so that the last simd load of an array stays inside it, and 64 bytes aligned for the avx512 loads
+   const int max_simd_width = 16;
+   _surface_world_bounds_stride = (surface_count + max_simd_width - 1) / max_simd_width * max_simd_width;
+   _aligned_free(_surface_world_bounds);
+   _surface_world_bounds = (float*)_aligned_malloc(sizeof(float) * 6 * std::max(_surface_world_bounds_stride, max_simd_width), 64);
+   memset(_surface_world_bounds, 0, sizeof(float) * 6 * std::max(_surface_world_bounds_stride, max_simd_width));
 
    for (int i = 0; i < _scene.surfaces.size(); ++i)
    {
       auto& surface = _scene.surfaces[i];
       surface.vertex_source_for_material = createVertexSource(*surface.mesh, surface.material->requiredMeshFields(_scene.surfaces[i].material_variant), surface.material->hasTessellation());
-      surface.vertex_source_position_normal = createVertexSource(*surface.mesh, int(MeshFieldName::Position)| int(MeshFieldName::Normal), surface.material->hasTessellation());// TODO rename
+      surface.vertex_source_position = createPositionVertexSource(*surface.mesh, surface.material->hasTessellation());
    }
+   _createBatchedMeshes();
 
    _scene.transform_hierarchy->updateNodesWorldToLocalMatrix();
+   _createUpdateGraph();
+}
 
-   
+void RenderEngine::_createUpdateGraph()
+{
+   TaskGraph& graph = *update_graph;
+   int animation = graph.addNode("animation", [this]() { _scene.animation_player->evaluateAndApplyToTargets(24.0f*_update_time); });
+   int transforms = graph.addNode("transforms", [this]() { _scene.transform_hierarchy->updateNodesWorldToLocalMatrix(); });
+   graph.addDependency(transforms, animation);
+   for (const auto& skeleton : _scene.skeletons)
+   {
+      Skeleton* updated_skeleton = skeleton.get();
+      int skeleton_node = graph.addNode("skeleton " + skeleton->name, [updated_skeleton]() { updated_skeleton->update(); });
+      graph.addDependency(skeleton_node, animation);
+   }
+
+   int camera = graph.addNode("camera matrices", [this]() { _updateCameraMatrices(*_update_render_data); });
+   int world_matrices = graph.addNode("surface world matrices", [this]() { _updateSurfaceWorldMatrices(*_update_render_data); });
+   graph.addDependency(world_matrices, transforms);
+   int culling = graph.addNode("surface culling", [this]() { _cullSurfaces(*_update_render_data); });
+   graph.addDependency(culling, camera);
+   graph.addDependency(culling, world_matrices);
+   int projection_matrices = graph.addNode("surface projection matrices", [this]() { _updateSurfaceProjectionMatrices(*_update_render_data); });
+   graph.addDependency(projection_matrices, culling);
+
+   int queue = graph.addNode("render queue", [this]() { _queueSurfaces(*_update_render_data); });
+   graph.addDependency(queue, projection_matrices);
+   int draw_batches = graph.addNode("draw batches", [this]() { _buildDrawBatches(*_update_render_data); });
+   graph.addDependency(draw_batches, queue);
+   int draw_buffers = graph.addNode("draw buffers", [this]() { _updateDrawBuffers(*_update_render_data); });
+   graph.addDependency(draw_buffers, draw_batches);
+   int uniforms = graph.addNode("uniforms", [this]() { _updateUniformBuffers(*_update_render_data, _update_time, _update_delta_time); });
+   graph.addDependency(uniforms, projection_matrices);
+
+   // the lights are not animated
+   int light_culling = graph.addNode("light culling", [this]()
+   {
+      // the main view is the only one culled for now, other views are appended here and counted in updateGridConfiguration
+      RenderData* light_culling_views[] = { _update_render_data };
+      froxeled_light_culler->buildLightLists(_scene, light_culling_views, 1);
+   });
+   graph.addDependency(light_culling, camera);
 }
 
 void RenderEngine::updateScene(RenderData& render_data)
 {
+   CPUProfileZone profile_zone("update scene");
    static float last_update_time = 0.0f;
    static auto start = std::chrono::steady_clock::now();
    auto now = std::chrono::steady_clock::now();
    float time_lapse = std::chrono::duration<float>(now - start).count();
       
-   _scene.animation_player->evaluateAndApplyToTargets(24.0f*time_lapse);
-   _scene.transform_hierarchy->updateNodesWorldToLocalMatrix();
-   for (const auto& skeleton : _scene.skeletons)
-      skeleton->update();
-
-   _updateRenderMatrices(render_data);
-   _sortSurfacesByDistanceToCamera(render_data);
-   _updateUniformBuffers(render_data, time_lapse, time_lapse - last_update_time);
-   
-   froxeled_light_culler->buildLightLists(_scene, render_data);
+   _update_render_data = &render_data;
+   _update_time = time_lapse;
+   _update_delta_time = time_lapse - last_update_time;
+   update_graph->execute();
 
    last_update_time = time_lapse;
 }
 
 void RenderEngine::renderScene(const RenderData& render_data)
 {   
+   GPUProfileZone profile_zone("render scene");
    GLDevice::bindDefaultDepthStencilState();   
    GLDevice::bindDefaultColorBlendState();
    GLDevice::bindDefaultRasterizationState();
    glPatchParameteri(GL_PATCH_VERTICES, 3);
    
-   froxeled_light_culler->updateLightListHeadTexture();
+   froxeled_light_culler->updateLightListHeadTexture(render_data);
 
    _renderSurfaces(render_data);
    film_processor->developFilm();
         
-   GLGPUTimer::swapCounters();
 }
 
 void RenderEngine::presentDebugTexture()
@@ -199,16 +278,11 @@ void RenderEngine::presentDebugTexture()
    GLDevice::draw(*render_resources->fullscreen_triangle_source);
 }
 
+// draws all the surfaces, including the ones out of the view frustum
 void RenderEngine::drawSurfaces(const RenderData& render_data)
 {
-   for (auto& sorted_surface : render_data.surfaces_sorted_by_distance)
-   {
-      int surface_index = sorted_surface.surface_index;
-      const auto& surface = _scene.surfaces[surface_index];
-      _bindSurfaceUniforms(surface_index, surface);
-
-      GLDevice::draw(*surface.vertex_source_position_normal);
-   }
+   for (const auto& draw_batch : render_data.all_surfaces_draw_batches)
+      _drawSurfaceBatch(render_data, draw_batch, false);
 }
 
 static void _debugDrawBasis(const mat4x3& mat)
@@ -260,7 +334,17 @@ void RenderEngine::_bindSceneUniforms()
    volumetric_fog->bindFogVolume();
 }
 
-void RenderEngine::_bindSurfaceUniforms(int suface_index, const SurfaceInstance& surface)
+void RenderEngine::_bindSurfaceDrawBuffers()
+{
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_SURFACE_DYNAMIC_UNIFORMS_SSBO, _surface_uniforms->id(),
+                     _surface_uniforms->getRenderSegmentOffset(), _surface_uniforms->segmentSize());
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BI_DRAW_SURFACE_INDICES_SSBO, _draw_surface_indices->id(),
+                     _draw_surface_indices->getRenderSegmentOffset(), _draw_surface_indices->segmentSize());
+   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _draw_commands->id());
+}
+
+// uniforms of a surface drawn on its own, the shaders find its index at draw_index in the draw surface indices
+void RenderEngine::_bindSurfaceUniforms(int draw_index, const SurfaceInstance& surface)
 {
    if (surface.skeleton)
    {
@@ -269,10 +353,29 @@ void RenderEngine::_bindSurfaceUniforms(int suface_index, const SurfaceInstance&
                         skinning_ssbo.getRenderSegmentOffset(), skinning_ssbo.segmentSize());
    }
 
-   glBindBufferRange(GL_UNIFORM_BUFFER, BI_SURFACE_DYNAMIC_UNIFORMS,
-                     _surface_uniforms->id(),
-                     _surface_uniforms->getRenderSegmentOffset() + _surface_uniforms_size*suface_index,
-                     _surface_uniforms_size);
+   glUniform1i(BI_SURFACE_DRAW_BASE, draw_index);
+}
+
+// the program is already bound
+void RenderEngine::_drawSurfaceBatch(const RenderData& render_data, const SurfaceDrawBatch& draw_batch, bool material_vertex_source)
+{
+   if (draw_batch.multi_draw_count > 0)
+   {
+      // the multi draws of a batch come from the same batched meshes and, sharing a program, need the same mesh fields
+      const auto& first_surface = _scene.surfaces[render_data.draw_surface_indices[draw_batch.first_draw]];
+      const auto& vertex_source = material_vertex_source ? *first_surface.batched_vertex_source_for_material : *first_surface.batched_vertex_source_position;
+      glUniform1i(BI_SURFACE_DRAW_BASE, draw_batch.first_draw);
+      GLDevice::multiDrawIndirect(vertex_source, _draw_commands->getRenderSegmentOffset() + sizeof(DrawElementsIndirectCommand)*draw_batch.first_draw,
+                                  draw_batch.multi_draw_count);
+   }
+
+   int first_single_draw = draw_batch.first_draw + draw_batch.multi_draw_count;
+   for (int draw_index = first_single_draw; draw_index < first_single_draw + draw_batch.single_draw_count; ++draw_index)
+   {
+      const auto& surface = _scene.surfaces[render_data.draw_surface_indices[draw_index]];
+      _bindSurfaceUniforms(draw_index, surface);
+      GLDevice::draw(material_vertex_source ? *surface.vertex_source_for_material : *surface.vertex_source_position);
+   }
 }
 
 void RenderEngine::_renderSurfaces(const RenderData& render_data)
@@ -280,6 +383,7 @@ void RenderEngine::_renderSurfaces(const RenderData& render_data)
    
    
    _bindSceneUniforms();   
+   _bindSurfaceDrawBuffers();
    voxelizer->bakeVoxels(this, render_data);
 
    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -287,21 +391,40 @@ void RenderEngine::_renderSurfaces(const RenderData& render_data)
    volumetric_fog->render(render_data);
 
    // Z Pass   
-   render_resources->z_pass_timer->start();
+   Profiler::beginGPUZone("z pass");
    GLDevice::bindFramebuffer(render_resources->main_framebuffer.get(), 1);
    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
    glClear(GL_DEPTH_BUFFER_BIT);
+   if (_settings.occlusion_culling)
+      occlusion_culler->keepSurfacesVisibleLastFrame(render_data.z_pass_draw_batches, *_draw_commands);
    GLDevice::bindProgram(*_z_pass_render_program);
-   for (auto& sorted_surface : render_data.surfaces_sorted_by_distance)
+   for (const auto& draw_batch : render_data.z_pass_draw_batches)
+      _drawSurfaceBatch(render_data, draw_batch, false); // TODO dont render for ocean and animated geometry
+
+   if (_settings.occlusion_culling)
    {
-      int surface_index = sorted_surface.surface_index;
-      const auto& surface = _scene.surfaces[surface_index];
-      _bindSurfaceUniforms(surface_index, surface);
-      
-      GLDevice::draw(*surface.vertex_source_position_normal); // TODO dont render for ocean and animated geometry
+      GPUProfileZone occlusion_zone("occlusion culling");
+      occlusion_culler->buildHiZ();
+      occlusion_culler->testSurfacesAgainstHiZ(render_data.z_pass_draw_batches, *_draw_commands);
+      occlusion_culler->keepVisibleSurfaces(render_data.opaque_draw_batches, *_draw_commands);
+
+      // second phase, the multi draws only
+      GLDevice::bindProgram(*_z_pass_render_program);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, occlusion_culler->secondPhaseDrawCommands().id());
+      for (const auto& draw_batch : render_data.z_pass_draw_batches)
+      {
+         if (draw_batch.multi_draw_count == 0)
+            continue;
+
+         const auto& first_surface = _scene.surfaces[render_data.draw_surface_indices[draw_batch.first_draw]];
+         glUniform1i(BI_SURFACE_DRAW_BASE, draw_batch.first_draw);
+         GLDevice::multiDrawIndirect(*first_surface.batched_vertex_source_position, sizeof(DrawElementsIndirectCommand)*draw_batch.first_draw,
+                                     draw_batch.multi_draw_count);
+      }
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _draw_commands->id());
    }
    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-   render_resources->z_pass_timer->stop();
+   Profiler::endGPUZone();
 
    // trace GI   
    voxelizer->traceGlobalIlluminationRays(render_data);
@@ -315,48 +438,43 @@ void RenderEngine::_renderSurfaces(const RenderData& render_data)
    volumetric_fog->computeMemBarrier();
 
    // Material Pass
-   render_resources->material_pass_timer->start();
+   Profiler::beginGPUZone("material pass");
    GLDevice::bindFramebuffer(render_resources->main_framebuffer.get(), 0);
    //glClear(GL_DEPTH_BUFFER_BIT);
-   _renderSurfacesMaterial(_scene.opaque_surfaces);
-   render_resources->material_pass_timer->stop();
+   _renderSurfacesMaterial(render_data, render_data.opaque_draw_batches);
+   Profiler::endGPUZone();
 
    froxeled_light_culler->drawFroxelGrid(render_data, _settings.x + _settings.y*32 + _settings.z*(32*32));
    voxelizer->debugDrawVoxels(render_data);
    
 
-   render_resources->background_timer->start();
+   Profiler::beginGPUZone("background");
    background_sky->render(render_data);
-   render_resources->background_timer->stop();
+   Profiler::endGPUZone();
 
    volumetric_fog->renderLightSprites(render_data, _scene);
 
+   Profiler::beginGPUZone("transparent pass");
    GLDevice::bindColorBlendState({ GLBlendingMode::ModulateAdd });
-   _renderSurfacesMaterial(_scene.transparent_surfaces);
+   _renderSurfacesMaterial(render_data, render_data.transparent_draw_batches);
    GLDevice::bindDefaultColorBlendState();
+   Profiler::endGPUZone();
 
    
 }
 
-void RenderEngine::_renderSurfacesMaterial(SurfaceRange surfaces)
+// a batch per program, the material of its first surface binds the textures
+void RenderEngine::_renderSurfacesMaterial(const RenderData& render_data, const std::vector<SurfaceDrawBatch>& draw_batches)
 {
-   int surface_index = int(std::distance(surfaces.begin(), _scene.surfaces.begin()));
-   const GLProgram* current_program = nullptr;
-
-   for (const auto& surface : surfaces)
+   for (const auto& draw_batch : draw_batches)
    {
-      _bindSurfaceUniforms(surface_index++, surface);
+      const auto& surface = _scene.surfaces[render_data.draw_surface_indices[draw_batch.first_draw]];
+      GLDevice::bindProgram(*surface.material_program);
+      glUniform1f(42, _settings.bias);         
+      GLDevice::bindUniformMatrix4(43, froxeled_light_culler->_debug_render_data.matrix_proj_world);
+      surface.material->bindTextures();
 
-      if (surface.material_program != current_program)
-      {
-         GLDevice::bindProgram(*surface.material_program);
-         glUniform1f(42, _settings.bias);         
-         GLDevice::bindUniformMatrix4(43, froxeled_light_culler->_debug_render_data.matrix_proj_world);
-         surface.material->bindTextures();
-         current_program = surface.material_program;
-      }      
-
-      GLDevice::draw(*surface.vertex_source_for_material);
+      _drawSurfaceBatch(render_data, draw_batch, true);
    }
 }
 
@@ -373,7 +491,6 @@ void RenderEngine::_createSceneLightsBuffer()
    _sun_lights_ssbo = createBuffer(sizeof(LightSunSSBO)*sun_light_count + sizeof(vec4), GL_MAP_WRITE_BIT);
 
    char* sphere_data = (char*)_sphere_lights_ssbo->map(GL_MAP_WRITE_BIT);
-   *((ivec3*)sphere_data) = froxeled_light_culler->froxelsDimensions();
    sphere_data += sizeof(vec4);
    char* spot_data = (char*)_spot_lights_ssbo->map(GL_MAP_WRITE_BIT);
    spot_data += sizeof(vec4);
@@ -437,68 +554,41 @@ void RenderEngine::_createSceneLightsBuffer()
 }
 
 
-void RenderEngine::_sortSurfacesByDistanceToCamera(RenderData& render_data)
+// the visible surfaces go in the render queue, the opaque ones in the z pass too
+void RenderEngine::_queueSurfaces(const RenderData& render_data)
 {
    int surface_count = int(render_data.main_view_surface_data.size());
-   auto& surfaces_sorted_by_distance = render_data.surfaces_sorted_by_distance;   
-   render_data.surfaces_sorted_by_distance.resize(surface_count);
+   int opaque_count = int(std::distance(_scene.opaque_surfaces.begin(), _scene.opaque_surfaces.end()));
+   float znear = _scene.camera.frustum.near;
+   float zfar = _scene.camera.frustum.far;
+   _render_queue->clear();
 
    for (int i = 0; i < surface_count; ++i)
    {      
+      if (!render_data.surface_visibility[i])
+         continue;
+
       float distance_to_camera = (render_data.main_view_surface_data[i].matrix_proj_local * vec4(_scene.surfaces[i].center_in_local_space, 1.0)).w;
-      surfaces_sorted_by_distance[i] = SurfaceDistanceSortItem{ i, distance_to_camera };
+      float depth = (distance_to_camera - znear) / (zfar - znear);
+      if (i < opaque_count)
+      {
+         _render_queue->add(RenderPass::ZPass, i, depth);
+         _render_queue->add(RenderPass::Opaque, i, depth);
+      }
+      else
+         _render_queue->add(RenderPass::Transparent, i, depth);
    }
 
-   auto sort_by_distance = [](SurfaceDistanceSortItem& a, SurfaceDistanceSortItem& b)
-   {
-      return a.distance < b.distance;
-   };
-   std::sort(RANGE(surfaces_sorted_by_distance), sort_by_distance);
+   _render_queue->sort();
 }
 
-struct SurfaceMaterialSortItem
-{
-   int surface_instance_index;
-   GLuint program_id;
-   bool is_transparent;
-};
-
-void RenderEngine::_sortSurfacesByMaterial()
+// the draw order is the render queue one, the surfaces are only split between opaque and transparent
+void RenderEngine::_partitionSurfacesByOpacity()
 {
    auto& surfaces = _scene.surfaces;
-   std::vector<SurfaceMaterialSortItem> temp_surface_list;
-   for (int i = 0; i < int(surfaces.size()); ++i)
-   {
-      const auto& surface = surfaces[i];
-      SurfaceMaterialSortItem item;
-      item.surface_instance_index = i;
-      item.program_id = surface.material_program->id();
-      item.is_transparent = surface.material->isTransparent();
-
-      temp_surface_list.push_back(item);
-      
-   }
-
-   auto sort_by_material = [](SurfaceMaterialSortItem& a, SurfaceMaterialSortItem& b)
-   {
-      if (a.is_transparent != b.is_transparent)
-         return b.is_transparent;
-
-      return a.program_id < b.program_id;
-   };
-   std::sort(RANGE(temp_surface_list), sort_by_material);
-
-   std::vector<SurfaceInstance> sorted_surfaces;
-   for (const auto& item : temp_surface_list)
+   auto first_transparent_surface_it = std::stable_partition(RANGE(surfaces), [](SurfaceInstance& surface)
    {
-      sorted_surfaces.push_back(surfaces[item.surface_instance_index]);
-   }
-         
-   surfaces = std::move(sorted_surfaces);
-
-   auto first_transparent_surface_it = std::find_if(RANGE(surfaces), [](SurfaceInstance& surface)
-   {
-      return surface.material->isTransparent();
+      return !surface.material->isTransparent();
    });
    _scene.opaque_surfaces = SurfaceRange(surfaces.begin(), first_transparent_surface_it);
    _scene.transparent_surfaces = SurfaceRange(first_transparent_surface_it, surfaces.end());
@@ -506,13 +596,25 @@ void RenderEngine::_sortSurfacesByMaterial()
 
 void RenderEngine::_updateUniformBuffers(const RenderData& render_data, float time, float delta_time)
 {
-   char* buffer = (char*)_surface_uniforms->getUpdateSegmentPtr(); // hopefully OpenGL will be done using that range at that time (I could use a fence to enforce it but meh I don't care)
+   char* buffer = (char*)_surface_uniforms->getUpdateSegmentPtr(); // RenderDataMailbox::consume handed it back once the gpu released it
+   const float* bounds = _surface_world_bounds;
+   int stride = _surface_world_bounds_stride;
    for (int i = 0; i < render_data.main_view_surface_data.size(); ++i)
    {
-      ((SurfaceUniforms*)buffer)->matrix_proj_local = render_data.main_view_surface_data[i].matrix_proj_local;
-      ((SurfaceUniforms*)buffer)->normal_matrix_world_local = render_data.main_view_surface_data[i].normal_matrix_world_local;
-      ((SurfaceUniforms*)buffer)->matrix_world_local = render_data.main_view_surface_data[i].matrix_world_local;
-      buffer += _surface_uniforms_size;
+      // the position decoding of the quantised meshes is folded into the local matrices, not into the normal one
+      const mat4& matrix_local_decoded = _scene.surfaces[i].mesh->positionDecodeMatrix();
+      // the voxelizer draws all the surfaces with matrix_world_local, the main view only the visible ones
+      ((SurfaceUniforms*)buffer)->matrix_world_local = render_data.main_view_surface_data[i].matrix_world_local * matrix_local_decoded;
+      // for the occlusion test, computed by the frustum culling
+      float cullable = _scene.surfaces[i].bounds_in_local_space.isNull() ? 0.0f : 1.0f;
+      ((SurfaceUniforms*)buffer)->world_bounds_center = vec4(bounds[i], bounds[stride + i], bounds[2 * stride + i], cullable);
+      ((SurfaceUniforms*)buffer)->world_bounds_extent = vec4(bounds[3 * stride + i], bounds[4 * stride + i], bounds[5 * stride + i], 0.0f);
+      if (render_data.surface_visibility[i])
+      {
+         ((SurfaceUniforms*)buffer)->matrix_proj_local = render_data.main_view_surface_data[i].matrix_proj_local * matrix_local_decoded;
+         ((SurfaceUniforms*)buffer)->normal_matrix_world_local = render_data.main_view_surface_data[i].normal_matrix_world_local;
+      }
+      buffer += sizeof(SurfaceUniforms);
    }
 
    SceneUniforms* scene_uniforms = (SceneUniforms*)_scene_uniforms->getUpdateSegmentPtr();
@@ -543,6 +645,138 @@ void RenderEngine::_updateUniformBuffers(const RenderData& render_data, float ti
    scene_uniforms->viewport = ivec4(0, 0, render_resources->main_framebuffer->width(), render_resources->main_framebuffer->height());
 }
 
+void RenderEngine::_buildDrawBatches(RenderData& render_data)
+{
+   render_data.draw_surface_indices.clear();
+   _appendDrawBatches(render_data, _all_surface_indices, false, &render_data.all_surfaces_draw_batches);
+   _appendDrawBatches(render_data, _render_queue->passSurfaces(RenderPass::ZPass), false, &render_data.z_pass_draw_batches);
+   _appendDrawBatches(render_data, _render_queue->passSurfaces(RenderPass::Opaque), true, &render_data.opaque_draw_batches);
+   _appendDrawBatches(render_data, _render_queue->passSurfaces(RenderPass::Transparent), true, &render_data.transparent_draw_batches);
+}
+
+void RenderEngine::_appendDrawBatches(RenderData& render_data, const std::vector<int>& surface_indices, bool batch_per_program, std::vector<SurfaceDrawBatch>* draw_batches)
+{
+   draw_batches->clear();
+   auto& draws = render_data.draw_surface_indices;
+   int count = int(surface_indices.size());
+   int first = 0;
+   while (first < count)
+   {
+      int end = first + 1;
+      const GLProgram* program = _scene.surfaces[surface_indices[first]].material_program;
+      // the multi draws of a batch read the same batched meshes
+      const GLVertexSource* batched_vertex_source = _scene.surfaces[surface_indices[first]].batched_vertex_source_position.get();
+      while (end < count)
+      {
+         const auto& surface = _scene.surfaces[surface_indices[end]];
+         if (batch_per_program && surface.material_program != program)
+            break;
+         if (surface.batched_vertex_source_position)
+         {
+            if (batched_vertex_source && surface.batched_vertex_source_position.get() != batched_vertex_source)
+               break;
+            batched_vertex_source = surface.batched_vertex_source_position.get();
+         }
+         end++;
+      }
+
+      SurfaceDrawBatch draw_batch;
+      draw_batch.first_draw = int(draws.size());
+      for (int i = first; i < end; ++i)
+      {
+         if (_scene.surfaces[surface_indices[i]].batched_first_vertex != -1)
+            draws.push_back(surface_indices[i]);
+      }
+      draw_batch.multi_draw_count = int(draws.size()) - draw_batch.first_draw;
+      for (int i = first; i < end; ++i)
+      {
+         if (_scene.surfaces[surface_indices[i]].batched_first_vertex == -1)
+            draws.push_back(surface_indices[i]);
+      }
+      draw_batch.single_draw_count = int(draws.size()) - draw_batch.first_draw - draw_batch.multi_draw_count;
+
+      draw_batches->push_back(draw_batch);
+      first = end;
+   }
+}
+
+void RenderEngine::_updateDrawBuffers(const RenderData& render_data)
+{
+   int* surface_indices = (int*)_draw_surface_indices->getUpdateSegmentPtr();
+   DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)_draw_commands->getUpdateSegmentPtr();
+   for (int draw_index = 0; draw_index < int(render_data.draw_surface_indices.size()); ++draw_index)
+   {
+      const auto& surface = _scene.surfaces[render_data.draw_surface_indices[draw_index]];
+      surface_indices[draw_index] = render_data.draw_surface_indices[draw_index];
+
+      // the commands of the single draws are never read
+      DrawElementsIndirectCommand& command = commands[draw_index];
+      command.count = surface.batched_first_vertex != -1 ? surface.mesh->indexCount() : 0;
+      command.instance_count = 1;
+      command.first_index = std::max(surface.batched_first_index, 0);
+      command.base_vertex = std::max(surface.batched_first_vertex, 0);
+      command.base_instance = 0;
+   }
+}
+
+// the meshes of the surfaces that are neither skinned nor tessellated go in shared buffers, to be drawn with multi draw indirect.
+// A batch holds the meshes of one vertex format, the meshes whose fields are encoded differently start a new batch.
+void RenderEngine::_createBatchedMeshes()
+{
+   _batched_meshes.clear();
+   std::vector<int> surface_batch(_scene.surfaces.size(), -1);
+   for (int surface_index = 0; surface_index < int(_scene.surfaces.size()); ++surface_index)
+   {
+      auto& surface = _scene.surfaces[surface_index];
+      surface.batched_first_vertex = -1;
+      surface.batched_first_index = -1;
+      if (surface.skeleton || surface.material->hasTessellation() || !surface.mesh->isIndexed())
+         continue;
+
+      int batch_index = 0;
+      for (; batch_index < int(_batched_meshes.size()); ++batch_index)
+      {
+         surface.batched_first_vertex = _batched_meshes[batch_index]->addMesh(*surface.mesh);
+         if (surface.batched_first_vertex != -1)
+            break;
+      }
+      if (batch_index == int(_batched_meshes.size()))
+      {
+         _batched_meshes.push_back(std::make_unique<BatchedMeshes>());
+         surface.batched_first_vertex = _batched_meshes.back()->addMesh(*surface.mesh);
+      }
+      surface.batched_first_index = _batched_meshes[batch_index]->meshFirstIndex(*surface.mesh);
+      surface_batch[surface_index] = batch_index;
+   }
+
+   std::vector<Sptr<GLVertexSource>> position_vertex_sources;
+   for (auto& batched_meshes : _batched_meshes)
+   {
+      batched_meshes->commitToGPU();
+      position_vertex_sources.push_back(createPositionVertexSource(*batched_meshes));
+   }
+
+   std::map<std::pair<int, FieldsMask>, Sptr<GLVertexSource>> vertex_sources;
+   auto batched_vertex_source = [&](int batch_index, FieldsMask fields) -> Sptr<GLVertexSource>
+   {
+      auto& vertex_source = vertex_sources[std::make_pair(batch_index, fields)];
+      if (!vertex_source)
+         vertex_source = createVertexSource(*_batched_meshes[batch_index], fields);
+      return vertex_source;
+   };
+
+   for (int surface_index = 0; surface_index < int(_scene.surfaces.size()); ++surface_index)
+   {
+      auto& surface = _scene.surfaces[surface_index];
+      int batch_index = surface_batch[surface_index];
+      if (batch_index == -1)
+         continue;
+
+      surface.batched_vertex_source_for_material = batched_vertex_source(batch_index, surface.material->requiredMeshFields(surface.material_variant));
+      surface.batched_vertex_source_position = position_vertex_sources[batch_index];
+   }
+}
+
 static Frustum _frustum(float fovy, float aspect, float znear, float zfar)
 {
    Frustum result;
@@ -556,7 +790,7 @@ static Frustum _frustum(float fovy, float aspect, float znear, float zfar)
    return result;
 }
 
-void RenderEngine::_updateRenderMatrices(RenderData& render_data)
+void RenderEngine::_updateCameraMatrices(RenderData& render_data)
 {
    _scene.camera.frustum = _frustum(3.14f / 2.0f, render_resources->framebuffer_size.ratio(), 0.05f, 20.0f);
    render_data.frustum = _scene.camera.frustum;
@@ -569,16 +803,108 @@ void RenderEngine::_updateRenderMatrices(RenderData& render_data)
    render_data.matrix_view_world = matrix_view_world;
    render_data.matrix_view_proj = inverse(matrix_projection);
    render_data.matrix_proj_view = matrix_projection;
+}
 
+void RenderEngine::_updateSurfaceWorldMatrices(RenderData& render_data)
+{
    for (int i = 0; i < render_data.main_view_surface_data.size(); ++i)
    {
       mat4 matrix_world_local = _scene.transform_hierarchy->nodeWorldToLocalMatrix(_scene.surfaces[i].transform_node_index);
       render_data.main_view_surface_data[i].matrix_world_local = matrix_world_local;
+   }
+}
+
+// the surfaces out of the view frustum keep their matrices of the last time they were visible
+void RenderEngine::_updateSurfaceProjectionMatrices(RenderData& render_data)
+{
+   for (int i = 0; i < render_data.main_view_surface_data.size(); ++i)
+   {
+      if (!render_data.surface_visibility[i])
+         continue;
+
+      const mat4& matrix_world_local = render_data.main_view_surface_data[i].matrix_world_local;
       render_data.main_view_surface_data[i].normal_matrix_world_local = normalMatrix(matrix_world_local);
       render_data.main_view_surface_data[i].matrix_proj_local = render_data.matrix_proj_world * matrix_world_local;
    }
 }
 
+template<typename simdfloatT>
+static void _frustumCullAabbs(const vec4* frustum_planes, const float* aabbs, int aabb_stride, int aabb_count, unsigned char* visibility)
+{
+   simdvec3_t<simdfloatT> planes_xyz[6];
+   simdfloatT planes_w[6];
+   for (int i = 0; i < 6; ++i)
+   {
+      planes_xyz[i] = simdvec3_t<simdfloatT>(vec3(frustum_planes[i].xyz));
+      planes_w[i] = simdfloatT(frustum_planes[i].w);
+   }
+
+   for (int i = 0; i < aabb_count; i += simdfloatT::width)
+   {
+      simdvec3_t<simdfloatT> center, extent;
+      center.load(aabbs, aabbs + aabb_stride, aabbs + 2 * aabb_stride, i);
+      extent.load(aabbs + 3 * aabb_stride, aabbs + 4 * aabb_stride, aabbs + 5 * aabb_stride, i);
+
+      typename simdfloatT::bool_type inside = true;
+      for (int k = 0; k < 6; ++k)
+         inside &= (dot(center, planes_xyz[k]) + dot(extent, abs(planes_xyz[k]))) >= -planes_w[k];
+
+      int inside_mask = movemask(inside);
+      int batch_size = std::min(int(simdfloatT::width), aabb_count - i);
+      for (int k = 0; k < batch_size; ++k)
+         visibility[i + k] = (inside_mask >> k) & 1;
+   }
+
+   simdfloatT::leaveSection();
+}
+
+void RenderEngine::_cullSurfaces(RenderData& render_data)
+{
+   int surface_count = int(render_data.main_view_surface_data.size());
+   float* center_x = _surface_world_bounds;
+   float* center_y = center_x + _surface_world_bounds_stride;
+   float* center_z = center_y + _surface_world_bounds_stride;
+   float* extent_x = center_z + _surface_world_bounds_stride;
+   float* extent_y = extent_x + _surface_world_bounds_stride;
+   float* extent_z = extent_y + _surface_world_bounds_stride;
+
+   for (int i = 0; i < surface_count; ++i)
+   {
+      const Aabb3& bounds = _scene.surfaces[i].bounds_in_local_space;
+      const mat4& matrix_world_local = render_data.main_view_surface_data[i].matrix_world_local;
+      vec3 center = vec3(matrix_world_local * vec4(0.5f * (bounds.pmin + bounds.pmax), 1.0f));
+      mat3 abs_rotation = mat3(abs(vec3(matrix_world_local[0])), abs(vec3(matrix_world_local[1])), abs(vec3(matrix_world_local[2])));
+      vec3 extent = abs_rotation * (0.5f * (bounds.pmax - bounds.pmin));
+
+      center_x[i] = center.x; center_y[i] = center.y; center_z[i] = center.z;
+      extent_x[i] = extent.x; extent_y[i] = extent.y; extent_z[i] = extent.z;
+   }
+
+   vec4 frustum_planes[6];
+   extractFrustumPlanes(render_data.matrix_proj_world, frustum_planes);
+   unsigned char* visibility = render_data.surface_visibility.data();
+   switch (_simd_instruction_set)
+   {
+#ifdef SIMD_AVX512
+   case SimdInstructionSet::AVX512:
+      _frustumCullAabbs<simdfloat16>(frustum_planes, _surface_world_bounds, _surface_world_bounds_stride, surface_count, visibility);
+      break;
+#endif
+   case SimdInstructionSet::AVX:
+      _frustumCullAabbs<simdfloat8>(frustum_planes, _surface_world_bounds, _surface_world_bounds_stride, surface_count, visibility);
+      break;
+   default:
+      _frustumCullAabbs<simdfloat>(frustum_planes, _surface_world_bounds, _surface_world_bounds_stride, surface_count, visibility);
+      break;
+   }
+
+   for (int i = 0; i < surface_count; ++i)
+   {
+      if (_scene.surfaces[i].bounds_in_local_space.isNull())
+         visibility[i] = 1;
+   }
+}
+
 
 vec4 _normalizePlane(vec4 plane)
 {
@@ -17,10 +17,26 @@ class SSAORenderer;
 class ClusteredLightCuller;
 class VolumetricFog;
 class Voxelizer;
+class BatchedMeshes;
+class RenderQueue;
+class OcclusionCuller;
+class TaskGraph;
+enum class SimdInstructionSet;
+
+// FroxelLists: full light lists per froxel.
+// ZBinned: a light range per depth slice and a light bitmask per screen tile, intersected when shading.
+enum class LightCullingMode { FroxelLists = 0, ZBinned = 1 };
 
 struct RenderSettings
 {
    float froxel_z_distribution_factor = 2.0f;
+   ivec3 light_froxels_dims = ivec3(24, 24, 32);
+   int max_lights_per_froxel = 100;
+   LightCullingMode light_culling_mode = LightCullingMode::FroxelLists;
+   int light_zbin_count = 256;
+   bool light_culling_on_gpu = false; // froxel lists mode only
+   bool light_list_heads_in_ssbo = false; // froxel lists mode culled on the cpu only
+   bool exact_sphere_light_injection = true; // froxel lists mode only
    float light_contribution_threshold = 0.05f;
    float bias = 0.0f;
    int x = 16;
@@ -31,6 +47,7 @@ struct RenderSettings
    vec3 fog_scattering_color = vec3(1.0);
    float fog_absorption = 0.01f;
    bool show_voxel_grid = false;
+   bool occlusion_culling = true;
 };
 
 
@@ -48,6 +65,7 @@ public:
 
    void drawSurfaces(const RenderData& render_data);
 
+   RenderSettings _settings; // declared first, the renderers read it when they are constructed
    Uptr<RenderResources> render_resources;
    Uptr<CubemapFiltering> cubemap_converter;
    Uptr<BackgroundSky> background_sky;
@@ -56,21 +74,31 @@ public:
    Uptr<ClusteredLightCuller> froxeled_light_culler;
    Uptr<VolumetricFog> volumetric_fog;
    Uptr<Voxelizer> voxelizer;
-
-   RenderSettings _settings;
+   Uptr<OcclusionCuller> occlusion_culler;
+   Uptr<TaskGraph> update_graph; // nodes of updateScene, with their timings of the last update
    
 private:
    void _bindSceneUniforms();
-   void _bindSurfaceUniforms(int suface_index, const SurfaceInstance& surface);
+   void _bindSurfaceDrawBuffers();
+   void _bindSurfaceUniforms(int draw_index, const SurfaceInstance& surface);
    void _renderSurfaces(const RenderData& render_data);
-   void _renderSurfacesMaterial(SurfaceRange surfaces);
+   void _renderSurfacesMaterial(const RenderData& render_data, const std::vector<SurfaceDrawBatch>& draw_batches);
+   void _drawSurfaceBatch(const RenderData& render_data, const SurfaceDrawBatch& draw_batch, bool material_vertex_source);
    void _createSceneLightsBuffer();
 
-   void _sortSurfacesByDistanceToCamera(RenderData& render_data);
-   void _sortSurfacesByMaterial();
+   void _queueSurfaces(const RenderData& render_data);
+   void _partitionSurfacesByOpacity();
    void _updateUniformBuffers(const RenderData& render_data, float time, float delta_time);
-   void _updateRenderMatrices(RenderData& render_data);
+   void _buildDrawBatches(RenderData& render_data);
+   void _appendDrawBatches(RenderData& render_data, const std::vector<int>& surface_indices, bool batch_per_program, std::vector<SurfaceDrawBatch>* draw_batches);
+   void _updateDrawBuffers(const RenderData& render_data);
+   void _createBatchedMeshes();
+   void _updateCameraMatrices(RenderData& render_data);
+   void _updateSurfaceWorldMatrices(RenderData& render_data);
+   void _updateSurfaceProjectionMatrices(RenderData& render_data);
+   void _createUpdateGraph();
    void _computeLightsRadius();
+   void _cullSurfaces(RenderData& render_data);
 
 private:
    DISALLOW_COPY_AND_ASSIGN(RenderEngine)
@@ -79,6 +107,13 @@ private:
    Uptr<GLDynamicBuffer> _surface_uniforms;
    Uptr<GLDynamicBuffer> _scene_uniforms;
 
+   // the surfaces of each draw and the indirect commands of the multi draws, laid out like RenderData::draw_surface_indices
+   std::vector<Uptr<BatchedMeshes>> _batched_meshes; // one per vertex format
+   Uptr<GLDynamicBuffer> _draw_surface_indices;
+   Uptr<GLDynamicBuffer> _draw_commands;
+   std::vector<int> _all_surface_indices;
+   Uptr<RenderQueue> _render_queue;
+
    Uptr<GLBuffer> _sphere_lights_ssbo;
    Uptr<GLBuffer> _spot_lights_ssbo;
    Uptr<GLBuffer> _rectangle_lights_ssbo;
@@ -86,7 +121,15 @@ private:
 
    Uptr<GLProgram> _z_pass_render_program;
 
-   size_t _surface_uniforms_size;
+   // world space bounds of the surfaces for the frustum test, stored per component (center xyz, extent xyz) with a stride padded for simd loads
+   float* _surface_world_bounds;
+   int _surface_world_bounds_stride;
+   SimdInstructionSet _simd_instruction_set;
+
+   // what the update graph nodes work on during an update
+   RenderData* _update_render_data;
+   float _update_time;
+   float _update_delta_time;
 
    
 };
@@ -1,9 +1,16 @@
 #include "RenderMesh.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "GLVertexSource.h"
 #include "GLFormats.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
 
 namespace yare {
 
@@ -13,24 +20,20 @@ namespace yare {
 RenderMesh::RenderMesh(int triangle_count, int vertex_count, const std::vector<VertexField>& input_fields)
 : _triangle_count(triangle_count)
 , _vertex_count(vertex_count)
+, _index_type(GL_NONE)
+, _index_count(0)
+, _position_decode_matrix(1.0f)
 {
-	std::int64_t vertex_buffer_size = 0;
 	for (const auto& input_field : input_fields)
 	{
 		auto& field = _fields[input_field.name];
 		field.components = input_field.components;
 		field.component_type = input_field.component_type;
-		field.offset = vertex_buffer_size;
-		field.size = input_field.components*GLFormats::sizeOfType(input_field.component_type)*vertex_count;
-		vertex_buffer_size += field.size;
+		field.normalized = input_field.normalized;
+		field.size = input_field.components*GLFormats::sizeOfType(input_field.component_type)*std::int64_t(vertex_count);
+		_field_data[input_field.name] = nullptr;
 	}
-
-	GLBufferDesc desc;
-	desc.flags = GL_MAP_WRITE_BIT;
-	desc.size_bytes = vertex_buffer_size;
-   desc.data = nullptr;
-	_vertex_buffer = std::make_unique<GLBuffer>(desc);
-   _vertex_cpu_buffer = std::make_unique<char[]>(vertex_buffer_size);
+   _layoutFields();
 }
 
 RenderMesh::~RenderMesh()
@@ -40,17 +43,33 @@ RenderMesh::~RenderMesh()
 
 void* RenderMesh::mapVertices(MeshFieldName vertex_field)
 {
-   const auto& field = _fields.at(vertex_field);
-   return _vertex_cpu_buffer.get() + field.offset;
+   auto& field_buffer = _field_buffers[vertex_field];
+   if (!field_buffer)
+   {
+      const Field& field = _fields.at(vertex_field);
+      field_buffer = std::make_unique<char[]>(field.size);
+      if (_field_data.at(vertex_field))
+         memcpy(field_buffer.get(), _field_data.at(vertex_field), field.size);
+      _field_data[vertex_field] = field_buffer.get();
+   }
+   return field_buffer.get();
 }
 
 void RenderMesh::unmapVertices()
 {
 }
 
+void RenderMesh::mapFieldToFile(MeshFieldName vertex_field, const Sptr<const MappedFile>& file, std::int64_t offset)
+{
+   assert(offset + _fields.at(vertex_field).size <= file->size());
+   _field_buffers.erase(vertex_field);
+   _field_data[vertex_field] = file->data() + offset;
+   _mapped_file = file;
+}
+
 void* RenderMesh::mapTrianglesIndices()
 {
-	return nullptr;
+	return _index_cpu_buffer.get();
 }
 
 void RenderMesh::unmapTriangleIndices()
@@ -58,12 +77,261 @@ void RenderMesh::unmapTriangleIndices()
 
 }
 
+// the fields are stored one after the other in the vertex buffer, returns its size
+std::int64_t RenderMesh::_layoutFields()
+{
+   std::int64_t vertex_buffer_size = 0;
+   for (auto& field : _fields)
+   {
+      field.second.offset = vertex_buffer_size;
+      vertex_buffer_size += field.second.size;
+   }
+   return vertex_buffer_size;
+}
+
+void RenderMesh::_replaceField(MeshFieldName vertex_field, int components, GLenum component_type, bool normalized, std::unique_ptr<char[]> data)
+{
+   Field& field = _fields.at(vertex_field);
+   field.components = components;
+   field.component_type = component_type;
+   field.normalized = normalized;
+   field.size = components*GLFormats::sizeOfType(component_type)*std::int64_t(_vertex_count);
+   _field_data[vertex_field] = data.get();
+   _field_buffers[vertex_field] = std::move(data);
+   _layoutFields();
+}
+
+static vec2 _octahedralEncode(vec3 direction)
+{
+   direction /= std::max(abs(direction.x) + abs(direction.y) + abs(direction.z), 1e-20f);
+   vec2 encoded = vec2(direction);
+   if (direction.z < 0.0f)
+   {
+      vec2 sign_not_zero = vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+      encoded = (1.0f - abs(vec2(encoded.y, encoded.x))) * sign_not_zero;
+   }
+   return encoded;
+}
+
+void RenderMesh::encodeField(MeshFieldName vertex_field, VertexEncoding encoding)
+{
+   const Field& field = _fields.at(vertex_field);
+   if (encoding == VertexEncoding::Float || field.component_type != GL_FLOAT)
+      return;
+
+   // read from the mapped file when the field was not modified yet
+   const float* source = (const float*)_field_data.at(vertex_field);
+   int components = field.components;
+   switch (encoding)
+   {
+   case VertexEncoding::Unorm16:
+   {
+      // the 4th component pads the vertices to 8 bytes
+      assert(vertex_field == MeshFieldName::Position);
+      Aabb3 bounds = positionBounds();
+      vec3 extent = max(bounds.pmax - bounds.pmin, vec3(1e-6f));
+      auto encoded_buffer = std::make_unique<char[]>(4 * sizeof(unsigned short)*_vertex_count);
+      unsigned short* encoded = (unsigned short*)encoded_buffer.get();
+      for (int i = 0; i < _vertex_count; ++i)
+      {
+         vec3 position = vec3(source[i*components + 0], source[i*components + 1], source[i*components + 2]);
+         vec3 unorm = clamp((position - bounds.pmin) / extent, 0.0f, 1.0f);
+         for (int k = 0; k < 3; ++k)
+            encoded[4 * i + k] = (unsigned short)(unorm[k] * 65535.0f + 0.5f);
+         encoded[4 * i + 3] = 0;
+      }
+      _position_decode_matrix = scale(translate(mat4(1.0f), bounds.pmin), extent);
+      _replaceField(vertex_field, 4, GL_UNSIGNED_SHORT, true, std::move(encoded_buffer));
+      break;
+   }
+   case VertexEncoding::Octahedral16:
+   case VertexEncoding::Octahedral8:
+   {
+      assert(vertex_field == MeshFieldName::Normal || vertex_field == MeshFieldName::Tangent0);
+      bool sixteen_bits = encoding == VertexEncoding::Octahedral16;
+      float max_value = sixteen_bits ? 32767.0f : 127.0f;
+      auto encoded_buffer = std::make_unique<char[]>(2 * (sixteen_bits ? sizeof(short) : sizeof(signed char))*_vertex_count);
+      for (int i = 0; i < _vertex_count; ++i)
+      {
+         vec2 octahedral = _octahedralEncode(vec3(source[i*components + 0], source[i*components + 1], source[i*components + 2]));
+         for (int k = 0; k < 2; ++k)
+         {
+            float snorm = std::round(clamp(octahedral[k], -1.0f, 1.0f) * max_value);
+            if (sixteen_bits)
+               ((short*)encoded_buffer.get())[2 * i + k] = short(snorm);
+            else
+               ((signed char*)encoded_buffer.get())[2 * i + k] = (signed char)(snorm);
+         }
+      }
+      _replaceField(vertex_field, 2, sixteen_bits ? GL_SHORT : GL_BYTE, true, std::move(encoded_buffer));
+      break;
+   }
+   case VertexEncoding::HalfFloat:
+   {
+      auto encoded_buffer = std::make_unique<char[]>(components * sizeof(unsigned short)*_vertex_count);
+      unsigned short* encoded = (unsigned short*)encoded_buffer.get();
+      for (int i = 0; i < components * _vertex_count; ++i)
+         encoded[i] = packHalf1x16(source[i]);
+      _replaceField(vertex_field, components, GL_HALF_FLOAT, false, std::move(encoded_buffer));
+      break;
+   }
+   case VertexEncoding::Unorm8:
+   {
+      auto encoded_buffer = std::make_unique<char[]>(components * _vertex_count);
+      unsigned char* encoded = (unsigned char*)encoded_buffer.get();
+      for (int i = 0; i < components * _vertex_count; ++i)
+         encoded[i] = (unsigned char)(clamp(source[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+      _replaceField(vertex_field, components, GL_UNSIGNED_BYTE, true, std::move(encoded_buffer));
+      break;
+   }
+   default:
+      break;
+   }
+}
+
+void RenderMesh::optimizeForIndexedDraw()
+{
+   if (isIndexed() || _vertex_count == 0)
+      return;
+
+   // welded straight from the mapped file
+   std::vector<VertexBlock> blocks;
+   for (const auto& field : _fields)
+      blocks.push_back({ _field_data.at(field.first), int(field.second.size / _vertex_count) });
+
+   std::vector<int> unique_vertices;
+   std::vector<unsigned int> indices = weldVertices(blocks, _vertex_count, &unique_vertices);
+   int vertex_count = int(unique_vertices.size());
+   optimizeVertexCacheOrder(&indices, vertex_count);
+   std::vector<int> previous_vertices = optimizeVertexFetchOrder(&indices, vertex_count);
+
+   // each field gets a block with the vertices in their new order, the mapped file is not read anymore
+   for (auto& field : _fields)
+   {
+      int vertex_size = int(field.second.size / _vertex_count);
+      const char* source = _field_data.at(field.first);
+      auto field_buffer = std::make_unique<char[]>(std::int64_t(vertex_size)*vertex_count);
+      for (int i = 0; i < vertex_count; ++i)
+         memcpy(field_buffer.get() + std::int64_t(i)*vertex_size, source + std::int64_t(unique_vertices[previous_vertices[i]])*vertex_size, vertex_size);
+
+      field.second.size = std::int64_t(vertex_size)*vertex_count;
+      _field_data[field.first] = field_buffer.get();
+      _field_buffers[field.first] = std::move(field_buffer);
+   }
+   _layoutFields();
+   _mapped_file = nullptr;
+   _vertex_count = vertex_count;
+
+   _index_count = int(indices.size());
+   if (vertex_count <= 65536)
+   {
+      _index_type = GL_UNSIGNED_SHORT;
+      _index_cpu_buffer = std::make_unique<char[]>(sizeof(unsigned short)*_index_count);
+      unsigned short* short_indices = (unsigned short*)_index_cpu_buffer.get();
+      for (int i = 0; i < _index_count; ++i)
+         short_indices[i] = (unsigned short)indices[i];
+   }
+   else
+   {
+      _index_type = GL_UNSIGNED_INT;
+      _index_cpu_buffer = std::make_unique<char[]>(sizeof(unsigned int)*_index_count);
+      memcpy(_index_cpu_buffer.get(), indices.data(), sizeof(unsigned int)*_index_count);
+   }
+}
+
+// the fields are copied to the gpu from where they are, the mapped file or their rewritten blocks, without gathering them first
 void RenderMesh::commitToGPU()
 {
-   auto size = _vertex_buffer->size();
-   void* gpu_buffer = _vertex_buffer->mapRange(0, size, GL_MAP_WRITE_BIT);
-   memcpy(gpu_buffer, _vertex_cpu_buffer.get(), size);
+   std::int64_t vertex_buffer_size = _layoutFields();
+   _vertex_buffer = createBuffer(vertex_buffer_size, GL_MAP_WRITE_BIT);
+   char* gpu_buffer = (char*)_vertex_buffer->mapRange(0, vertex_buffer_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+   for (const auto& field : _fields)
+   {
+      assert(_field_data.at(field.first) != nullptr);
+      memcpy(gpu_buffer + field.second.offset, _field_data.at(field.first), field.second.size);
+   }
    _vertex_buffer->unmap();
+
+   if (isIndexed())
+      _index_buffer = createBuffer(GLFormats::sizeOfType(_index_type)*std::int64_t(_index_count), 0, _index_cpu_buffer.get());
+
+   Field position_stream = positionStreamInfo();
+   if (position_stream.size == fieldInfo(MeshFieldName::Position).size)
+   {
+      _position_buffer = createBuffer(position_stream.size, 0, (void*)_field_data.at(MeshFieldName::Position));
+   }
+   else
+   {
+      auto positions = std::make_unique<char[]>(position_stream.size);
+      copyPositionStream(positions.get());
+      _position_buffer = createBuffer(position_stream.size, 0, positions.get());
+   }
+}
+
+Aabb3 RenderMesh::positionBounds() const
+{
+   Aabb3 bounds;
+   auto field_it = _fields.find(MeshFieldName::Position);
+   if (field_it != _fields.end() && field_it->second.component_type == GL_UNSIGNED_SHORT)
+   {
+      bounds.extend(vec3(_position_decode_matrix * vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+      bounds.extend(vec3(_position_decode_matrix * vec4(1.0f, 1.0f, 1.0f, 1.0f)));
+      return bounds;
+   }
+   if (field_it == _fields.end() || field_it->second.component_type != GL_FLOAT || field_it->second.components < 3)
+      return bounds;
+
+   const Field& field = field_it->second;
+   const float* positions = (const float*)_field_data.at(MeshFieldName::Position);
+   for (int i = 0; i < _vertex_count; ++i)
+      bounds.extend(vec3(positions[i * field.components + 0], positions[i * field.components + 1], positions[i * field.components + 2]));
+
+   return bounds;
+}
+
+void RenderMesh::copyPackedPositions(vec3* positions) const
+{
+   const Field& field = _fields.at(MeshFieldName::Position);
+   if (field.component_type == GL_UNSIGNED_SHORT)
+   {
+      const unsigned short* unorms = (const unsigned short*)_field_data.at(MeshFieldName::Position);
+      for (int i = 0; i < _vertex_count; ++i)
+      {
+         vec3 unorm = vec3(unorms[4 * i + 0], unorms[4 * i + 1], unorms[4 * i + 2]) / 65535.0f;
+         positions[i] = vec3(_position_decode_matrix * vec4(unorm, 1.0f));
+      }
+      return;
+   }
+   assert(field.component_type == GL_FLOAT && field.components >= 3);
+
+   const float* source = (const float*)_field_data.at(MeshFieldName::Position);
+   if (field.components == 3)
+   {
+      memcpy(positions, source, sizeof(vec3)*_vertex_count);
+      return;
+   }
+
+   for (int i = 0; i < _vertex_count; ++i)
+      positions[i] = vec3(source[i * field.components + 0], source[i * field.components + 1], source[i * field.components + 2]);
+}
+
+RenderMesh::Field RenderMesh::positionStreamInfo() const
+{
+   Field stream = _fields.at(MeshFieldName::Position);
+   if (stream.component_type == GL_FLOAT)
+      stream.components = 3;
+   stream.offset = 0;
+   stream.size = stream.components*GLFormats::sizeOfType(stream.component_type)*std::int64_t(_vertex_count);
+   return stream;
+}
+
+void RenderMesh::copyPositionStream(char* destination) const
+{
+   const Field& field = _fields.at(MeshFieldName::Position);
+   if (field.component_type == GL_FLOAT)
+      copyPackedPositions((vec3*)destination);
+   else
+      memcpy(destination, _field_data.at(MeshFieldName::Position), field.size);
 }
 
 Uptr<GLVertexSource> createVertexSource(const RenderMesh& mesh, FieldsMask fields_bitmask, bool tessellation)
@@ -77,24 +345,185 @@ Uptr<GLVertexSource> createVertexSource(const RenderMesh& mesh, FieldsMask field
         {
             auto field_info = mesh.fieldInfo(MeshFieldName(mesh_field));
             GLSLVecType vec_type = MeshFieldName(mesh_field) == MeshFieldName::BoneIndices ? GLSLVecType::uvec: GLSLVecType::vec;
-            vertex_source->setVertexAttribute(i, field_info.components, field_info.component_type, vec_type, 0, field_info.offset);
+            vertex_source->setVertexAttribute(i, field_info.components, field_info.component_type, vec_type, 0, field_info.offset, field_info.normalized);
         }
     }
     vertex_source->setVertexCount(mesh.vertexCount());
+    if (mesh.isIndexed())
+        vertex_source->setIndexBuffer(mesh.indexBuffer(), mesh.indexType(), mesh.indexCount());
     vertex_source->setPrimitiveType(tessellation ? GL_PATCHES : GL_TRIANGLES);
     return vertex_source;
 }
 
-Uptr<GLVertexSource> createVertexSource(const RenderMesh& mesh)
+BatchedMeshes::BatchedMeshes()
+: _vertex_count(0)
+, _index_count(0)
+, _index_type(GL_NONE)
 {
-	auto vertex_source = std::make_unique<GLVertexSource>();
-	vertex_source->setVertexBuffer(mesh.vertexBuffer());
-	vertex_source->setVertexAttribute(0, 3, GL_FLOAT, GLSLVecType::vec, 0, mesh.fieldInfo(MeshFieldName::Position).offset);
-   vertex_source->setVertexAttribute(1, 3, GL_FLOAT, GLSLVecType::vec, 0, mesh.fieldInfo(MeshFieldName::Normal).offset);
-   vertex_source->setVertexAttribute(2, 2, GL_FLOAT, GLSLVecType::vec, 0, mesh.fieldInfo(MeshFieldName::Uv0).offset);
-	vertex_source->setVertexCount(mesh.vertexCount());
+}
 
-	return vertex_source;
+BatchedMeshes::~BatchedMeshes()
+{
+}
+
+static const MeshFieldName cAllMeshFields[] = { MeshFieldName::Position, MeshFieldName::Normal, MeshFieldName::Uv0, MeshFieldName::Tangent0,
+                                                MeshFieldName::BoneIndices, MeshFieldName::BoneWeights };
+
+int BatchedMeshes::addMesh(RenderMesh& mesh)
+{
+    auto mesh_it = _mesh_first_vertex.find(&mesh);
+    if (mesh_it != _mesh_first_vertex.end())
+        return mesh_it->second;
+
+    if (!mesh.isIndexed())
+        return -1;
+
+    for (MeshFieldName name : cAllMeshFields)
+    {
+        auto field_it = _fields.find(name);
+        if (!mesh.hasField(name) || field_it == _fields.end())
+            continue;
+
+        const auto& mesh_field = mesh.fieldInfo(name);
+        if (mesh_field.components != field_it->second.components || mesh_field.component_type != field_it->second.component_type ||
+            mesh_field.normalized != field_it->second.normalized)
+            return -1;
+    }
+
+    for (MeshFieldName name : cAllMeshFields)
+    {
+        if (mesh.hasField(name) && _fields.count(name) == 0)
+        {
+            auto& field = _fields[name];
+            field.components = mesh.fieldInfo(name).components;
+            field.component_type = mesh.fieldInfo(name).component_type;
+            field.normalized = mesh.fieldInfo(name).normalized;
+            field.offset = 0;
+            field.size = 0;
+        }
+    }
+
+    int first_vertex = _vertex_count;
+    _mesh_first_vertex[&mesh] = first_vertex;
+    _mesh_first_index[&mesh] = _index_count;
+    _vertex_count += mesh.vertexCount();
+    _index_count += mesh.indexCount();
+    return first_vertex;
+}
+
+void BatchedMeshes::commitToGPU()
+{
+    if (_vertex_count == 0)
+        return;
+
+    std::int64_t vertex_buffer_size = 0;
+    for (auto& field : _fields)
+    {
+        field.second.offset = vertex_buffer_size;
+        field.second.size = field.second.components*GLFormats::sizeOfType(field.second.component_type)*_vertex_count;
+        vertex_buffer_size += GLFormats::alignSize(field.second.size, 16);
+    }
+
+    // each mesh is copied from its cpu vertices, in the mapped file when it was imported from one, straight into the mapped buffers
+    _vertex_buffer = createBuffer(vertex_buffer_size, GL_MAP_WRITE_BIT);
+    char* vertex_data = (char*)_vertex_buffer->map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    for (const auto& mesh : _mesh_first_vertex)
+    {
+        for (const auto& field : _fields)
+        {
+            // the fields a mesh does not have are left to zero
+            std::int64_t vertex_size = field.second.components*GLFormats::sizeOfType(field.second.component_type);
+            char* destination = vertex_data + field.second.offset + vertex_size*mesh.second;
+            if (mesh.first->hasField(field.first))
+                memcpy(destination, mesh.first->fieldData(field.first), mesh.first->fieldInfo(field.first).size);
+            else
+                memset(destination, 0, vertex_size*mesh.first->vertexCount());
+        }
+    }
+    _vertex_buffer->unmap();
+
+    // the meshes have the same position format, so the same position stream format
+    _position_stream = _mesh_first_vertex.begin()->first->positionStreamInfo();
+    std::int64_t position_size = _position_stream.size / _mesh_first_vertex.begin()->first->vertexCount();
+    _position_stream.size = position_size*_vertex_count;
+    _position_buffer = createBuffer(_position_stream.size, GL_MAP_WRITE_BIT);
+    char* position_data = (char*)_position_buffer->map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    for (const auto& mesh : _mesh_first_vertex)
+        mesh.first->copyPositionStream(position_data + position_size*mesh.second);
+    _position_buffer->unmap();
+
+    // 16 bits indices when all the meshes have them, the draws add the first vertex of the mesh to the indices
+    _index_type = GL_UNSIGNED_SHORT;
+    for (const auto& mesh : _mesh_first_vertex)
+    {
+        if (mesh.first->indexType() == GL_UNSIGNED_INT)
+            _index_type = GL_UNSIGNED_INT;
+    }
+
+    int index_size = GLFormats::sizeOfType(_index_type);
+    _index_buffer = createBuffer(std::int64_t(index_size)*_index_count, GL_MAP_WRITE_BIT);
+    char* index_data = (char*)_index_buffer->map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    for (const auto& mesh : _mesh_first_vertex)
+    {
+        char* destination = index_data + std::int64_t(index_size)*_mesh_first_index.at(mesh.first);
+        const void* mesh_indices = mesh.first->mapTrianglesIndices();
+        if (mesh.first->indexType() == _index_type)
+        {
+            memcpy(destination, mesh_indices, std::int64_t(index_size)*mesh.first->indexCount());
+        }
+        else
+        {
+            for (int i = 0; i < mesh.first->indexCount(); ++i)
+                ((unsigned int*)destination)[i] = ((const unsigned short*)mesh_indices)[i];
+        }
+        mesh.first->unmapTriangleIndices();
+    }
+    _index_buffer->unmap();
+}
+
+Uptr<GLVertexSource> createVertexSource(const BatchedMeshes& meshes, FieldsMask fields_bitmask)
+{
+    auto vertex_source = std::make_unique<GLVertexSource>();
+    vertex_source->setVertexBuffer(*meshes._vertex_buffer);
+    for (int i = 0; i < 32; ++i)
+    {
+        auto mesh_field = (1 << i);
+        if (fields_bitmask & mesh_field)
+        {
+            const auto& field_info = meshes._fields.at(MeshFieldName(mesh_field));
+            GLSLVecType vec_type = MeshFieldName(mesh_field) == MeshFieldName::BoneIndices ? GLSLVecType::uvec : GLSLVecType::vec;
+            vertex_source->setVertexAttribute(i, field_info.components, field_info.component_type, vec_type, 0, field_info.offset, field_info.normalized);
+        }
+    }
+    vertex_source->setVertexCount(meshes.vertexCount());
+    vertex_source->setIndexBuffer(*meshes._index_buffer, meshes._index_type, meshes.indexCount());
+    vertex_source->setPrimitiveType(GL_TRIANGLES);
+    return vertex_source;
+}
+
+Uptr<GLVertexSource> createPositionVertexSource(const RenderMesh& mesh, bool tessellation)
+{
+    auto vertex_source = std::make_unique<GLVertexSource>();
+    auto position_stream = mesh.positionStreamInfo();
+    vertex_source->setVertexBuffer(mesh.positionBuffer());
+    vertex_source->setVertexAttribute(0, position_stream.components, position_stream.component_type, GLSLVecType::vec, 0, 0, position_stream.normalized);
+    vertex_source->setVertexCount(mesh.vertexCount());
+    if (mesh.isIndexed())
+        vertex_source->setIndexBuffer(mesh.indexBuffer(), mesh.indexType(), mesh.indexCount());
+    vertex_source->setPrimitiveType(tessellation ? GL_PATCHES : GL_TRIANGLES);
+    return vertex_source;
+}
+
+Uptr<GLVertexSource> createPositionVertexSource(const BatchedMeshes& meshes)
+{
+    auto vertex_source = std::make_unique<GLVertexSource>();
+    const auto& position_stream = meshes._position_stream;
+    vertex_source->setVertexBuffer(*meshes._position_buffer);
+    vertex_source->setVertexAttribute(0, position_stream.components, position_stream.component_type, GLSLVecType::vec, 0, 0, position_stream.normalized);
+    vertex_source->setVertexCount(meshes.vertexCount());
+    vertex_source->setIndexBuffer(*meshes._index_buffer, meshes._index_type, meshes.indexCount());
+    vertex_source->setPrimitiveType(GL_TRIANGLES);
+    return vertex_source;
 }
 
 }
\ No newline at end of file
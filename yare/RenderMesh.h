@@ -4,12 +4,16 @@
 #include <string>
 #include <vector>
 
+#include <glm/mat4x4.hpp>
+
 #include "GLBuffer.h"
+#include "Aabb3.h"
 
 namespace yare {
 
 class GLProgram;
 class GLVertexSource;
+class MappedFile;
 
 enum class MeshFieldName {
     Position = 1 << 0, Normal = 1 << 1,
@@ -24,47 +28,138 @@ struct VertexField
    MeshFieldName name;
    int components;
    GLenum component_type;
+   bool normalized = false; // integers read as floats in [0,1] or [-1,1]
+};
+
+// packed formats a float field can be converted to
+enum class VertexEncoding {
+    Float,
+    Unorm16,      // positions, relative to the mesh bounds
+    Octahedral16, // normals and tangents, 2 snorm16
+    Octahedral8,  // normals and tangents, 2 snorm8
+    HalfFloat,    // uvs
+    Unorm8        // bone weights
 };
 
-class RenderMesh // TODO Yvain handle indexed meshes
+class RenderMesh
 {
 public:
     RenderMesh(int triangle_count, int vertex_count, const std::vector<VertexField>& fields);
     ~RenderMesh();
 
+    // writable vertices of the field, copied out of the mapped file when it is mapped to one
     void* mapVertices(MeshFieldName vertex_field);
     void unmapVertices();    
+    // the vertices of the field are read in the file at offset, until the field is rewritten. The mesh keeps the file mapped
+    void mapFieldToFile(MeshFieldName vertex_field, const Sptr<const MappedFile>& file, std::int64_t offset);
 
+    // indices in indexType(), null when the mesh is not indexed
     void* mapTrianglesIndices();
     void unmapTriangleIndices();
 
+    // converts a float field to a packed format, call it before commitToGPU.
+    // The octahedral normals and tangents need a shader that decodes them, the other formats are decoded by the vertex fetch
+    void encodeField(MeshFieldName vertex_field, VertexEncoding encoding);
+
+    // welds the identical vertices and builds the index buffer, with the triangles ordered for the post transform cache
+    // and the vertices in the order the triangles fetch them. Call it before commitToGPU
+    void optimizeForIndexedDraw();
+
     void commitToGPU();
+    // bounds of the vertex positions, the quantisation bounds when they are Unorm16
+    Aabb3 positionBounds() const;
+    // positions as 3 floats, whatever their format in the vertex buffer
+    void copyPackedPositions(vec3* positions) const;
+    // maps the positions read by the shaders to the mesh local space, the draws fold it into their local matrices
+    const mat4& positionDecodeMatrix() const { return _position_decode_matrix; }
 
 	const GLBuffer& vertexBuffer() const { return *_vertex_buffer;  }
+    // positions only, for the depth only passes that do not need to fetch the other fields
+    const GLBuffer& positionBuffer() const { return *_position_buffer; }
 	int triangleCount() const { return _triangle_count; }
 	int vertexCount() const { return _vertex_count; }
 
+    bool isIndexed() const { return _index_type != GL_NONE; }
+    // GL_UNSIGNED_SHORT when the vertices fit in 16 bits, GL_UNSIGNED_INT otherwise
+    GLenum indexType() const { return _index_type; }
+    int indexCount() const { return _index_count; }
+    const GLBuffer& indexBuffer() const { return *_index_buffer; }
+
     struct Field
     {
         int components;
         GLenum component_type;
+        bool normalized;
         std::int64_t offset;
         std::int64_t size;
     };
     const Field& fieldInfo(MeshFieldName vertex_field) const { return _fields.at(vertex_field); }
+    bool hasField(MeshFieldName vertex_field) const { return _fields.count(vertex_field) != 0; }
+    const void* fieldData(MeshFieldName vertex_field) const { return _field_data.at(vertex_field); }
+    // format of the position stream: the float positions packed to 3 components, the quantised ones as they are
+    Field positionStreamInfo() const;
+    void copyPositionStream(char* destination) const;
 
 private:
     DISALLOW_COPY_AND_ASSIGN(RenderMesh)	
 
+    std::int64_t _layoutFields();
+    void _replaceField(MeshFieldName vertex_field, int components, GLenum component_type, bool normalized, std::unique_ptr<char[]> data);
+
 	std::map<MeshFieldName, Field> _fields;
+    // cpu vertices of each field, in its own block or in the mapped file
+    std::map<MeshFieldName, const char*> _field_data;
+    std::map<MeshFieldName, std::unique_ptr<char[]>> _field_buffers;
+    Sptr<const MappedFile> _mapped_file;
 	int _triangle_count;
 	int _vertex_count;
-    //GLBuffer _index_buffer;
+    GLenum _index_type;
+    int _index_count;
+    mat4 _position_decode_matrix;
+    Uptr<GLBuffer> _vertex_buffer;
+    Uptr<GLBuffer> _position_buffer;
+    Uptr<GLBuffer> _index_buffer;
+    std::unique_ptr<char[]> _index_cpu_buffer;
+};
+
+// Vertices of several meshes concatenated in one buffer, so that they can all be drawn with one multi draw call.
+// Each field is stored in its own block, the vertices of a mesh start at the same index in all the blocks.
+// The indices of the meshes are concatenated too, they stay relative to the first vertex of their mesh.
+class BatchedMeshes
+{
+public:
+    BatchedMeshes();
+    ~BatchedMeshes();
+
+    // returns the first vertex of the mesh in the batch, -1 when the mesh is not indexed or its fields are not in the formats of the batch
+    int addMesh(RenderMesh& mesh);
+    void commitToGPU();
+
+    int vertexCount() const { return _vertex_count; }
+    int indexCount() const { return _index_count; }
+    int meshFirstIndex(const RenderMesh& mesh) const { return _mesh_first_index.at(&mesh); }
+
+private:
+    friend Uptr<GLVertexSource> createVertexSource(const BatchedMeshes& meshes, FieldsMask fields_bitmask);
+    friend Uptr<GLVertexSource> createPositionVertexSource(const BatchedMeshes& meshes);
+    DISALLOW_COPY_AND_ASSIGN(BatchedMeshes)
+
+    std::map<MeshFieldName, RenderMesh::Field> _fields;
+    std::map<RenderMesh*, int> _mesh_first_vertex;
+    std::map<const RenderMesh*, int> _mesh_first_index;
+    int _vertex_count;
+    int _index_count;
+    GLenum _index_type;
+    RenderMesh::Field _position_stream;
     Uptr<GLBuffer> _vertex_buffer;
-    std::unique_ptr<char[]> _vertex_cpu_buffer;
+    Uptr<GLBuffer> _position_buffer;
+    Uptr<GLBuffer> _index_buffer;
 };
 
 Uptr<GLVertexSource> createVertexSource(const RenderMesh& mesh, FieldsMask fields_bitmask, bool tessellation);
-Uptr<GLVertexSource> createVertexSource(const RenderMesh& mesh);
+Uptr<GLVertexSource> createVertexSource(const BatchedMeshes& meshes, FieldsMask fields_bitmask);
+// the position in attribute 0, read from the position stream
+Uptr<GLVertexSource> createPositionVertexSource(const RenderMesh& mesh, bool tessellation);
+Uptr<GLVertexSource> createPositionVertexSource(const BatchedMeshes& meshes);
 
 }
\ No newline at end of file
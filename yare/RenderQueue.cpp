@@ -0,0 +1,131 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <map>
+#include <glm/common.hpp>
+
+#include "Scene.h"
+#include "GLProgram.h"
+
+namespace yare {
+
+static const int cPassShift = 62;
+static const int cDepthBits = 24;
+static const std::uint64_t cDepthMask = (std::uint64_t(1) << cDepthBits) - 1;
+
+RenderQueue::RenderQueue()
+{
+}
+
+void RenderQueue::setSurfaces(const std::vector<SurfaceInstance>& surfaces)
+{
+   // ids are ranks so that they fit in 16 bits, programs are ranked by gl id and texture sets by material
+   std::map<GLuint, unsigned short> program_ids;
+   std::map<const IMaterial*, unsigned short> texture_set_ids;
+   for (const auto& surface : surfaces)
+   {
+      program_ids[surface.material_program->id()] = 0;
+      texture_set_ids[surface.material.get()] = 0;
+   }
+
+   unsigned short id = 0;
+   for (auto& program_id : program_ids)
+      program_id.second = id++;
+   id = 0;
+   for (auto& texture_set_id : texture_set_ids)
+      texture_set_id.second = id++;
+
+   _surface_program_ids.resize(surfaces.size());
+   _surface_texture_set_ids.resize(surfaces.size());
+   for (int i = 0; i < int(surfaces.size()); ++i)
+   {
+      _surface_program_ids[i] = program_ids.at(surfaces[i].material_program->id());
+      _surface_texture_set_ids[i] = texture_set_ids.at(surfaces[i].material.get());
+   }
+}
+
+void RenderQueue::clear()
+{
+   _items.clear();
+}
+
+void RenderQueue::add(RenderPass pass, int surface_index, float depth)
+{
+   std::uint64_t quantized_depth = std::uint64_t(glm::clamp(depth, 0.0f, 1.0f) * float(cDepthMask));
+   std::uint64_t program = _surface_program_ids[surface_index];
+   std::uint64_t texture_set = _surface_texture_set_ids[surface_index];
+
+   std::uint64_t key = std::uint64_t(pass) << cPassShift;
+   switch (pass)
+   {
+   case RenderPass::ZPass:
+      key |= quantized_depth << (cPassShift - cDepthBits);
+      break;
+   case RenderPass::Opaque:
+      key |= (program << 46) | (texture_set << 30) | (quantized_depth << 6);
+      break;
+   case RenderPass::Transparent:
+      key |= ((cDepthMask - quantized_depth) << (cPassShift - cDepthBits)) | (program << 22) | (texture_set << 6);
+      break;
+   }
+
+   _items.push_back({ key, surface_index });
+}
+
+// 8 bits digits, the histograms of all the digits are counted in one pass over the keys
+static void _radixSort(std::vector<RenderQueueItem>* items, std::vector<RenderQueueItem>* sort_buffer)
+{
+   const int digit_count = 8;
+   int item_count = int(items->size());
+   sort_buffer->resize(item_count);
+   if (item_count < 2)
+      return;
+
+   int histograms[digit_count][256] = {};
+   for (const auto& item : *items)
+   {
+      for (int digit = 0; digit < digit_count; ++digit)
+         histograms[digit][(item.key >> (8 * digit)) & 0xff]++;
+   }
+
+   RenderQueueItem* source = items->data();
+   RenderQueueItem* destination = sort_buffer->data();
+   for (int digit = 0; digit < digit_count; ++digit)
+   {
+      int shift = 8 * digit;
+      int* histogram = histograms[digit];
+
+      // a digit shared by all the keys does not change the order
+      if (histogram[(source[0].key >> shift) & 0xff] == item_count)
+         continue;
+
+      int offset = 0;
+      for (int i = 0; i < 256; ++i)
+      {
+         int count = histogram[i];
+         histogram[i] = offset;
+         offset += count;
+      }
+
+      for (int i = 0; i < item_count; ++i)
+         destination[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+
+      std::swap(source, destination);
+   }
+
+   if (source != items->data())
+      items->swap(*sort_buffer);
+}
+
+void RenderQueue::sort()
+{
+   _radixSort(&_items, &_sort_buffer);
+
+   for (auto& pass_surfaces : _pass_surfaces)
+      pass_surfaces.clear();
+
+   for (const auto& item : _items)
+      _pass_surfaces[item.key >> cPassShift].push_back(item.surface_index);
+}
+
+}
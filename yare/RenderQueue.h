@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "tools.h"
+
+namespace yare {
+
+struct SurfaceInstance;
+
+enum class RenderPass { ZPass = 0, Opaque = 1, Transparent = 2 };
+const int cRenderPassCount = 3;
+
+struct RenderQueueItem
+{
+   std::uint64_t key;
+   int surface_index;
+};
+
+// Surfaces of all the passes sorted by a packed 64 bits key, with a lsd radix sort.
+// The pass is in the top bits so each pass reads its own contiguous view, in its own order:
+//   z pass:      pass | depth (front to back)
+//   opaque:      pass | program | texture set | depth (state grouped, then front to back)
+//   transparent: pass | inverted depth (back to front) | program | texture set
+class RenderQueue
+{
+public:
+   RenderQueue();
+
+   // assigns the program and texture set ids the keys are built from, call it again when the scene surfaces change
+   void setSurfaces(const std::vector<SurfaceInstance>& surfaces);
+
+   void clear();
+   // depth is the distance to the camera mapped to [0,1], values outside are clamped
+   void add(RenderPass pass, int surface_index, float depth);
+   void sort();
+
+   // surface indices of a pass in draw order, valid after sort
+   const std::vector<int>& passSurfaces(RenderPass pass) const { return _pass_surfaces[int(pass)]; }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(RenderQueue)
+
+   std::vector<unsigned short> _surface_program_ids;
+   std::vector<unsigned short> _surface_texture_set_ids;
+   std::vector<RenderQueueItem> _items;
+   std::vector<RenderQueueItem> _sort_buffer;
+   std::vector<int> _pass_surfaces[cRenderPassCount];
+};
+
+}
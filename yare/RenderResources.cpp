@@ -9,7 +9,6 @@
 #include "GLProgram.h"
 #include "GLSampler.h"
 #include "GLFramebuffer.h"
-#include "GLGPUTimer.h"
 #include "glsl_global_defines.h"
 
 namespace yare {
@@ -62,15 +61,6 @@ Samplers createSamplers()
 
 RenderResources::RenderResources(const ImageSize& framebuffer_size_)
 {
-   timer = std::make_unique<GLGPUTimer>();
-   ssao_timer = std::make_unique<GLGPUTimer>(); 
-   z_pass_timer = std::make_unique<GLGPUTimer>();
-   voxelize_timer = std::make_unique<GLGPUTimer>();
-   raytrace_timer = std::make_unique<GLGPUTimer>();
-   material_pass_timer = std::make_unique<GLGPUTimer>();
-   background_timer = std::make_unique<GLGPUTimer>();
-   volumetric_fog_timer = std::make_unique<GLGPUTimer>();
-
    framebuffer_size = framebuffer_size_;
    main_framebuffer = createFramebuffer(framebuffer_size, GL_RGBA16F, 2, GL_DEPTH_COMPONENT32F); // 0 color, // 1 normals
    ssao_framebuffer = createFramebuffer(framebuffer_size, GL_R16F, 2);
@@ -11,7 +11,6 @@ class GLBuffer;
 class GLVertexSource;
 class GLSampler;
 class GLFramebuffer;
-class GLGPUTimer;
 class GLProgram;
 class GLTexture1D;
 
@@ -33,21 +32,13 @@ struct RenderResources
    Uptr<GLFramebuffer> main_framebuffer;
    Uptr<GLFramebuffer> ssao_framebuffer;
    Uptr<GLFramebuffer> halfsize_postprocess_fbo;
+   Uptr<GLFramebuffer> present_framebuffer; // the final image goes to the window when null
 
    Samplers samplers;
 
    Uptr<GLBuffer> fullscreen_triangle_vbo;
    Uptr<GLVertexSource> fullscreen_triangle_source;
 
-   Uptr<GLGPUTimer> timer;
-   Uptr<GLGPUTimer> ssao_timer;
-   Uptr<GLGPUTimer> z_pass_timer;
-   Uptr<GLGPUTimer> voxelize_timer;
-   Uptr<GLGPUTimer> raytrace_timer;
-   Uptr<GLGPUTimer> material_pass_timer;
-   Uptr<GLGPUTimer> background_timer;
-   Uptr<GLGPUTimer> volumetric_fog_timer;
-
    Uptr<GLBuffer> hammersley_samples;
    Uptr<GLTexture1D> random_texture;
 
@@ -13,6 +13,7 @@
 #include "IMaterial.h"
 #include "Transform.h"
 #include "SurfaceRange.h"
+#include "Aabb3.h"
 
 namespace yare {
 
@@ -31,6 +32,7 @@ struct SurfaceInstance
 {
    int transform_node_index;
    vec3 center_in_local_space;
+   Aabb3 bounds_in_local_space; // null when the surface is never culled
    Sptr<RenderMesh> mesh;
    Sptr<Skeleton> skeleton;
    Sptr<IMaterial> material;
@@ -38,7 +40,13 @@ struct SurfaceInstance
    const GLProgram* material_program;
         
    Sptr<GLVertexSource> vertex_source_for_material;
-   Sptr<GLVertexSource> vertex_source_position_normal;
+   Sptr<GLVertexSource> vertex_source_position; // depth only passes
+
+   // surfaces whose mesh is in the scene batched meshes are drawn with multi draw indirect, with these vertex sources
+   int batched_first_vertex = -1;
+   int batched_first_index = -1;
+   Sptr<GLVertexSource> batched_vertex_source_for_material;
+   Sptr<GLVertexSource> batched_vertex_source_position;
 };
 
 enum class LightType { Sphere = 0, Rectangle = 1, Sun = 3, Spot = 2 };
@@ -96,17 +104,27 @@ struct MainViewSurfaceData
     glm::mat3 normal_matrix_world_local;
 };
 
-struct SurfaceDistanceSortItem
+// Consecutive draws of a pass sharing a program, the multi drawn surfaces come first and are submitted with one call,
+// the others (skinned or tessellated) are drawn one by one
+struct SurfaceDrawBatch
 {
-   int surface_index;
-   float distance;
+   int first_draw;
+   int multi_draw_count;
+   int single_draw_count;
 };
 
 struct RenderData
 {
    std::vector<MainViewSurfaceData> main_view_surface_data;
-   
-   std::vector<SurfaceDistanceSortItem> surfaces_sorted_by_distance;
+   std::vector<unsigned char> surface_visibility; // surfaces in the view frustum, the sort and the draws skip the others
+
+   // surface index of every draw of the frame, the draw batches of the passes index it
+   std::vector<int> draw_surface_indices;
+   std::vector<SurfaceDrawBatch> all_surfaces_draw_batches; // all the surfaces in one batch, for the voxelizer
+   std::vector<SurfaceDrawBatch> z_pass_draw_batches;
+   std::vector<SurfaceDrawBatch> opaque_draw_batches;
+   std::vector<SurfaceDrawBatch> transparent_draw_batches;
+
    glm::mat4x4 matrix_proj_world;
    glm::mat4x4 matrix_view_proj;
    glm::mat4x4 matrix_proj_view;
@@ -167,7 +185,9 @@ public:
    Uptr<AnimationPlayer> animation_player;
    Uptr<TransformHierarchy> transform_hierarchy;
 
-   RenderData render_data[2];
+   // one per dynamic buffers segment, written by the update, published, read by the render, and retired while the gpu
+   // finishes its last frames, see RenderDataMailbox
+   std::vector<RenderData> render_data;
 };
 
 
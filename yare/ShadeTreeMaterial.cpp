@@ -124,6 +124,9 @@ std::string ShadeTreeMaterial::_buildProgramDefinesString(MaterialVariant materi
    if (int(material_variant) & int(MaterialVariant::EnableSDFVolume))
       defines += "#define USE_SDF_VOLUME \n";
 
+   if (int(material_variant) & int(MaterialVariant::OctahedralDirections))
+      defines += "#define USE_OCTAHEDRAL_DIRECTIONS \n";
+
    return defines;
 }
 
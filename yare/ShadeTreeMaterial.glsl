@@ -1,14 +1,24 @@
 ~~~~~~~~~~~~~~~~~~~ VertexShader ~~~~~~~~~~~~~~~~~~~~~
+#extension GL_ARB_shader_draw_parameters : require
 #include "glsl_global_defines.h"
 %s
+// positions are decoded by the local matrices, uvs and bone weights by the vertex fetch
 layout(location=0) in vec3 position;
+#ifdef USE_OCTAHEDRAL_DIRECTIONS
+layout(location=1) in vec2 octahedral_normal;
+#else
 layout(location=1) in vec3 normal;
+#endif
 #ifdef USE_UV
 layout(location=2) in vec2 uv;
 #endif
 #ifdef USE_NORMAL_MAPPING
+#ifdef USE_OCTAHEDRAL_DIRECTIONS
+layout(location = 3) in vec2 octahedral_tangent;
+#else
 layout(location = 3) in vec3 tangent;
 #endif
+#endif
 
 #ifdef USE_SKINNING
 layout(location = 4) in uvec4 bone_index;
@@ -32,8 +42,27 @@ layout(std430, binding = BI_SKINNING_PALETTE_SSBO) buffer SkinningPaletteSSBO
    mat4x3 skinning_matrix[];
 };
 #endif
+
+#ifdef USE_OCTAHEDRAL_DIRECTIONS
+vec3 octahedralDecode(vec2 encoded)
+{
+   vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+   float folded = max(-direction.z, 0.0);
+   direction.x += direction.x >= 0.0 ? -folded : folded;
+   direction.y += direction.y >= 0.0 ? -folded : folded;
+   return normalize(direction);
+}
+#endif
+
 void main()
 {
+#ifdef USE_OCTAHEDRAL_DIRECTIONS
+   vec3 normal = octahedralDecode(octahedral_normal);
+#ifdef USE_NORMAL_MAPPING
+   vec3 tangent = octahedralDecode(octahedral_tangent);
+#endif
+#endif
+
 #ifdef USE_SKINNING
    vec3 pos_world = matrix_world_local*vec4(position, 1.0);
    vec3 normal_world = mat3(normal_matrix_world_local)*normal;
@@ -187,21 +216,19 @@ vec3 pointLightIrradiance(vec3 light_power, vec3 light_position, float light_rad
 
 vec3 evalDiffuseBSDF(vec3 color, vec3 normal)
 {   
-   unsigned int start_offset = froxel_light_lists.start_offset;
    vec3 irradiance = vec3(0.0);
    
-   for (unsigned int i = 0; i < froxel_light_lists.sphere_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_SPHERE); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       SphereLight light = sphere_lights[light_index];
 
       irradiance += pointLightIrradiance(light.color, light.position, light.radius);
    }
-   start_offset += froxel_light_lists.sphere_light_count;
 
-   for (unsigned int i = 0; i < froxel_light_lists.spot_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_SPOT); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       SpotLight light = spot_lights[light_index];
 
       vec3 light_dir = normalize(light.position - attr_position);
@@ -211,17 +238,15 @@ vec3 evalDiffuseBSDF(vec3 color, vec3 normal)
       // This means that not all the light source power is redirected to the light cone, some is lost in the directions outside of the cone.
       irradiance += pointLightIrradiance(light.color, light.position, light.radius) * spot_attenuation;
    }
-   start_offset += froxel_light_lists.spot_light_count;
 
-   for (unsigned int i = 0; i < froxel_light_lists.rectangle_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_RECTANGLE); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       RectangleLight light = rectangle_lights[light_index];
 
       vec2 light_size = vec2(light.size_x, light.size_y);
       irradiance += rectangleLightIrradiance(light.position, light_size, light.direction_x, light.direction_y, light.radius) * light.color;
    }
-   start_offset += froxel_light_lists.rectangle_light_count;
 
    for (int i = 0; i < sun_lights.length(); ++i)
    {
@@ -342,12 +367,11 @@ vec3 out_val;
 vec3 evalGlossyBSDF(vec3 color, vec3 normal, float roughness)
 {
    roughness = max(roughness, 0.001);
-   unsigned int start_offset = froxel_light_lists.start_offset;
    vec3 exit_radiance = vec3(0.0);
 
-   for (unsigned int i = 0; i < froxel_light_lists.sphere_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_SPHERE); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       SphereLight light = sphere_lights[light_index];
 
       vec3 light_vector = light.position - attr_position;
@@ -361,11 +385,10 @@ vec3 evalGlossyBSDF(vec3 color, vec3 normal, float roughness)
 
       exit_radiance += renormalization_factor* evalMicrofacetGGX(roughness, normal, view_vector, light_dir) * pointLightIncidentRadiance(light.color, closest_point+ attr_position, light.radius);
    }
-   start_offset += froxel_light_lists.sphere_light_count;
    
-   for (unsigned int i = 0; i < froxel_light_lists.spot_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_SPOT); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       SpotLight light = spot_lights[light_index];
 
       vec3 light_vector = normalize(light.position - attr_position);
@@ -373,11 +396,10 @@ vec3 evalGlossyBSDF(vec3 color, vec3 normal, float roughness)
 
       exit_radiance += evalMicrofacetGGX(roughness, normal, view_vector, light_vector) * pointLightIncidentRadiance(light.color, light.position, light.radius) * spot_attenuation;
    }
-   start_offset += froxel_light_lists.spot_light_count;
 
-   /*for (unsigned int i = 0; i < froxel_light_lists.rectangle_light_count; ++i)
+   /*for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_RECTANGLE); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       RectangleLight light = rectangle_lights[light_index];
 
       vec3 reflection_vector = normalize(reflect(-view_vector, normal));
@@ -392,7 +414,6 @@ vec3 evalGlossyBSDF(vec3 color, vec3 normal, float roughness)
 
       exit_radiance += evalMicrofacetGGX(roughness, normal, view_vector, light_dir) * pointLightIncidentRadiance(light.color, closest_point, light.radius);
    }*/
-   start_offset += froxel_light_lists.rectangle_light_count;
 
    for (int i = 0; i < sun_lights.length(); ++i)
    {
@@ -32,6 +32,7 @@ public:
    virtual void bindTextures() override;
    virtual bool isTransparent() override { return _is_transparent; }
    virtual bool hasTessellation() override { return false; }
+   virtual bool supportsOctahedralDirections() override { return true; }
 
 private:
    std::string _createVertexShaderCode(const ShadeTreeEvaluation& evaluation, const std::string& fragment_template, const std::string& defines);
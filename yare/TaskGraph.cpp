@@ -0,0 +1,196 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+
+#include "Profiler.h"
+#include "stl_helpers.h"
+
+namespace yare {
+
+TaskGraph::TaskGraph(int worker_count)
+   : _remaining_node_count(0)
+   , _ready_node_count(0)
+   , _execution_index(0)
+   , _busy_thread_count(0)
+   , _quit(false)
+{
+   if (worker_count <= 0)
+      worker_count = std::max(int(std::thread::hardware_concurrency()), 1);
+
+   for (int i = 0; i < worker_count; ++i)
+      _queues.push_back(std::make_unique<WorkerQueue>());
+
+   for (int i = 1; i < worker_count; ++i)
+      _threads.emplace_back(&TaskGraph::_workerLoop, this, i);
+}
+
+TaskGraph::~TaskGraph()
+{
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _quit = true;
+   }
+   _execution_started.notify_all();
+   for (auto& thread : _threads)
+      thread.join();
+}
+
+int TaskGraph::addNode(const std::string& name, std::function<void()> work)
+{
+   auto node = std::make_unique<Node>();
+   node->name = name;
+   node->work = std::move(work);
+   node->dependency_count = 0;
+   node->pending_dependency_count = 0;
+   node->timing = { 0.0f, 0.0f, 0 };
+   _nodes.push_back(std::move(node));
+   return int(_nodes.size()) - 1;
+}
+
+void TaskGraph::addDependency(int node, int dependency)
+{
+   _nodes[dependency]->successors.push_back(node);
+   _nodes[node]->dependency_count++;
+}
+
+void TaskGraph::execute()
+{
+   if (_nodes.empty())
+      return;
+
+   _execution_start = std::chrono::steady_clock::now();
+   _remaining_node_count = nodeCount();
+   int root_count = 0;
+   for (int i = 0; i < nodeCount(); ++i)
+   {
+      _nodes[i]->pending_dependency_count = _nodes[i]->dependency_count;
+      if (_nodes[i]->dependency_count == 0)
+         _push(root_count++ % workerCount(), i);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _busy_thread_count = int(_threads.size());
+      _execution_index++;
+   }
+   _execution_started.notify_all();
+
+   _runNodes(0);
+
+   std::unique_lock<std::mutex> lock(_mutex);
+   _execution_finished.wait(lock, [this] { return _busy_thread_count == 0; });
+}
+
+void TaskGraph::_workerLoop(int worker)
+{
+   Profiler::setThreadName(string_format("task worker %d", worker));
+   unsigned int last_execution_index = 0;
+   while (true)
+   {
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _execution_started.wait(lock, [&] { return _quit || _execution_index != last_execution_index; });
+         if (_quit)
+            return;
+         last_execution_index = _execution_index;
+      }
+
+      _runNodes(worker);
+
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         _busy_thread_count--;
+      }
+      _execution_finished.notify_all();
+   }
+}
+
+// the workers wait on _node_ready for the nodes that are not ready yet, it is signaled by _push and by the last node
+void TaskGraph::_runNodes(int worker)
+{
+   while (_remaining_node_count > 0)
+   {
+      int node;
+      if (_pop(worker, &node) || _steal(worker, &node))
+      {
+         _runNode(worker, node);
+      }
+      else
+      {
+         std::unique_lock<std::mutex> lock(_ready_mutex);
+         _node_ready.wait(lock, [this] { return _ready_node_count > 0 || _remaining_node_count == 0; });
+      }
+   }
+}
+
+void TaskGraph::_runNode(int worker, int node_index)
+{
+   Node& node = *_nodes[node_index];
+   auto start = std::chrono::steady_clock::now();
+   {
+      CPUProfileZone profile_zone(node.name.c_str());
+      node.work();
+   }
+   auto end = std::chrono::steady_clock::now();
+
+   node.timing.start_ms = std::chrono::duration<float, std::milli>(start - _execution_start).count();
+   node.timing.duration_ms = std::chrono::duration<float, std::milli>(end - start).count();
+   node.timing.worker = worker;
+
+   for (int successor : node.successors)
+   {
+      if (--_nodes[successor]->pending_dependency_count == 0)
+         _push(worker, successor);
+   }
+
+   if (--_remaining_node_count == 0)
+   {
+      // taking the lock makes sure the waiting workers are either asleep or about to see the count
+      { std::lock_guard<std::mutex> lock(_ready_mutex); }
+      _node_ready.notify_all();
+   }
+}
+
+void TaskGraph::_push(int worker, int node)
+{
+   {
+      std::lock_guard<std::mutex> lock(_queues[worker]->mutex);
+      _queues[worker]->nodes.push_back(node);
+   }
+   {
+      std::lock_guard<std::mutex> lock(_ready_mutex);
+      _ready_node_count++;
+   }
+   _node_ready.notify_one();
+}
+
+bool TaskGraph::_pop(int worker, int* node)
+{
+   std::lock_guard<std::mutex> lock(_queues[worker]->mutex);
+   if (_queues[worker]->nodes.empty())
+      return false;
+
+   *node = _queues[worker]->nodes.back();
+   _queues[worker]->nodes.pop_back();
+   _ready_node_count--;
+   return true;
+}
+
+bool TaskGraph::_steal(int worker, int* node)
+{
+   for (int i = 1; i < workerCount(); ++i)
+   {
+      WorkerQueue& victim = *_queues[(worker + i) % workerCount()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.nodes.empty())
+      {
+         *node = victim.nodes.front();
+         victim.nodes.pop_front();
+         _ready_node_count--;
+         return true;
+      }
+   }
+   return false;
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tools.h"
+
+namespace yare {
+
+struct TaskTiming
+{
+   float start_ms; // from the start of the execution
+   float duration_ms;
+   int worker;
+};
+
+// Nodes with explicit dependencies, all run once per execute() on a pool of workers.
+// A node is pushed on the queue of the worker that completed its last dependency. Workers pop their newest node
+// and steal the oldest one of the other queues when theirs is empty. The thread calling execute() is worker 0.
+// Workers with nothing to run sleep until a node is ready, so they leave the cores to the omp loops of the running nodes.
+class TaskGraph
+{
+public:
+   explicit TaskGraph(int worker_count = 0); // 0 for one worker per hardware thread
+   ~TaskGraph();
+
+   int addNode(const std::string& name, std::function<void()> work);
+   void addDependency(int node, int dependency);
+
+   // returns when all the nodes are done
+   void execute();
+
+   int nodeCount() const { return int(_nodes.size()); }
+   int workerCount() const { return int(_queues.size()); }
+   const std::string& nodeName(int node) const { return _nodes[node]->name; }
+   // timing of the node during the last execution
+   const TaskTiming& nodeTiming(int node) const { return _nodes[node]->timing; }
+
+private:
+   DISALLOW_COPY_AND_ASSIGN(TaskGraph)
+
+   struct Node
+   {
+      std::string name;
+      std::function<void()> work;
+      std::vector<int> successors;
+      int dependency_count;
+      std::atomic<int> pending_dependency_count;
+      TaskTiming timing;
+   };
+
+   struct WorkerQueue
+   {
+      std::mutex mutex;
+      std::deque<int> nodes;
+   };
+
+   void _workerLoop(int worker);
+   void _runNodes(int worker);
+   void _runNode(int worker, int node);
+   void _push(int worker, int node);
+   bool _pop(int worker, int* node);
+   bool _steal(int worker, int* node);
+
+   std::vector<Uptr<Node>> _nodes;
+   std::vector<Uptr<WorkerQueue>> _queues;
+   std::vector<std::thread> _threads;
+   std::atomic<int> _remaining_node_count;
+   std::atomic<int> _ready_node_count; // pushed and not popped yet
+   std::mutex _ready_mutex;
+   std::condition_variable _node_ready;
+   std::chrono::steady_clock::time_point _execution_start;
+
+   std::mutex _mutex;
+   std::condition_variable _execution_started;
+   std::condition_variable _execution_finished;
+   unsigned int _execution_index;
+   int _busy_thread_count;
+   bool _quit;
+};
+
+}
@@ -3,7 +3,7 @@
 #include "GLTexture.h"
 #include "GLDevice.h"
 #include "GLProgram.h"
-#include "GLGPUTimer.h"
+#include "Profiler.h"
 #include "GLSampler.h"
 #include "glsl_volumetric_fog_defines.h"
 #include "glsl_global_defines.h"
@@ -35,13 +35,9 @@ VolumetricFog::~VolumetricFog(){}
 void VolumetricFog::render(const RenderData& render_data)
 {
    if (!_settings.fog_enabled)
-   {
-      _rr.volumetric_fog_timer->start();
-      _rr.volumetric_fog_timer->stop();
       return;
-   }
    
-   _rr.volumetric_fog_timer->start();
+   GPUProfileZone profile_zone("volumetric fog");
 
    GLDevice::bindProgram(*_fog_lighting_program);
    GLDevice::bindImage(BI_INSCATTERING_EXTINCTION_VOLUME_IMAGE, *_inscattering_extinction_volume, GL_WRITE_ONLY);
@@ -65,8 +61,6 @@ void VolumetricFog::render(const RenderData& render_data)
    glUniform4f(BI_FRUSTUM, render_data.frustum.left, render_data.frustum.right, render_data.frustum.bottom, render_data.frustum.top);
    
    glDispatchCompute(_fog_volume_size.x/16, _fog_volume_size.y/16, 1);
-
-   _rr.volumetric_fog_timer->stop();
 }
 
 void VolumetricFog::renderLightSprites(const RenderData& render_data, const Scene& scene)
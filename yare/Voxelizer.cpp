@@ -10,7 +10,7 @@
 #include "GLProgram.h"
 #include "GLDevice.h"
 #include "GLBuffer.h"
-#include "GLGPUTimer.h"
+#include "Profiler.h"
 #include "RenderEngine.h"
 #include "RenderResources.h"
 #include "Scene.h"
@@ -159,7 +159,7 @@ Voxelizer::~Voxelizer() {}
 
 void Voxelizer::bakeVoxels(RenderEngine* render_engine, const RenderData& render_data)
 {
-   _rr.voxelize_timer->start();
+   Profiler::beginGPUZone("voxelize");
    GLDevice::bindFramebuffer(_empty_framebuffer.get(), 0);
    //GLDevice::bindFramebuffer(_rr.main_framebuffer.get(), 0);
    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
@@ -207,7 +207,7 @@ void Voxelizer::bakeVoxels(RenderEngine* render_engine, const RenderData& render
    glDispatchCompute(_texture_size / 4, _texture_size / 4, _texture_size / 4);
 
    glMemoryBarrier(GL_ALL_BARRIER_BITS);
-   _rr.voxelize_timer->stop();
+   Profiler::endGPUZone();
 }
 
 void Voxelizer::debugDrawVoxels(const RenderData& render_data)
@@ -234,7 +234,7 @@ void Voxelizer::traceGlobalIlluminationRays(const RenderData& render_data)
    /*float clear_color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
    glClearTexImage(_voxels_illumination->id(), 0, GL_RGBA, GL_FLOAT, clear_color);
    glMemoryBarrier(GL_ALL_BARRIER_BITS);*/
-   _rr.raytrace_timer->start();
+   Profiler::beginGPUZone("trace gi rays");
    // fixme glviewport
    GLDevice::bindFramebuffer(_gi_framebuffer.get(), 0);
    GLDevice::bindProgram(*_trace_gi_rays);
@@ -248,7 +248,7 @@ void Voxelizer::traceGlobalIlluminationRays(const RenderData& render_data)
    GLDevice::draw(*_rr.fullscreen_triangle_source);
 
    gatherGlobalIllumination();
-   _rr.raytrace_timer->stop();   
+   Profiler::endGPUZone();
 }
 
 void Voxelizer::gatherGlobalIllumination()
@@ -0,0 +1,53 @@
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ ComputeShader ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#include "glsl_occlusion_culling_defines.h"
+
+// every texel of the pyramid holds the farthest depth of the depth buffer texels it covers
+
+layout(local_size_x = HIZ_TILE_WIDTH, local_size_y = HIZ_TILE_WIDTH) in;
+
+layout(binding = BI_HIZ_OUTPUT_IMAGE, r32f) uniform restrict writeonly image2D output_level;
+
+#ifdef COPY_DEPTH
+
+layout(binding = BI_DEPTH_TEXTURE) uniform sampler2D depth_texture;
+
+void main()
+{
+   ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+   if (any(greaterThanEqual(texel, imageSize(output_level))))
+      return;
+
+   imageStore(output_level, texel, vec4(texelFetch(depth_texture, texel, 0).r));
+}
+
+#else
+
+layout(binding = BI_HIZ_INPUT_IMAGE, r32f) uniform restrict readonly image2D input_level;
+
+void main()
+{
+   ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+   ivec2 output_size = imageSize(output_level);
+   if (any(greaterThanEqual(texel, output_size)))
+      return;
+
+   // the last row and column of an odd sized level also cover the texels the halved size leaves out
+   ivec2 input_size = imageSize(input_level);
+   ivec2 first = 2 * texel;
+   ivec2 last = min(first + 1, input_size - 1);
+   if (texel.x == output_size.x - 1)
+      last.x = input_size.x - 1;
+   if (texel.y == output_size.y - 1)
+      last.y = input_size.y - 1;
+
+   float farthest_depth = 0.0;
+   for (int y = first.y; y <= last.y; ++y)
+   {
+      for (int x = first.x; x <= last.x; ++x)
+         farthest_depth = max(farthest_depth, imageLoad(input_level, ivec2(x, y)).r);
+   }
+
+   imageStore(output_level, texel, vec4(farthest_depth));
+}
+
+#endif
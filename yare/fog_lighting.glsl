@@ -31,22 +31,19 @@ void main()
 
    FroxelLightLists froxel_light_lists = fetchCurrentFroxelLightLists(froxel_coords01);  
 
-   unsigned int start_offset = froxel_light_lists.start_offset;
    vec3 in_scattered_radiance = vec3(0.0);
    
-   for (unsigned int i = 0; i < froxel_light_lists.sphere_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_SPHERE); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       in_scattered_radiance += sphereLightIncidentRadiance(sphere_lights[light_index], froxel_center_in_world, froxel_length);
    }
-   start_offset += froxel_light_lists.sphere_light_count;
 
-   for (unsigned int i = 0; i < froxel_light_lists.spot_light_count; ++i)
+   for (LightListIterator it = beginLightList(froxel_light_lists, LIGHT_TYPE_SPOT); nextLight(it); )
    {
-      int light_index = light_list_data[start_offset + i];
+      int light_index = it.light_index;
       in_scattered_radiance += spotLightIncidentRadiance(spot_lights[light_index], froxel_center_in_world, froxel_length);
    }
-   start_offset += froxel_light_lists.spot_light_count;
 
    in_scattered_radiance += textureLod(sky_diffuse_cubemap, vec3(0, 0, 1), 0).rgb;
    in_scattered_radiance *= scattering * 1 / (4 * PI);
@@ -12,7 +12,6 @@
 
 // uniforms buffers
 #define BI_SCENE_UNIFORMS 1
-#define BI_SURFACE_DYNAMIC_UNIFORMS 2
 
 // ssbos
 #define BI_EXPOSURE_VALUES_SSBO 4
@@ -22,4 +21,10 @@
 #define BI_SUN_LIGHTS_SSBO 8
 #define BI_LIGHT_LIST_DATA_SSBO 9
 #define BI_HAMMERSLEY_SAMPLES_SSBO 10
-#define BI_SKINNING_PALETTE_SSBO 11
\ No newline at end of file
+#define BI_SKINNING_PALETTE_SSBO 11
+#define BI_LIGHT_LIST_HEAD_SSBO 12
+#define BI_SURFACE_DYNAMIC_UNIFORMS_SSBO 13
+#define BI_DRAW_SURFACE_INDICES_SSBO 14
+
+// uniforms
+#define BI_SURFACE_DRAW_BASE 40
\ No newline at end of file
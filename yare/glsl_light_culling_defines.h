@@ -0,0 +1,16 @@
+#pragma once
+
+// images
+#define BI_LIGHT_LIST_HEAD_IMAGE 0
+
+// ssbos
+#define BI_LIGHT_LIST_SIZE_SSBO 0
+#define BI_CULLED_LIGHTS_SSBO 1
+
+// uniforms
+#define BI_MATRIX_PROJ_VIEW 0
+#define BI_FRUSTUM 4
+#define BI_ZNEAR_ZFAR 5
+#define BI_FROXEL_Z_DISTRIBUTION_FACTOR 6
+#define BI_MAX_LIGHTS_PER_FROXEL 7
+#define BI_LIGHT_LIST_CAPACITY 8
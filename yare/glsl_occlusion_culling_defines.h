@@ -0,0 +1,22 @@
+#pragma once
+
+// textures
+#define BI_DEPTH_TEXTURE 0
+#define BI_HIZ_TEXTURE 1
+
+// images
+#define BI_HIZ_INPUT_IMAGE 0
+#define BI_HIZ_OUTPUT_IMAGE 1
+
+// ssbos
+#define BI_DRAW_COMMANDS_SSBO 0
+#define BI_SECOND_PHASE_DRAW_COMMANDS_SSBO 1
+#define BI_SURFACE_VISIBILITY_SSBO 2
+
+// uniforms
+#define BI_FIRST_DRAW 0
+#define BI_DRAW_COUNT 1
+#define BI_HIZ_LEVEL_COUNT 2
+
+#define OCCLUSION_CULLING_GROUP_SIZE 64
+#define HIZ_TILE_WIDTH 8
@@ -0,0 +1,190 @@
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ ComputeShader ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#include "glsl_light_culling_defines.h"
+#include "glsl_global_defines.h"
+#include "lighting_uniforms.glsl"
+
+layout(binding = BI_LIGHT_LIST_HEAD_IMAGE, rgba32ui) uniform restrict writeonly uimage3D light_list_head_image;
+
+layout(std430, binding = BI_LIGHT_LIST_SIZE_SSBO) buffer LightListSizeSSBO
+{
+   uint light_list_size;
+};
+
+// the lights with the froxel range and the planes of the cpu injection, see GPUCulledLight in ClusteredLightCuller.cpp
+struct CulledLight
+{
+   ivec4 froxel_min; // w is 1 when the light is tested against its view space sphere, held by planes[0]
+   ivec4 froxel_max;
+   vec4 planes[6];   // clip space bounding planes
+};
+
+layout(std430, binding = BI_CULLED_LIGHTS_SSBO) readonly buffer CulledLightsSSBO
+{
+   ivec4 first_culled_lights; // first light of each type, the light count in w
+   CulledLight culled_lights[];
+};
+
+layout(location = BI_MATRIX_PROJ_VIEW) uniform mat4 matrix_proj_view;
+layout(location = BI_FRUSTUM) uniform vec4 frustum;
+layout(location = BI_ZNEAR_ZFAR) uniform vec2 znear_zfar;
+layout(location = BI_FROXEL_Z_DISTRIBUTION_FACTOR) uniform float froxel_z_distribution_factor;
+layout(location = BI_MAX_LIGHTS_PER_FROXEL) uniform uint max_lights_per_froxel;
+layout(location = BI_LIGHT_LIST_CAPACITY) uniform uint light_list_capacity;
+
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+// The same froxel bounds as the cpu injection: the clip space aabb of _updateMacroFroxelInfo
+// and the view space aabb and side planes of _updateMacroFroxelViewSpaceInfo
+struct FroxelBounds
+{
+   vec3 center_cs;
+   vec3 extent_cs;
+   vec3 min_vs;
+   vec3 max_vs;
+   vec2 left_normal_vs;
+   vec2 right_normal_vs;
+   vec2 bottom_normal_vs;
+   vec2 top_normal_vs;
+};
+
+// the clip space froxels use the distribution factor rounded down to an integer power, as _convertFroxelZtoCameraZ
+vec3 froxelCorner(vec3 froxel_coords01)
+{
+   float z = froxel_coords01.z;
+   for (int i = 0; i < int(froxel_z_distribution_factor) - 1; ++i)
+      z = z * froxel_coords01.z;
+
+   float depth = mix(znear_zfar.x, znear_zfar.y, z);
+   float ratio = depth / znear_zfar.x;
+   return vec3(mix(frustum.x, frustum.y, froxel_coords01.x) * ratio, mix(frustum.z, frustum.w, froxel_coords01.y) * ratio, -depth);
+}
+
+vec3 project(vec3 point)
+{
+   vec4 point_hs = matrix_proj_view * vec4(point, 1.0);
+   return point_hs.xyz / point_hs.w;
+}
+
+FroxelBounds froxelBounds(ivec3 froxel, ivec3 froxels_dims)
+{
+   FroxelBounds bounds;
+   vec3 rcp_froxels_dims = 1.0 / vec3(froxels_dims);
+   vec3 aabb_min = project(froxelCorner(vec3(froxel) * rcp_froxels_dims));
+   vec3 aabb_max = project(froxelCorner(vec3(froxel + ivec3(1)) * rcp_froxels_dims));
+   bounds.center_cs = 0.5 * (aabb_min + aabb_max);
+   bounds.extent_cs = 0.5 * (aabb_max - aabb_min);
+
+   float depth_min = mix(znear_zfar.x, znear_zfar.y, pow(float(froxel.z) / froxels_dims.z, froxel_z_distribution_factor));
+   float depth_max = mix(znear_zfar.x, znear_zfar.y, pow(float(froxel.z + 1) / froxels_dims.z, froxel_z_distribution_factor));
+
+   // froxel bounds on the near plane, they scale with depth / near
+   float left = mix(frustum.x, frustum.y, float(froxel.x) / froxels_dims.x);
+   float right = mix(frustum.x, frustum.y, float(froxel.x + 1) / froxels_dims.x);
+   float bottom = mix(frustum.z, frustum.w, float(froxel.y) / froxels_dims.y);
+   float top = mix(frustum.z, frustum.w, float(froxel.y + 1) / froxels_dims.y);
+
+   float rcp_near = 1.0 / znear_zfar.x;
+   bounds.min_vs = vec3(min(left * depth_min, left * depth_max) * rcp_near, min(bottom * depth_min, bottom * depth_max) * rcp_near, -depth_max);
+   bounds.max_vs = vec3(max(right * depth_min, right * depth_max) * rcp_near, max(top * depth_min, top * depth_max) * rcp_near, -depth_min);
+
+   bounds.left_normal_vs = normalize(vec2(znear_zfar.x, left));
+   bounds.right_normal_vs = -normalize(vec2(znear_zfar.x, right));
+   bounds.bottom_normal_vs = normalize(vec2(znear_zfar.x, bottom));
+   bounds.top_normal_vs = -normalize(vec2(znear_zfar.x, top));
+
+   return bounds;
+}
+
+// _aabbOverlapsFroxel: the light bounding planes against the froxel clip space aabb
+bool planesOverlapFroxel(CulledLight light, FroxelBounds froxel)
+{
+   bool overlap = true;
+   for (int i = 0; i < 6; ++i)
+   {
+      float d = dot(froxel.center_cs, light.planes[i].xyz);
+      float r = dot(froxel.extent_cs, abs(light.planes[i].xyz));
+      overlap = overlap && (d + r >= -light.planes[i].w);
+   }
+   return overlap;
+}
+
+// _sphereOverlapsFroxel: the sphere against the froxel view space aabb and its 4 side planes
+bool sphereOverlapsFroxel(vec3 sphere_center, float sphere_radius, FroxelBounds froxel)
+{
+   vec3 to_closest_point = max(froxel.min_vs, min(sphere_center, froxel.max_vs)) - sphere_center;
+   return dot(to_closest_point, to_closest_point) <= sphere_radius * sphere_radius
+      && dot(froxel.left_normal_vs, sphere_center.xz) >= -sphere_radius
+      && dot(froxel.right_normal_vs, sphere_center.xz) >= -sphere_radius
+      && dot(froxel.bottom_normal_vs, sphere_center.yz) >= -sphere_radius
+      && dot(froxel.top_normal_vs, sphere_center.yz) >= -sphere_radius;
+}
+
+int lightCount(int light_type)
+{
+   return (light_type == LIGHT_TYPE_SPOT ? first_culled_lights.w : first_culled_lights[light_type + 1]) - first_culled_lights[light_type];
+}
+
+bool lightOverlapsFroxel(int light_type, int light_index, ivec3 froxel, FroxelBounds froxel_bounds)
+{
+   CulledLight light = culled_lights[first_culled_lights[light_type] + light_index];
+   if (any(lessThan(froxel, light.froxel_min.xyz)) || any(greaterThan(froxel, light.froxel_max.xyz)))
+      return false;
+
+   if (light.froxel_min.w != 0)
+      return sphereOverlapsFroxel(light.planes[0].xyz, light.planes[0].w, froxel_bounds);
+   return planesOverlapFroxel(light, froxel_bounds);
+}
+
+// counts the lights overlapping the froxel, and writes them in the light list data if write_offset is valid
+uint cullLights(int light_type, ivec3 froxel, FroxelBounds froxel_bounds, int write_offset)
+{
+   uint count = 0u;
+   int light_count = lightCount(light_type);
+   for (int i = 0; i < light_count && count < max_lights_per_froxel; ++i)
+   {
+      if (lightOverlapsFroxel(light_type, i, froxel, froxel_bounds))
+      {
+         if (write_offset >= 0)
+            light_list_data[write_offset + int(count)] = i;
+         count++;
+      }
+   }
+
+   return count;
+}
+
+void main()
+{
+   ivec3 froxel = ivec3(gl_GlobalInvocationID.xyz);
+   ivec3 froxels_dims = imageSize(light_list_head_image);
+   if (any(greaterThanEqual(froxel, froxels_dims)))
+      return;
+
+   FroxelBounds froxel_bounds = froxelBounds(froxel, froxels_dims);
+
+   // first pass counts the lights to reserve the list, the second one writes it
+   uint sphere_light_count = cullLights(LIGHT_TYPE_SPHERE, froxel, froxel_bounds, -1);
+   uint spot_light_count = cullLights(LIGHT_TYPE_SPOT, froxel, froxel_bounds, -1);
+   uint rectangle_light_count = cullLights(LIGHT_TYPE_RECTANGLE, froxel, froxel_bounds, -1);
+
+   uint list_size = sphere_light_count + spot_light_count + rectangle_light_count;
+   uint start_offset = atomicAdd(light_list_size, list_size);
+   if (start_offset + list_size > light_list_capacity)
+   {
+      sphere_light_count = 0u;
+      spot_light_count = 0u;
+      rectangle_light_count = 0u;
+   }
+   else
+   {
+      // same order as the cpu lists: sphere, spot, rectangle
+      int offset = int(start_offset);
+      cullLights(LIGHT_TYPE_SPHERE, froxel, froxel_bounds, offset);
+      offset += int(sphere_light_count);
+      cullLights(LIGHT_TYPE_SPOT, froxel, froxel_bounds, offset);
+      offset += int(spot_light_count);
+      cullLights(LIGHT_TYPE_RECTANGLE, froxel, froxel_bounds, offset);
+   }
+
+   imageStore(light_list_head_image, froxel, uvec4(start_offset, sphere_light_count, spot_light_count, rectangle_light_count));
+}
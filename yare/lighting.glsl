@@ -88,13 +88,105 @@ FroxelLightLists fetchCurrentFroxelLightLists(vec3 pos_in_frustum)
 
    ivec3 current_froxel_coords = ivec3(light_froxels_dims * vec3((p.xy+1.0)*0.5, froxel_z));*/
 
-   uvec2 froxel_data = texelFetch(light_list_head, current_froxel_coords, 0).xy;
-   
    FroxelLightLists froxel_light_lists;
+   if (light_culling_mode == LIGHT_CULLING_ZBINNED)
+   {
+      current_froxel_coords = min(current_froxel_coords, light_froxels_dims - 1);
+      froxel_light_lists.zbin = current_froxel_coords.z;
+      froxel_light_lists.tile = current_froxel_coords.x + current_froxel_coords.y * light_froxels_dims.x;
+      return froxel_light_lists;
+   }
+
+   uvec4 froxel_data;
+   if (light_list_heads_in_ssbo != 0)
+   {
+      current_froxel_coords = min(current_froxel_coords, light_froxels_dims - 1);
+      int head_component_count = (light_counts_packed != 0) ? 2 : 4;
+      int head_offset = head_component_count * (current_froxel_coords.x + light_froxels_dims.x * (current_froxel_coords.y + light_froxels_dims.y * current_froxel_coords.z));
+      froxel_data.xy = uvec2(light_list_heads[head_offset], light_list_heads[head_offset + 1]);
+      froxel_data.zw = (light_counts_packed != 0) ? uvec2(0) : uvec2(light_list_heads[head_offset + 2], light_list_heads[head_offset + 3]);
+   }
+   else
+   {
+      froxel_data = texelFetch(light_list_head, current_froxel_coords, 0);
+   }
    froxel_light_lists.start_offset = froxel_data.x;
-   froxel_light_lists.sphere_light_count = froxel_data.y & 0x3FF;
-   froxel_light_lists.spot_light_count = (froxel_data.y >> 10) & 0x3FF;
-   froxel_light_lists.rectangle_light_count = (froxel_data.y >> 20) & 0x3FF;
+   if (light_counts_packed != 0)
+   {
+      froxel_light_lists.sphere_light_count = froxel_data.y & 0x3FF;
+      froxel_light_lists.spot_light_count = (froxel_data.y >> 10) & 0x3FF;
+      froxel_light_lists.rectangle_light_count = (froxel_data.y >> 20) & 0x3FF;
+   }
+   else
+   {
+      froxel_light_lists.sphere_light_count = froxel_data.y;
+      froxel_light_lists.spot_light_count = froxel_data.z;
+      froxel_light_lists.rectangle_light_count = froxel_data.w;
+   }
 
    return froxel_light_lists;
 }
+
+LightListIterator beginLightList(FroxelLightLists froxel_light_lists, int light_type)
+{
+   LightListIterator it;
+   it.light_type = light_type;
+   it.bits = 0u;
+
+   if (light_culling_mode == LIGHT_CULLING_ZBINNED)
+   {
+      int zbin_offset = light_zbins_offset + (froxel_light_lists.zbin * 3 + light_type) * 2;
+      it.zbin_first = light_list_data[zbin_offset];
+      it.zbin_last = light_list_data[zbin_offset + 1];
+      it.next = (it.zbin_first >> 5) - 1;
+      it.last = it.zbin_last >> 5;
+      it.tile_mask_start = light_tile_masks_offset[light_type] + froxel_light_lists.tile * light_tile_mask_word_count[light_type];
+   }
+   else
+   {
+      // the lists of a froxel are stored one after the other: sphere, spot, rectangle
+      it.next = int(froxel_light_lists.start_offset);
+      if (light_type != LIGHT_TYPE_SPHERE)
+         it.next += int(froxel_light_lists.sphere_light_count);
+      if (light_type == LIGHT_TYPE_RECTANGLE)
+         it.next += int(froxel_light_lists.spot_light_count);
+
+      if (light_type == LIGHT_TYPE_SPHERE)
+         it.last = it.next + int(froxel_light_lists.sphere_light_count) - 1;
+      else if (light_type == LIGHT_TYPE_SPOT)
+         it.last = it.next + int(froxel_light_lists.spot_light_count) - 1;
+      else
+         it.last = it.next + int(froxel_light_lists.rectangle_light_count) - 1;
+   }
+
+   return it;
+}
+
+bool nextLight(inout LightListIterator it)
+{
+   if (light_culling_mode == LIGHT_CULLING_ZBINNED)
+   {
+      // the lights of the tile are intersected with the range of the z bin, one 32 bits word at a time
+      while (it.bits == 0u)
+      {
+         it.next++;
+         if (it.next > it.last)
+            return false;
+
+         int first_bit = max(it.zbin_first - it.next * 32, 0);
+         int last_bit = min(it.zbin_last - it.next * 32, 31);
+         uint range_mask = (0xFFFFFFFFu << first_bit) & (0xFFFFFFFFu >> (31 - last_bit));
+         it.bits = uint(light_list_data[it.tile_mask_start + it.next]) & range_mask;
+      }
+
+      int bit = findLSB(it.bits);
+      it.bits &= it.bits - 1u;
+      it.light_index = light_list_data[light_sorted_lights_offset[it.light_type] + it.next * 32 + bit];
+      return true;
+   }
+
+   if (it.next > it.last)
+      return false;
+   it.light_index = light_list_data[it.next++];
+   return true;
+}
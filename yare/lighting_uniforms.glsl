@@ -36,17 +36,39 @@ struct SunLight
    int padding1;
 };
 
+#define LIGHT_TYPE_SPHERE 0
+#define LIGHT_TYPE_RECTANGLE 1
+#define LIGHT_TYPE_SPOT 2
+
+#define LIGHT_CULLING_FROXEL_LISTS 0
+#define LIGHT_CULLING_ZBINNED 1
+
 layout(binding = BI_LIGHT_LIST_HEAD) uniform usampler3D light_list_head;
 
+// same content as the light_list_head texture, read directly from the buffer written by the cpu
+layout(std430, binding = BI_LIGHT_LIST_HEAD_SSBO) readonly buffer LightListHeadSSBO
+{
+   uint light_list_heads[];
+};
+
+// in z-binned mode light_froxels_dims is the tiles count in x,y and the z bins count in z
 layout(std430, binding = BI_LIGHT_LIST_DATA_SSBO) buffer LightDataSSBO
 {
+   ivec3 light_froxels_dims;
+   int light_counts_packed;
+   int light_culling_mode;
+   int light_zbins_offset;
+   int light_list_heads_in_ssbo;
+   int padding_light_list;
+   ivec4 light_sorted_lights_offset;
+   ivec4 light_tile_masks_offset;
+   ivec4 light_tile_mask_word_count;
    int light_list_data[];
 };
 
 layout(std430, binding = BI_SPHERE_LIGHTS_SSBO) buffer SphereLightsSSBO
 {
-   ivec3 light_froxels_dims;
-   int padding0;
+   ivec4 padding0;
    SphereLight sphere_lights[];
 };
 
@@ -70,8 +92,24 @@ layout(std430, binding = BI_SUN_LIGHTS_SSBO) buffer SunLightsSSBO
 
 struct FroxelLightLists
 {
-   unsigned int start_offset;
-   unsigned int sphere_light_count;
-   unsigned int spot_light_count;
-   unsigned int rectangle_light_count;
+   uint start_offset;
+   uint sphere_light_count;
+   uint spot_light_count;
+   uint rectangle_light_count;
+   int zbin;
+   int tile;
+};
+
+struct LightListIterator
+{
+   int light_type;
+   int light_index;
+   // froxel lists: offsets into light_list_data. z-binned: bitmask words of the tile
+   int next;
+   int last;
+   // z-binned: range of the sorted lights in the z bin, and lights of the current word not visited yet
+   int zbin_first;
+   int zbin_last;
+   int tile_mask_start;
+   uint bits;
 };
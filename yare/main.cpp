@@ -6,9 +6,12 @@
 #include <assert.h>
 #include <iostream>
 #include <atomic>
-#include <future>
+#include <algorithm>
+#include <mutex>
+#include <thread>
 
 #include "GLBuffer.h"
+#include "RenderDataMailbox.h"
 #include "RenderEngine.h"
 #include "ClusteredLightCuller.h"
 #include "CameraManipulator.h"
@@ -21,8 +24,9 @@
 #include "Raytracer.h"
 #include "AppGui.h"
 #include "RenderResources.h"
-#include "GLGPUTimer.h"
 #include "Voxelizer.h"
+#include "HeadlessBenchmark.h"
+#include "Profiler.h"
 
 
 using namespace yare;
@@ -136,9 +140,21 @@ float updateScene(RenderEngine* render_engine, int data_index, GLFWwindow* updat
 float renderScene(RenderEngine* render_engine, int data_index, AppGui* app_gui, GLFWwindow* render_context);
 
 #define MULTITHREADED_RENDER
+#define HEADLESS_BENCHMARK // yare --headless, --compare-light-culling and --test-light-culling, see HeadlessBenchmark.h
+#define UPDATE_RATE 60 // simulation ticks per second, the render runs at the display rate
+#define DYNAMIC_BUFFER_SEGMENT_COUNT 4 // written, published, read, and retired while the gpu runs, deeper gpu queues need more to avoid stalls
 
-int main()
+int main(int argc, char** argv)
 {
+#ifdef HEADLESS_BENCHMARK
+   if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+      return runHeadlessBenchmark(argc - 2, argv + 2, DYNAMIC_BUFFER_SEGMENT_COUNT);
+   if (argc > 1 && strcmp(argv[1], "--compare-light-culling") == 0)
+      return runLightCullingComparison(argc - 2, argv + 2, DYNAMIC_BUFFER_SEGMENT_COUNT);
+   if (argc > 1 && strcmp(argv[1], "--test-light-culling") == 0)
+      return runLightCullingTest(DYNAMIC_BUFFER_SEGMENT_COUNT);
+#endif
+
    if (!glfwInit())
    {
       fprintf(stderr, "glfw: failed to initialize\n");
@@ -151,18 +167,20 @@ int main()
       return -1;
    }
 
+   Profiler::setThreadName("render");
+
    GLFWwindow* window;
    GLFWwindow* update_context;
    createContexts(&window, &update_context);
+   GLDynamicBuffer::setSegmentCount(DYNAMIC_BUFFER_SEGMENT_COUNT);
+   RenderDataMailbox render_data_mailbox;
    
    RenderEngine render_engine(ImageSize(1500, 1000));
 
    AppGui app_gui(window, &render_engine);
-
-   CameraManipulator camera_manipulator(&render_engine.scene()->camera.point_of_view);
     
    //char* file = "D:\\BlenderTests\\Sintel_Lite_Cycles_V2.3dy";
-   char* file = "D:\\BlenderTests\\stanford_bunny.3dy";
+   char* file = argc > 1 ? argv[1] : "D:\\BlenderTests\\stanford_bunny.3dy";
    //char* file = "D:\\BlenderTests\\DeLorean.3dy";
    //char* file = "D:\\BlenderTests\\test_clustered_shading.3dy";
    import3DY(file, render_engine, render_engine.scene());
@@ -172,9 +190,43 @@ int main()
 
    glfwShowWindow(window);
 
-   int update_index = 0;
-   int render_index = 1;
-   updateScene(&render_engine, render_index, update_context); // bootstrap the update/render multithreaded cycle
+   // the inputs move this camera, the update copies it into the scene when it starts
+   std::mutex camera_mutex;
+   PointOfView camera_input = render_engine.scene()->camera.point_of_view;
+   CameraManipulator camera_manipulator(&camera_input);
+
+   // held by the update while it runs, the render thread changes the scene configuration when the update waits for its next tick
+   std::mutex update_mutex;
+   auto updateSnapshot = [&]()
+   {
+      std::lock_guard<std::mutex> lock(update_mutex);
+      {
+         std::lock_guard<std::mutex> camera_lock(camera_mutex);
+         render_engine.scene()->camera.point_of_view = camera_input;
+      }
+      float update_duration = updateScene(&render_engine, render_data_mailbox.writeSlot(), update_context);
+      render_data_mailbox.publish();
+      return update_duration;
+   };
+
+#ifdef MULTITHREADED_RENDER
+   // the update runs at a fixed rate and the render draws the latest snapshot it published, none waits for the other
+   std::atomic<float> update_duration(updateSnapshot()); // the render always has a snapshot to read
+   std::atomic<bool> quit_update(false);
+   std::thread update_thread([&]()
+   {
+      Profiler::setThreadName("update");
+      const auto tick_period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / UPDATE_RATE));
+      auto next_tick = std::chrono::steady_clock::now() + tick_period;
+      while (!quit_update)
+      {
+         std::this_thread::sleep_until(next_tick);
+         update_duration = updateSnapshot();
+         // a late update does not try to catch up
+         next_tick = std::max(next_tick + tick_period, std::chrono::steady_clock::now());
+      }
+   });
+#endif
 
    int i = 0;
    while (!glfwWindowShouldClose(window))
@@ -182,31 +234,35 @@ int main()
       glfwPollEvents();
       if (!app_gui.hasMouseFocus())
       {
+         std::lock_guard<std::mutex> camera_lock(camera_mutex);
          handleInputs(window, &camera_manipulator);
-         if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
-            render_engine.froxeled_light_culler->debugUpdateFroxeledGrid(render_engine.scene()->render_data[render_index]);
       }
-                
-      GLDynamicBuffer::moveActiveSegments();
-           
-#ifdef MULTITHREADED_RENDER
-      // we run at the same time the render of the current frame and the update of the next one
-      auto next_frame_scene_update_fence = std::async(updateScene, &render_engine, update_index, update_context);
-      float render_duration = renderScene(&render_engine, render_index, &app_gui, window);      
-      float update_duration = next_frame_scene_update_fence.get();
-      // end of multithreaded section
-#else
-      float update_duration = updateScene(&render_engine, render_index, update_context);
-      float render_duration = renderScene(&render_engine, render_index, &app_gui, window);      
+
+      {
+         std::unique_lock<std::mutex> lock(update_mutex, std::try_to_lock);
+         if (lock.owns_lock())
+         {
+            if (!app_gui.hasMouseFocus() && glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
+               render_engine.froxeled_light_culler->debugUpdateFroxeledGrid(render_engine.scene()->render_data[render_data_mailbox.readSlot()]);
+            render_engine.froxeled_light_culler->updateGridConfiguration(*render_engine.scene());
+         }
+      }
+
+#ifndef MULTITHREADED_RENDER
+      float update_duration = updateSnapshot();
 #endif
+      // when no new snapshot was published since the last frame, the same one is rendered again
+      render_data_mailbox.consume();
+      float render_duration = renderScene(&render_engine, render_data_mailbox.readSlot(), &app_gui, window);
                   
       if ( (i++) % 60 == 0 )
          app_gui.reportCPUTimings(render_duration*1000.0f, update_duration*1000.0f);
+   }
 
 #ifdef MULTITHREADED_RENDER
-      std::swap(update_index, render_index);
+   quit_update = true;
+   update_thread.join();
 #endif
-   }
 
    glfwTerminate();
    return 0;
@@ -238,10 +294,10 @@ float renderScene(RenderEngine* render_engine, int data_index, AppGui* app_gui,
    render_engine->renderScene(render_engine->scene()->render_data[data_index]);
    //render_engine.presentDebugTexture();  
    app_gui->drawWidgets();
-   //std::cout << "r:" << render_engine->render_resources->material_pass_timer->elapsedTimeInMs() << std::endl;
    float render_duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
 
    glfwSwapBuffers(window);   
+   Profiler::endFrame();
    return render_duration;
 }
 
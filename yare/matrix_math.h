@@ -61,6 +61,19 @@ inline vec3 project(const mat4x4& matrix, const vec3& point)
    return vec_hs.xyz / vec3(vec_hs.w);
 }
 
+// left, right, bottom, top, near and far planes of the frustum of a projection matrix, normals point inside.
+// A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+inline void extractFrustumPlanes(const mat4& matrix_proj, vec4* planes)
+{
+   mat4 rows = transpose(matrix_proj);
+   planes[0] = rows[3] + rows[0];
+   planes[1] = rows[3] - rows[0];
+   planes[2] = rows[3] + rows[1];
+   planes[3] = rows[3] - rows[1];
+   planes[4] = rows[3] + rows[2];
+   planes[5] = rows[3] - rows[2];
+}
+
 inline vec3 extractScaling(const mat4x4& matrix)
 {
    return vec3(length(vec3(matrix[0].xyz)), length(vec3(matrix[1].xyz)), length(vec3(matrix[2].xyz)));
@@ -0,0 +1,105 @@
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ ComputeShader ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#include "glsl_global_defines.h"
+#include "glsl_occlusion_culling_defines.h"
+#include "scene_uniforms.glsl"
+#include "surface_uniforms.glsl"
+
+// LAST_FRAME_VISIBILITY: the multi draws only keep the surfaces visible last frame (first phase)
+// HIZ_TEST: tests the surfaces against the hi-z of the first phase depth, updates their visibility and writes
+//           the second phase draws of the visible surfaces the first phase did not draw
+// otherwise: the multi draws only keep the visible surfaces
+
+layout(local_size_x = OCCLUSION_CULLING_GROUP_SIZE) in;
+
+struct DrawElementsIndirectCommand
+{
+   uint count;
+   uint instance_count;
+   uint first_index;
+   int base_vertex;
+   uint base_instance;
+};
+
+layout(std430, binding = BI_DRAW_COMMANDS_SSBO) buffer DrawCommandsSSBO
+{
+   DrawElementsIndirectCommand draw_commands[];
+};
+
+layout(std430, binding = BI_SURFACE_VISIBILITY_SSBO) buffer SurfaceVisibilitySSBO
+{
+   uint surface_visibility[];
+};
+
+layout(location = BI_FIRST_DRAW) uniform int first_draw;
+layout(location = BI_DRAW_COUNT) uniform int draw_count;
+
+#ifdef HIZ_TEST
+
+layout(std430, binding = BI_SECOND_PHASE_DRAW_COMMANDS_SSBO) writeonly buffer SecondPhaseDrawCommandsSSBO
+{
+   DrawElementsIndirectCommand second_phase_draw_commands[];
+};
+
+layout(binding = BI_HIZ_TEXTURE) uniform sampler2D hiz_texture;
+layout(location = BI_HIZ_LEVEL_COUNT) uniform int hiz_level_count;
+
+bool isVisible(vec3 center, vec3 extent)
+{
+   vec3 ndc_min = vec3(1.0);
+   vec3 ndc_max = vec3(-1.0);
+   for (int i = 0; i < 8; ++i)
+   {
+      vec3 corner_sign = vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+      vec4 corner = matrix_proj_world * vec4(center + corner_sign * extent, 1.0);
+      if (corner.w <= 0.0)
+         return true; // crosses the camera plane
+
+      vec3 corner_ndc = corner.xyz / corner.w;
+      ndc_min = min(ndc_min, corner_ndc);
+      ndc_max = max(ndc_max, corner_ndc);
+   }
+
+   vec2 uv_min = clamp(0.5 * ndc_min.xy + 0.5, 0.0, 1.0);
+   vec2 uv_max = clamp(0.5 * ndc_max.xy + 0.5, 0.0, 1.0);
+   float nearest_depth = 0.5 * ndc_min.z + 0.5;
+
+   // the level where the screen rectangle covers at most 2x2 texels
+   vec2 rectangle_size = (uv_max - uv_min) * vec2(textureSize(hiz_texture, 0));
+   int level = int(ceil(log2(max(max(rectangle_size.x, rectangle_size.y), 1.0))));
+   level = min(level, hiz_level_count - 1);
+
+   ivec2 level_size = textureSize(hiz_texture, level);
+   ivec2 texel_min = min(ivec2(uv_min * vec2(level_size)), level_size - 1);
+   ivec2 texel_max = min(ivec2(uv_max * vec2(level_size)), level_size - 1);
+   float farthest_depth = max(max(texelFetch(hiz_texture, texel_min, level).r, texelFetch(hiz_texture, ivec2(texel_max.x, texel_min.y), level).r),
+                              max(texelFetch(hiz_texture, ivec2(texel_min.x, texel_max.y), level).r, texelFetch(hiz_texture, texel_max, level).r));
+
+   return nearest_depth <= farthest_depth;
+}
+
+#endif
+
+void main()
+{
+   int draw = int(gl_GlobalInvocationID.x);
+   if (draw >= draw_count)
+      return;
+
+   draw += first_draw;
+   int draw_surface = draw_surface_indices[draw];
+
+#if defined(LAST_FRAME_VISIBILITY)
+   draw_commands[draw].instance_count = surface_visibility[draw_surface];
+#elif defined(HIZ_TEST)
+   vec4 bounds_center = surface_uniforms[draw_surface].world_bounds_center;
+   bool visible = bounds_center.w == 0.0 || isVisible(bounds_center.xyz, surface_uniforms[draw_surface].world_bounds_extent.xyz);
+   bool drawn_by_first_phase = surface_visibility[draw_surface] != 0;
+
+   DrawElementsIndirectCommand command = draw_commands[draw];
+   command.instance_count = (visible && !drawn_by_first_phase) ? 1 : 0;
+   second_phase_draw_commands[draw] = command;
+   surface_visibility[draw_surface] = visible ? 1 : 0;
+#else
+   draw_commands[draw].instance_count = surface_visibility[draw_surface];
+#endif
+}
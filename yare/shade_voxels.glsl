@@ -28,13 +28,13 @@ void main()
    float voxel_length = (aabb_pmax.x-aabb_pmin.x)/voxel_grid_dim.x;
 
    vec3 irradiance = vec3(0.0);   
-   for (unsigned int i = 0; i < sphere_lights.length(); ++i)
+   for (uint i = 0; i < sphere_lights.length(); ++i)
    {
       vec3 light_dir = (sphere_lights[i].position - voxel_center_in_world);
       irradiance += sphereLightIncidentRadiance(sphere_lights[i], voxel_center_in_world, voxel_length) * saturate(dot(light_dir, normal));
    }
 
-   for (unsigned int i = 0; i < spot_lights.length(); ++i)
+   for (uint i = 0; i < spot_lights.length(); ++i)
    {   
       vec3 light_dir = (spot_lights[i].position - voxel_center_in_world);   
       irradiance += spotLightIncidentRadiance(spot_lights[i], voxel_center_in_world, voxel_length) * saturate(dot(light_dir, normal));
@@ -0,0 +1,42 @@
+#include "simd.h"
+
+#include <intrin.h>
+
+namespace yare {
+
+SimdInstructionSet detectSimdInstructionSet()
+{
+   int cpu_info[4];
+   __cpuid(cpu_info, 0);
+   int max_leaf = cpu_info[0];
+
+   __cpuid(cpu_info, 1);
+   bool os_uses_xsave = (cpu_info[2] & (1 << 27)) != 0;
+   bool cpu_has_avx = (cpu_info[2] & (1 << 28)) != 0;
+   if (!os_uses_xsave || !cpu_has_avx)
+      return SimdInstructionSet::SSE;
+
+   // the os must save the ymm (and zmm) registers on context switch, otherwise the cpu support is useless
+   unsigned long long xcr0 = _xgetbv(0);
+   bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+   bool os_saves_zmm = (xcr0 & 0xE6) == 0xE6;
+
+   bool cpu_has_avx512f = false;
+   if (max_leaf >= 7)
+   {
+      __cpuidex(cpu_info, 7, 0);
+      cpu_has_avx512f = (cpu_info[1] & (1 << 16)) != 0;
+   }
+
+#ifdef SIMD_AVX512
+   if (cpu_has_avx512f && os_saves_zmm)
+      return SimdInstructionSet::AVX512;
+#endif
+   // the 8 lanes path only uses avx float instructions, avx2 is not required
+   if (os_saves_ymm)
+      return SimdInstructionSet::AVX;
+   else
+      return SimdInstructionSet::SSE;
+}
+
+}
@@ -1,9 +1,27 @@
 #pragma once
 
-#include <xmmintrin.h>
+#include <immintrin.h>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
 
 namespace yare {
 
+using namespace glm;
+// the simd overloads of min and max must not hide the glm ones
+using glm::min;
+using glm::max;
+
+// the AVX-512 intrinsics are only available from VS2017 15.3 on
+#if !defined(_MSC_VER) || _MSC_VER >= 1911
+#define SIMD_AVX512
+#endif
+
+// Widest instruction set usable on the running cpu, the value is the number of float lanes
+enum class SimdInstructionSet { SSE = 4, AVX = 8, AVX512 = 16 };
+
+SimdInstructionSet detectSimdInstructionSet();
 
 /*****************  simdbool  *********************/
 
@@ -24,18 +42,25 @@ __forceinline const simdbool operator &=(simdbool& a, const simdbool& b) { retur
 __forceinline const simdbool operator |=(simdbool& a, const simdbool& b) { return a = a | b; }
 __forceinline const simdbool operator ^=(simdbool& a, const simdbool& b) { return a = a ^ b; }
 
+__forceinline int movemask(const simdbool& a) { return _mm_movemask_ps(a.val); }
+
 
 /*****************  simdfloat  *********************/
 
 _declspec(align(16))
 struct simdfloat
 {
+   static const int width = 4;
+   typedef simdbool bool_type;
+
    explicit simdfloat(float scalval) : val(_mm_set1_ps(scalval)) {  }
    simdfloat() {}
    simdfloat(__m128 val) : val(val) {}
 
-   void load(float* values) { val = _mm_load_ps(values); }
+   void load(const float* values) { val = _mm_load_ps(values); }
    void load(float a, float b, float c, float d) { val = _mm_set_ps(a, b, c, d); }
+   void store(float* values) const { _mm_store_ps(values, val); }
+   static void leaveSection() {}
 
    __m128 val;
 };
@@ -54,33 +79,167 @@ __forceinline const simdbool operator <=(const simdfloat& a, const simdfloat& b)
 
 __forceinline simdfloat abs(const simdfloat& a) { return _mm_and_ps(a.val, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))); }
 __forceinline simdfloat rcp(const simdfloat& a) { return _mm_rcp_ps(a.val); }
+__forceinline simdfloat min(const simdfloat& a, const simdfloat& b) { return _mm_min_ps(a.val, b.val); }
+__forceinline simdfloat max(const simdfloat& a, const simdfloat& b) { return _mm_max_ps(a.val, b.val); }
+
+
+/*****************  simdbool8 (AVX)  *********************/
+
+_declspec(align(32))
+struct simdbool8
+{
+   simdbool8(bool val) : val(_mm256_castsi256_ps(_mm256_set1_epi32((val ? 0xFFFFFFFF : 0x00000000)))) {}
+   simdbool8(__m256 val) : val(val) {}
+
+   __m256 val;
+};
+
+__forceinline const simdbool8 operator &(const simdbool8& a, const simdbool8& b) { return _mm256_and_ps(a.val, b.val); }
+__forceinline const simdbool8 operator |(const simdbool8& a, const simdbool8& b) { return _mm256_or_ps(a.val, b.val); }
+__forceinline const simdbool8 operator ^(const simdbool8& a, const simdbool8& b) { return _mm256_xor_ps(a.val, b.val); }
+
+__forceinline const simdbool8 operator &=(simdbool8& a, const simdbool8& b) { return a = a & b; }
+__forceinline const simdbool8 operator |=(simdbool8& a, const simdbool8& b) { return a = a | b; }
+__forceinline const simdbool8 operator ^=(simdbool8& a, const simdbool8& b) { return a = a ^ b; }
+
+__forceinline int movemask(const simdbool8& a) { return _mm256_movemask_ps(a.val); }
+
+
+/*****************  simdfloat8 (AVX)  *********************/
+
+_declspec(align(32))
+struct simdfloat8
+{
+   static const int width = 8;
+   typedef simdbool8 bool_type;
+
+   explicit simdfloat8(float scalval) : val(_mm256_set1_ps(scalval)) {  }
+   simdfloat8() {}
+   simdfloat8(__m256 val) : val(val) {}
+
+   void load(const float* values) { val = _mm256_loadu_ps(values); }
+   void store(float* values) const { _mm256_storeu_ps(values, val); }
+   static void leaveSection() { _mm256_zeroupper(); } // avoids avx/sse transition penalties in the following sse code
+
+   __m256 val;
+};
+
+__forceinline simdfloat8 operator *(const simdfloat8& a, const simdfloat8& b) { return _mm256_mul_ps(a.val, b.val); }
+__forceinline simdfloat8 operator -(const simdfloat8& a, const simdfloat8& b) { return _mm256_sub_ps(a.val, b.val); }
+__forceinline simdfloat8 operator +(const simdfloat8& a, const simdfloat8& b) { return _mm256_add_ps(a.val, b.val); }
+__forceinline simdfloat8 operator /(const simdfloat8& a, const simdfloat8& b) { return _mm256_div_ps(a.val, b.val); }
+
+__forceinline const simdfloat8 operator -(const simdfloat8& a) { return _mm256_xor_ps(a.val, _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000))); }
+
+__forceinline const simdbool8 operator >(const simdfloat8& a, const simdfloat8& b) { return _mm256_cmp_ps(a.val, b.val, _CMP_GT_OQ); }
+__forceinline const simdbool8 operator <(const simdfloat8& a, const simdfloat8& b) { return _mm256_cmp_ps(a.val, b.val, _CMP_LT_OQ); }
+__forceinline const simdbool8 operator >=(const simdfloat8& a, const simdfloat8& b) { return _mm256_cmp_ps(a.val, b.val, _CMP_GE_OQ); }
+__forceinline const simdbool8 operator <=(const simdfloat8& a, const simdfloat8& b) { return _mm256_cmp_ps(a.val, b.val, _CMP_LE_OQ); }
+
+__forceinline simdfloat8 abs(const simdfloat8& a) { return _mm256_and_ps(a.val, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))); }
+__forceinline simdfloat8 rcp(const simdfloat8& a) { return _mm256_rcp_ps(a.val); }
+__forceinline simdfloat8 min(const simdfloat8& a, const simdfloat8& b) { return _mm256_min_ps(a.val, b.val); }
+__forceinline simdfloat8 max(const simdfloat8& a, const simdfloat8& b) { return _mm256_max_ps(a.val, b.val); }
+
+
+#ifdef SIMD_AVX512
+
+/*****************  simdbool16 (AVX-512)  *********************/
+
+struct simdbool16
+{
+   simdbool16(bool val) : val(val ? 0xFFFF : 0x0000) {}
+   simdbool16(__mmask16 val) : val(val) {}
+
+   __mmask16 val;
+};
+
+__forceinline const simdbool16 operator &(const simdbool16& a, const simdbool16& b) { return __mmask16(a.val & b.val); }
+__forceinline const simdbool16 operator |(const simdbool16& a, const simdbool16& b) { return __mmask16(a.val | b.val); }
+__forceinline const simdbool16 operator ^(const simdbool16& a, const simdbool16& b) { return __mmask16(a.val ^ b.val); }
+
+__forceinline const simdbool16 operator &=(simdbool16& a, const simdbool16& b) { return a = a & b; }
+__forceinline const simdbool16 operator |=(simdbool16& a, const simdbool16& b) { return a = a | b; }
+__forceinline const simdbool16 operator ^=(simdbool16& a, const simdbool16& b) { return a = a ^ b; }
+
+__forceinline int movemask(const simdbool16& a) { return int(a.val); }
+
+
+/*****************  simdfloat16 (AVX-512)  *********************/
+
+_declspec(align(64))
+struct simdfloat16
+{
+   static const int width = 16;
+   typedef simdbool16 bool_type;
+
+   explicit simdfloat16(float scalval) : val(_mm512_set1_ps(scalval)) {  }
+   simdfloat16() {}
+   simdfloat16(__m512 val) : val(val) {}
+
+   void load(const float* values) { val = _mm512_loadu_ps(values); }
+   void store(float* values) const { _mm512_storeu_ps(values, val); }
+   static void leaveSection() { _mm256_zeroupper(); }
+
+   __m512 val;
+};
+
+__forceinline simdfloat16 operator *(const simdfloat16& a, const simdfloat16& b) { return _mm512_mul_ps(a.val, b.val); }
+__forceinline simdfloat16 operator -(const simdfloat16& a, const simdfloat16& b) { return _mm512_sub_ps(a.val, b.val); }
+__forceinline simdfloat16 operator +(const simdfloat16& a, const simdfloat16& b) { return _mm512_add_ps(a.val, b.val); }
+__forceinline simdfloat16 operator /(const simdfloat16& a, const simdfloat16& b) { return _mm512_div_ps(a.val, b.val); }
+
+// _mm512_xor_ps needs AVX512DQ, stay on AVX512F
+__forceinline const simdfloat16 operator -(const simdfloat16& a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.val), _mm512_set1_epi32(0x80000000))); }
+
+__forceinline const simdbool16 operator >(const simdfloat16& a, const simdfloat16& b) { return _mm512_cmp_ps_mask(a.val, b.val, _CMP_GT_OQ); }
+__forceinline const simdbool16 operator <(const simdfloat16& a, const simdfloat16& b) { return _mm512_cmp_ps_mask(a.val, b.val, _CMP_LT_OQ); }
+__forceinline const simdbool16 operator >=(const simdfloat16& a, const simdfloat16& b) { return _mm512_cmp_ps_mask(a.val, b.val, _CMP_GE_OQ); }
+__forceinline const simdbool16 operator <=(const simdfloat16& a, const simdfloat16& b) { return _mm512_cmp_ps_mask(a.val, b.val, _CMP_LE_OQ); }
+
+__forceinline simdfloat16 abs(const simdfloat16& a) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.val), _mm512_set1_epi32(0x7fffffff))); }
+__forceinline simdfloat16 rcp(const simdfloat16& a) { return _mm512_rcp14_ps(a.val); }
+__forceinline simdfloat16 min(const simdfloat16& a, const simdfloat16& b) { return _mm512_min_ps(a.val, b.val); }
+__forceinline simdfloat16 max(const simdfloat16& a, const simdfloat16& b) { return _mm512_max_ps(a.val, b.val); }
+
+#endif
+
 
 /*****************  simdvec3  *********************/
 
-struct simdvec3
+template<typename simdfloatT>
+struct simdvec3_t
 {
-   simdvec3() {}
-   explicit simdvec3(const simdfloat& f) : x(f), y(f), z(f) {}
-   explicit simdvec3(const vec3& v) : x(v.x), y(v.y), z(v.z) {}
-   simdvec3(simdfloat x, simdfloat y, simdfloat z) : x(x), y(y), z(z) {}
+   simdvec3_t() {}
+   explicit simdvec3_t(const simdfloatT& f) : x(f), y(f), z(f) {}
+   explicit simdvec3_t(const vec3& v) : x(v.x), y(v.y), z(v.z) {}
+   simdvec3_t(simdfloatT x, simdfloatT y, simdfloatT z) : x(x), y(y), z(z) {}
 
-   void load(float* xvalues, float* yvalues, float* zvalues, int offset) { x.load(xvalues + offset); y.load(yvalues + offset); z.load(zvalues + offset); }
+   void load(const float* xvalues, const float* yvalues, const float* zvalues, int offset) { x.load(xvalues + offset); y.load(yvalues + offset); z.load(zvalues + offset); }
 
-   simdfloat x;
-   simdfloat y;
-   simdfloat z;
+   simdfloatT x;
+   simdfloatT y;
+   simdfloatT z;
 };
 
-__forceinline simdvec3 operator *(const simdfloat& f, const simdvec3& b) { return simdvec3(f * b.x, f * b.y, f * b.z); }
+typedef simdvec3_t<simdfloat> simdvec3;
+typedef simdvec3_t<simdfloat8> simdvec3_8;
+#ifdef SIMD_AVX512
+typedef simdvec3_t<simdfloat16> simdvec3_16;
+#endif
+
+template<typename T> __forceinline simdvec3_t<T> operator *(const T& f, const simdvec3_t<T>& b) { return simdvec3_t<T>(f * b.x, f * b.y, f * b.z); }
 
-__forceinline simdvec3 operator *(const simdvec3& a, const simdvec3& b) { return simdvec3(a.x * b.x, a.y * b.y, a.z * b.z); }
-__forceinline simdvec3 operator -(const simdvec3& a, const simdvec3& b) { return simdvec3(a.x - b.x, a.y - b.y, a.z - b.z); }
-__forceinline simdvec3 operator +(const simdvec3& a, const simdvec3& b) { return simdvec3(a.x + b.x, a.y + b.y, a.z + b.z); }
-__forceinline simdvec3 operator /(const simdvec3& a, const simdvec3& b) { return simdvec3(a.x / b.x, a.y / b.y, a.z / b.z); }
+template<typename T> __forceinline simdvec3_t<T> operator *(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return simdvec3_t<T>(a.x * b.x, a.y * b.y, a.z * b.z); }
+template<typename T> __forceinline simdvec3_t<T> operator -(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return simdvec3_t<T>(a.x - b.x, a.y - b.y, a.z - b.z); }
+template<typename T> __forceinline simdvec3_t<T> operator +(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return simdvec3_t<T>(a.x + b.x, a.y + b.y, a.z + b.z); }
+template<typename T> __forceinline simdvec3_t<T> operator /(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return simdvec3_t<T>(a.x / b.x, a.y / b.y, a.z / b.z); }
 
-__forceinline simdfloat dot(const simdvec3& a, const simdvec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
-__forceinline simdvec3 abs(const simdvec3& a) { return simdvec3(abs(a.x), abs(a.y), abs(a.z)); }
-__forceinline simdvec3 rcp(const simdvec3& a) { return simdvec3(rcp(a.x), rcp(a.y), rcp(a.z)); }
+template<typename T> __forceinline T dot(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+template<typename T> __forceinline simdvec3_t<T> abs(const simdvec3_t<T>& a) { return simdvec3_t<T>(abs(a.x), abs(a.y), abs(a.z)); }
+template<typename T> __forceinline simdvec3_t<T> rcp(const simdvec3_t<T>& a) { return simdvec3_t<T>(rcp(a.x), rcp(a.y), rcp(a.z)); }
+template<typename T> __forceinline simdvec3_t<T> min(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return simdvec3_t<T>(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z)); }
+template<typename T> __forceinline simdvec3_t<T> max(const simdvec3_t<T>& a, const simdvec3_t<T>& b) { return simdvec3_t<T>(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z)); }
 
 template<typename T, typename U>
 __forceinline static T mix(T const & x, T const & y, U const & a)
@@ -91,68 +250,90 @@ __forceinline static T mix(T const & x, T const & y, U const & a)
 
 /*****************  simdvec4  *********************/
 
-struct simdvec4
+template<typename simdfloatT>
+struct simdvec4_t
 {
-   simdvec4() {}
-   explicit simdvec4(const simdfloat& f) : x(f), y(f), z(f), w(f) {}
-   explicit simdvec4(const vec4& v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
-   simdvec4(simdfloat x, simdfloat y, simdfloat z, simdfloat w) : x(x), y(y), z(z), w(w) {}
+   simdvec4_t() {}
+   explicit simdvec4_t(const simdfloatT& f) : x(f), y(f), z(f), w(f) {}
+   explicit simdvec4_t(const vec4& v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
+   simdvec4_t(simdfloatT x, simdfloatT y, simdfloatT z, simdfloatT w) : x(x), y(y), z(z), w(w) {}
 
-   simdfloat x;
-   simdfloat y;
-   simdfloat z;
-   simdfloat w;
+   simdfloatT x;
+   simdfloatT y;
+   simdfloatT z;
+   simdfloatT w;
 
-   __forceinline const simdvec4 operator -(const simdvec4& a) { return simdvec4(-a.x, -a.y, -a.z, -a.w); }
+   __forceinline const simdvec4_t operator -(const simdvec4_t& a) { return simdvec4_t(-a.x, -a.y, -a.z, -a.w); }
 };
 
-__forceinline simdvec4 operator *(const simdfloat& f, const simdvec4& b) { return simdvec4(f * b.x, f * b.y, f * b.z, f* b.w); }
+typedef simdvec4_t<simdfloat> simdvec4;
+typedef simdvec4_t<simdfloat8> simdvec4_8;
+#ifdef SIMD_AVX512
+typedef simdvec4_t<simdfloat16> simdvec4_16;
+#endif
 
-__forceinline simdvec4 operator *(const simdvec4& a, const simdvec4& b) { return simdvec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w); }
-__forceinline simdvec4 operator -(const simdvec4& a, const simdvec4& b) { return simdvec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
-__forceinline simdvec4 operator +(const simdvec4& a, const simdvec4& b) { return simdvec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
-__forceinline simdvec4 operator /(const simdvec4& a, const simdvec4& b) { return simdvec4(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w); }
+template<typename T> __forceinline simdvec4_t<T> operator *(const T& f, const simdvec4_t<T>& b) { return simdvec4_t<T>(f * b.x, f * b.y, f * b.z, f* b.w); }
 
-__forceinline simdfloat dot(const simdvec4& a, const simdvec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w+b.w; }
-__forceinline simdvec4 abs(const simdvec4& a) { return simdvec4(abs(a.x), abs(a.y), abs(a.z), abs(a.w)); }
+template<typename T> __forceinline simdvec4_t<T> operator *(const simdvec4_t<T>& a, const simdvec4_t<T>& b) { return simdvec4_t<T>(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w); }
+template<typename T> __forceinline simdvec4_t<T> operator -(const simdvec4_t<T>& a, const simdvec4_t<T>& b) { return simdvec4_t<T>(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+template<typename T> __forceinline simdvec4_t<T> operator +(const simdvec4_t<T>& a, const simdvec4_t<T>& b) { return simdvec4_t<T>(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+template<typename T> __forceinline simdvec4_t<T> operator /(const simdvec4_t<T>& a, const simdvec4_t<T>& b) { return simdvec4_t<T>(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w); }
+
+template<typename T> __forceinline T dot(const simdvec4_t<T>& a, const simdvec4_t<T>& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w+b.w; }
+template<typename T> __forceinline simdvec4_t<T> abs(const simdvec4_t<T>& a) { return simdvec4_t<T>(abs(a.x), abs(a.y), abs(a.z), abs(a.w)); }
 
 
 /*****************  simdmat4  *********************/
 
-struct simdmat4
+template<typename simdfloatT>
+struct simdmat4_t
 {
-   simdmat4() {}
-   explicit simdmat4(const mat4& v) : m {simdvec4(v[0]) , simdvec4(v[1]), simdvec4(v[2]), simdvec4(v[3]) } {}
-   
-   simdvec4 m[4];
+   simdmat4_t() {}
+   explicit simdmat4_t(const mat4& v) : m {simdvec4_t<simdfloatT>(v[0]) , simdvec4_t<simdfloatT>(v[1]), simdvec4_t<simdfloatT>(v[2]), simdvec4_t<simdfloatT>(v[3]) } {}
+
+   simdvec4_t<simdfloatT> m[4];
 
 };
 
-__forceinline simdvec4 operator *(const simdmat4& mat, const simdvec4& v)
+typedef simdmat4_t<simdfloat> simdmat4;
+typedef simdmat4_t<simdfloat8> simdmat4_8;
+#ifdef SIMD_AVX512
+typedef simdmat4_t<simdfloat16> simdmat4_16;
+#endif
+
+template<typename T>
+__forceinline simdvec4_t<T> operator *(const simdmat4_t<T>& mat, const simdvec4_t<T>& v)
 {
-   simdvec4 mov0(v.x);
-   simdvec4 mov1(v.y);
-   simdvec4 mul0 = mat.m[0] * mov0;
-   simdvec4 mul1 = mat.m[1] * mov1;
-   simdvec4 add0 = mul0 + mul1;
-   simdvec4 mov2(v.z);
-   simdvec4 mov3(v.w);
-   simdvec4 mul2 = mat.m[2] * mov2;
-   simdvec4 mul3 = mat.m[3] * mov3;
-   simdvec4 add1 = mul2 + mul3;
-   simdvec4 add2 = add0 + add1;
+   simdvec4_t<T> mov0(v.x);
+   simdvec4_t<T> mov1(v.y);
+   simdvec4_t<T> mul0 = mat.m[0] * mov0;
+   simdvec4_t<T> mul1 = mat.m[1] * mov1;
+   simdvec4_t<T> add0 = mul0 + mul1;
+   simdvec4_t<T> mov2(v.z);
+   simdvec4_t<T> mov3(v.w);
+   simdvec4_t<T> mul2 = mat.m[2] * mov2;
+   simdvec4_t<T> mul3 = mat.m[3] * mov3;
+   simdvec4_t<T> add1 = mul2 + mul3;
+   simdvec4_t<T> add2 = add0 + add1;
    return add2;
 }
 
 /*****************  simdfrustum  *********************/
-struct simdfrustum
+template<typename simdfloatT>
+struct simdfrustum_t
 {
-   simdfloat left;
-   simdfloat right;
-   simdfloat bottom;
-   simdfloat top;   
-   simdfloat near;
-   simdfloat far;
+   simdfloatT left;
+   simdfloatT right;
+   simdfloatT bottom;
+   simdfloatT top;
+   simdfloatT near;
+   simdfloatT far;
 };
 
-}
\ No newline at end of file
+typedef simdfrustum_t<simdfloat> simdfrustum;
+typedef simdfrustum_t<simdfloat8> simdfrustum_8;
+#ifdef SIMD_AVX512
+typedef simdfrustum_t<simdfloat16> simdfrustum_16;
+#endif
+
+}
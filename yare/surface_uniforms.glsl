@@ -1,7 +1,28 @@
 
-layout(std140, binding = BI_SURFACE_DYNAMIC_UNIFORMS) uniform SurfaceDynamicUniforms
+// the vertex shaders that read these need GL_ARB_shader_draw_parameters enabled
+struct SurfaceDynamicUniforms
 {
-   mat4 matrix_proj_local;
-   mat4 normal_matrix_world_local;
-   mat4x3 matrix_world_local;
-};
\ No newline at end of file
+   mat4 proj_local;
+   mat4 normal_world_local;
+   mat4x3 world_local;
+   vec4 world_bounds_center; // w is 0 when the surface is never culled
+   vec4 world_bounds_extent;
+};
+
+layout(std430, binding = BI_SURFACE_DYNAMIC_UNIFORMS_SSBO) readonly buffer SurfaceDynamicUniformsSSBO
+{
+   SurfaceDynamicUniforms surface_uniforms[];
+};
+
+// surface index of each draw of the frame, a multi draw reads it at surface_draw_base + gl_DrawIDARB, a single draw at surface_draw_base
+layout(std430, binding = BI_DRAW_SURFACE_INDICES_SSBO) readonly buffer DrawSurfaceIndicesSSBO
+{
+   int draw_surface_indices[];
+};
+
+layout(location = BI_SURFACE_DRAW_BASE) uniform int surface_draw_base;
+
+#define surface_index draw_surface_indices[surface_draw_base + gl_DrawIDARB]
+#define matrix_proj_local surface_uniforms[surface_index].proj_local
+#define normal_matrix_world_local surface_uniforms[surface_index].normal_world_local
+#define matrix_world_local surface_uniforms[surface_index].world_local